@@ -0,0 +1,40 @@
+// Stand-in for the engine header, just enough to build mjpeg_streamer.hpp outside Unreal for these benchmarks.
+// Log lines go to stderr.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+
+typedef int32_t int32;
+typedef int64_t int64;
+typedef uint8_t uint8;
+typedef uint32_t uint32;
+typedef uint64_t uint64;
+
+struct FString {
+    std::string s;
+    FString() {}
+    FString(const char* c) : s(c) {}
+    const char* operator*() const { return s.c_str(); }
+};
+
+#define TEXT(x) x
+#define UE_LOG(Category, Verbosity, Format, ...) std::fprintf(stderr, Format "\n", ##__VA_ARGS__)
+
+template <class T>
+decltype(auto) MoveTemp(T&& t) {
+    return std::move(t);
+}
+
+struct FMath {
+    template <class T>
+    static T Max(T a, T b) { return a > b ? a : b; }
+    template <class T>
+    static T Min(T a, T b) { return a < b ? a : b; }
+    template <class T>
+    static T Clamp(T v, T lo, T hi) { return v < lo ? lo : (v > hi ? hi : v); }
+};
@@ -0,0 +1,100 @@
+// Connection storm against the listener: client threads connect, fetch a ?snapshot of a 200 KB frame with
+// Connection: close and hang up, optionally paced to a target rate. Reports connect-to-close latency and
+// throughput. See README.md for building.
+//
+// usage: connection_storm <listener loops> <connections per second, 0 = unpaced> <connections> [client threads]
+
+#include "CoreMinimal.h"
+#include "mjpeg_streamer.hpp"
+
+#include <netinet/in.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static const int PORT = 18090;
+
+// Microseconds from connect to the server closing the connection, < 0 if the connect failed
+static double fetchSnapshot() {
+    auto start = Clock::now();
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(PORT);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    const char request[] = "GET /stream.mjpg?snapshot HTTP/1.1\r\nConnection: close\r\n\r\n";
+    send(fd, request, sizeof(request) - 1, 0);
+    char buffer[4096];
+    while (recv(fd, buffer, sizeof(buffer), 0) > 0) {
+    }
+    close(fd);
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        std::fprintf(stderr, "usage: %s <listener loops> <connections per second, 0 = unpaced> <connections> [client threads]\n", argv[0]);
+        return 1;
+    }
+    int loops = std::atoi(argv[1]);
+    int rate = std::atoi(argv[2]);
+    int total = std::atoi(argv[3]);
+    int client_threads = argc > 4 ? std::atoi(argv[4]) : 8;
+
+    nadjieb::MJPEGStreamer streamer;
+    streamer.setListenerThreads(loops);
+    if (!streamer.start(PORT, 2)) {
+        return 1;
+    }
+    streamer.publish("/stream.mjpg", std::string(200000, 'x'));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::vector<double> latencies;
+    std::mutex latencies_mtx;
+    std::vector<std::thread> clients;
+    int failed = 0;
+    auto start = Clock::now();
+    for (int c = 0; c < client_threads; ++c) {
+        clients.emplace_back([&, c]() {
+            for (int i = c; i < total; i += client_threads) {
+                if (rate > 0) {
+                    std::this_thread::sleep_until(start + std::chrono::microseconds((int64_t)i * 1000000 / rate));
+                }
+                double latency = fetchSnapshot();
+                std::lock_guard<std::mutex> lock(latencies_mtx);
+                if (latency < 0) {
+                    ++failed;
+                } else {
+                    latencies.push_back(latency);
+                }
+            }
+        });
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    int running_loops = streamer.getListenerThreads();
+    streamer.stop();
+
+    if (latencies.empty()) {
+        std::fprintf(stderr, "no connection succeeded\n");
+        return 1;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    std::printf(
+        "loops=%d rate=%d connections=%zu failed=%d p50=%.0fus p99=%.0fus max=%.0fus throughput=%.0f conn/s\n",
+        running_loops, rate, latencies.size(), failed, latencies[latencies.size() / 2],
+        latencies[latencies.size() * 99 / 100], latencies.back(), latencies.size() / seconds);
+    return 0;
+}
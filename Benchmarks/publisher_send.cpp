@@ -0,0 +1,129 @@
+// Server CPU per delivered frame of the publisher workers, poll/send against io_uring. Clients run in a forked
+// process that reads every stream through epoll, so their CPU is not counted. See README.md for building.
+//
+// usage: publisher_send <backend: poll | uring> <topics> <clients per topic> <frame bytes> <fps>
+
+#include "CoreMinimal.h"
+#include "mjpeg_streamer.hpp"
+
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static const int SECONDS = 4;
+// Multipart boundary and part headers per frame, roughly
+static const int HEADER_BYTES = 80;
+
+// User plus system CPU of this process in seconds
+static double processCpu() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// Connects clients_per_topic clients to every topic, signals ready_fd and reads until the run is over.
+// Writes the bytes received to ready_fd
+static void runClients(int port, int topics, int clients_per_topic, int ready_fd) {
+    int epoll_fd = epoll_create1(0);
+    for (int t = 0; t < topics; ++t) {
+        for (int c = 0; c < clients_per_topic; ++c) {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(port);
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            connect(fd, (sockaddr*)&address, sizeof(address));
+            std::string request = "GET /t" + std::to_string(t) + " HTTP/1.1\r\n\r\n";
+            send(fd, request.data(), request.size(), 0);
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = fd;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        }
+    }
+    write(ready_fd, "r", 1);
+
+    static char buffer[1 << 20];
+    long long total = 0;
+    auto end = Clock::now() + std::chrono::seconds(SECONDS + 1);
+    epoll_event events[64];
+    while (Clock::now() < end) {
+        int count = epoll_wait(epoll_fd, events, 64, 100);
+        for (int i = 0; i < count; ++i) {
+            ssize_t received;
+            while ((received = recv(events[i].data.fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0) {
+                total += received;
+            }
+        }
+    }
+    write(ready_fd, &total, sizeof(total));
+}
+
+int main(int argc, char** argv) {
+    if (argc < 6) {
+        std::fprintf(stderr, "usage: %s <poll | uring> <topics> <clients per topic> <frame bytes> <fps>\n", argv[0]);
+        return 1;
+    }
+    bool uring = std::strcmp(argv[1], "uring") == 0;
+    int topics = std::atoi(argv[2]);
+    int clients_per_topic = std::atoi(argv[3]);
+    int frame_size = std::atoi(argv[4]);
+    int fps = std::atoi(argv[5]);
+    int port = uring ? 18101 : 18100;
+
+    nadjieb::MJPEGStreamer streamer;
+    streamer.setSendBackend(uring ? nadjieb::net::SendBackend::IO_URING : nadjieb::net::SendBackend::POLL);
+    if (!streamer.start(port, 2)) {
+        return 1;
+    }
+    for (int t = 0; t < topics; ++t) {
+        streamer.publish("/t" + std::to_string(t), std::string(10, 'x'));
+    }
+
+    int pipe_fds[2];
+    pipe(pipe_fds);
+    pid_t pid = fork();
+    if (pid == 0) {
+        runClients(port, topics, clients_per_topic, pipe_fds[1]);
+        _exit(0);
+    }
+    char ready;
+    read(pipe_fds[0], &ready, 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    std::string frame(frame_size, 'j');
+    double cpu_start = processCpu();
+    auto start = Clock::now();
+    long published = 0;
+    while (Clock::now() < start + std::chrono::seconds(SECONDS)) {
+        std::this_thread::sleep_until(start + std::chrono::microseconds((long)published * 1000000 / fps));
+        for (int t = 0; t < topics; ++t) {
+            streamer.publish("/t" + std::to_string(t), frame);
+        }
+        ++published;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    double cpu = processCpu() - cpu_start;
+
+    long long received = 0;
+    read(pipe_fds[0], &received, sizeof(received));
+    waitpid(pid, nullptr, 0);
+    bool used_uring = streamer.getSendBackend() == nadjieb::net::SendBackend::IO_URING;
+    streamer.stop();
+
+    double delivered = received / (double)(frame_size + HEADER_BYTES);
+    std::printf(
+        "%-8s topics=%d clients=%d frame=%dKB offered=%ld frames/s delivered=%.0f frames/s cpu=%.2fs %.1fus/frame\n",
+        used_uring ? "io_uring" : "poll", topics, topics * clients_per_topic, frame_size / 1024,
+        (long)topics * clients_per_topic * fps, delivered / SECONDS, cpu, cpu * 1e6 / delivered);
+    return 0;
+}
@@ -0,0 +1,127 @@
+// Server CPU per delivered frame with plain sends against MSG_ZEROCOPY, for large frames to many clients.
+// Clients run in a forked process on loopback, where the kernel always copies: the plugin then falls back to
+// plain sends, and this shows what that detection costs. The savings themselves need a NIC with scatter-gather.
+// See README.md for building.
+//
+// usage: zerocopy_send <send | zerocopy> <clients> <frame bytes> <fps>
+
+#include "CoreMinimal.h"
+#include "mjpeg_streamer.hpp"
+
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static const int SECONDS = 3;
+// Multipart boundary and part headers per frame, roughly
+static const int HEADER_BYTES = 80;
+
+// User plus system CPU of this process in seconds
+static double processCpu() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// Connects clients to /stream.mjpg, signals ready_fd and reads until the run is over.
+// Writes the bytes received to ready_fd
+static void runClients(int port, int clients, int ready_fd) {
+    int epoll_fd = epoll_create1(0);
+    for (int c = 0; c < clients; ++c) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        connect(fd, (sockaddr*)&address, sizeof(address));
+        std::string request = "GET /stream.mjpg HTTP/1.1\r\n\r\n";
+        send(fd, request.data(), request.size(), 0);
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+    write(ready_fd, "r", 1);
+
+    static char buffer[1 << 20];
+    long long total = 0;
+    auto end = Clock::now() + std::chrono::seconds(SECONDS + 1);
+    epoll_event events[128];
+    while (Clock::now() < end) {
+        int count = epoll_wait(epoll_fd, events, 128, 100);
+        for (int i = 0; i < count; ++i) {
+            ssize_t received;
+            while ((received = recv(events[i].data.fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0) {
+                total += received;
+            }
+        }
+    }
+    write(ready_fd, &total, sizeof(total));
+}
+
+int main(int argc, char** argv) {
+    if (argc < 5) {
+        std::fprintf(stderr, "usage: %s <send | zerocopy> <clients> <frame bytes> <fps>\n", argv[0]);
+        return 1;
+    }
+    bool zerocopy = std::strcmp(argv[1], "zerocopy") == 0;
+    int clients = std::atoi(argv[2]);
+    int frame_size = std::atoi(argv[3]);
+    int fps = std::atoi(argv[4]);
+    int port = zerocopy ? 18121 : 18120;
+
+    nadjieb::MJPEGStreamer streamer;
+    if (zerocopy) {
+        streamer.setZeroCopyThreshold(256 * 1024);
+    }
+    if (!streamer.start(port, 2)) {
+        return 1;
+    }
+    streamer.publish("/stream.mjpg", std::string(10, 'x'));
+
+    int pipe_fds[2];
+    pipe(pipe_fds);
+    pid_t pid = fork();
+    if (pid == 0) {
+        runClients(port, clients, pipe_fds[1]);
+        _exit(0);
+    }
+    char ready;
+    read(pipe_fds[0], &ready, 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    double cpu_start = processCpu();
+    auto start = Clock::now();
+    long published = 0;
+    while (Clock::now() < start + std::chrono::seconds(SECONDS)) {
+        std::this_thread::sleep_until(start + std::chrono::microseconds((long)published * 1000000 / fps));
+        // A fresh frame each time, as the encoder produces them
+        streamer.publish("/stream.mjpg", std::string(frame_size, 'j'));
+        ++published;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    double cpu = processCpu() - cpu_start;
+
+    long long received = 0;
+    read(pipe_fds[0], &received, sizeof(received));
+    waitpid(pid, nullptr, 0);
+    auto stats = streamer.getZeroCopyStats();
+    streamer.stop();
+
+    double delivered = received / (double)(frame_size + HEADER_BYTES);
+    std::printf(
+        "%-8s clients=%d frame=%dKB delivered=%.0f/%ld frames/s cpu=%.1fus/frame zerocopy sends=%llu completed=%llu copied=%llu\n",
+        zerocopy ? "zerocopy" : "send", clients, frame_size / 1024, delivered / SECONDS, (long)clients * fps,
+        cpu * 1e6 / delivered, (unsigned long long)stats.sends, (unsigned long long)stats.completed,
+        (unsigned long long)stats.copied);
+    return 0;
+}
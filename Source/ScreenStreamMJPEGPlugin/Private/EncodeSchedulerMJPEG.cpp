@@ -0,0 +1,308 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "EncodeSchedulerMJPEG.h"
+
+#include "HAL/Event.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+
+#include <atomic>
+
+// One encode thread. Sleeps on WakeEvent while the scheduler has nothing for it
+class FEncodeWorkerMJPEG : public FRunnable
+{
+public:
+    FEncodeWorkerMJPEG(FEncodeSchedulerMJPEG &InScheduler, int32 InIndex)
+        : Scheduler(InScheduler), Index(InIndex), WakeEvent(FPlatformProcess::GetSynchEventFromPool(false))
+    {
+        const uint64 AffinityMask = Scheduler.ThreadAffinityMask != 0 ? Scheduler.ThreadAffinityMask : FPlatformAffinity::GetNoAffinityMask();
+        Thread = FRunnableThread::Create(this, *FString::Printf(TEXT("MJPEGEncode%d"), Index), 0, Scheduler.ThreadPriority, AffinityMask);
+    }
+
+    virtual ~FEncodeWorkerMJPEG() override
+    {
+        bStop = true;
+        WakeEvent->Trigger();
+        if (Thread)
+        {
+            Thread->WaitForCompletion();
+            delete Thread;
+        }
+        FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+    }
+
+    virtual uint32 Run() override
+    {
+        while (Scheduler.RunJobs(*this))
+        {
+            WakeEvent->Wait();
+        }
+        return 0;
+    }
+
+    FEncodeSchedulerMJPEG &Scheduler;
+    const int32 Index;
+    FEvent *WakeEvent;
+    FRunnableThread *Thread = nullptr;
+    std::atomic<bool> bStop{false};
+};
+
+FEncodeQueueMJPEG::~FEncodeQueueMJPEG()
+{
+    // Neither ready nor running, the scheduler holds a reference while it is either
+    for (FJob &Job : WaitingJobs)
+    {
+        if (Job.Drop)
+        {
+            Job.Drop();
+        }
+    }
+}
+
+void FEncodeQueueMJPEG::SetPriority(int32 InPriority)
+{
+    FScopeLock ScopeLock(&Scheduler.Lock);
+    Priority = InPriority;
+}
+
+void FEncodeQueueMJPEG::SetMaxWaitingJobs(int32 Count)
+{
+    FScopeLock ScopeLock(&Scheduler.Lock);
+    MaxWaitingJobs = FMath::Max(Count, 1);
+}
+
+void FEncodeQueueMJPEG::Submit(TUniqueFunction<void()> Encode, TUniqueFunction<void()> Drop, double DeadlineSeconds)
+{
+    TArray<FJob> DroppedJobs;
+    {
+        FScopeLock ScopeLock(&Scheduler.Lock);
+        WaitingJobs.Add({MoveTemp(Encode), MoveTemp(Drop), DeadlineSeconds});
+        if (Scheduler.bShutdown)
+        {
+            DroppedJobs = MoveTemp(WaitingJobs);
+        }
+        while (WaitingJobs.Num() > MaxWaitingJobs)
+        {
+            DroppedJobs.Add(MoveTemp(WaitingJobs[0]));
+            WaitingJobs.RemoveAt(0);
+        }
+        if (WaitingJobs.Num() > 0)
+        {
+            Scheduler.MakeReady(*this);
+        }
+    }
+
+    // Outside the lock, drop callbacks may submit again
+    for (FJob &Job : DroppedJobs)
+    {
+        if (Job.Drop)
+        {
+            Job.Drop();
+        }
+    }
+}
+
+void FEncodeQueueMJPEG::Flush()
+{
+    for (;;)
+    {
+        TArray<FJob> DroppedJobs;
+        bool bWaitForRunning = false;
+        {
+            FScopeLock ScopeLock(&Scheduler.Lock);
+            DroppedJobs = MoveTemp(WaitingJobs);
+            if (bReady)
+            {
+                Scheduler.ReadyQueues.RemoveAll([this](const TSharedPtr<FEncodeQueueMJPEG, ESPMode::ThreadSafe> &Queue) { return Queue.Get() == this; });
+                bReady = false;
+            }
+            bWaitForRunning = bRunning;
+        }
+
+        for (FJob &Job : DroppedJobs)
+        {
+            if (Job.Drop)
+            {
+                Job.Drop();
+            }
+        }
+        if (!bWaitForRunning)
+        {
+            return;
+        }
+
+        // A single encode takes a few milliseconds
+        FPlatformProcess::Sleep(0.0005f);
+    }
+}
+
+FEncodeSchedulerMJPEG &FEncodeSchedulerMJPEG::Get()
+{
+    static FEncodeSchedulerMJPEG Scheduler;
+    return Scheduler;
+}
+
+FEncodeSchedulerMJPEG::FEncodeSchedulerMJPEG()
+    : MaxThreads(FMath::Clamp(FPlatformMisc::NumberOfCores() / 2, 1, 4))
+{
+}
+
+FEncodeSchedulerMJPEG::~FEncodeSchedulerMJPEG()
+{
+    Shutdown();
+}
+
+TSharedRef<FEncodeQueueMJPEG, ESPMode::ThreadSafe> FEncodeSchedulerMJPEG::CreateQueue()
+{
+    return MakeShareable(new FEncodeQueueMJPEG(*this));
+}
+
+void FEncodeSchedulerMJPEG::SetMaxThreads(int32 Count)
+{
+    FScopeLock ScopeLock(&Lock);
+    MaxThreads = FMath::Clamp(Count, 1, 64);
+
+    // Parked threads below the new limit look for work again
+    for (FEncodeWorkerMJPEG *Worker : Workers)
+    {
+        Worker->WakeEvent->Trigger();
+    }
+    for (int32 Started = 0; !bShutdown && Started < ReadyQueues.Num() && Workers.Num() < MaxThreads; ++Started)
+    {
+        Workers.Add(new FEncodeWorkerMJPEG(*this, Workers.Num()));
+    }
+}
+
+int32 FEncodeSchedulerMJPEG::GetMaxThreads() const
+{
+    FScopeLock ScopeLock(&Lock);
+    return MaxThreads;
+}
+
+int32 FEncodeSchedulerMJPEG::GetNumThreads() const
+{
+    FScopeLock ScopeLock(&Lock);
+    return Workers.Num();
+}
+
+void FEncodeSchedulerMJPEG::SetThreadPlacement(EThreadPriority Priority, uint64 AffinityMask)
+{
+    FScopeLock ScopeLock(&Lock);
+    ThreadPriority = Priority;
+    ThreadAffinityMask = AffinityMask;
+    for (FEncodeWorkerMJPEG *Worker : Workers)
+    {
+        if (Worker->Thread)
+        {
+            Worker->Thread->SetThreadPriority(Priority);
+        }
+    }
+}
+
+void FEncodeSchedulerMJPEG::Shutdown()
+{
+    TArray<FEncodeWorkerMJPEG *> StoppedWorkers;
+    {
+        FScopeLock ScopeLock(&Lock);
+        bShutdown = true;
+        StoppedWorkers = MoveTemp(Workers);
+        IdleWorkers.Reset();
+    }
+
+    // Joins the threads, which need the lock to notice the shutdown
+    for (FEncodeWorkerMJPEG *Worker : StoppedWorkers)
+    {
+        delete Worker;
+    }
+}
+
+void FEncodeSchedulerMJPEG::MakeReady(FEncodeQueueMJPEG &Queue)
+{
+    if (Queue.bRunning || Queue.bReady)
+    {
+        // The thread running it requeues it when done
+        return;
+    }
+
+    Queue.bReady = true;
+    ReadyQueues.Add(Queue.AsShared());
+
+    if (IdleWorkers.Num() > 0)
+    {
+        IdleWorkers.Pop()->WakeEvent->Trigger();
+    }
+    else if (!bShutdown && Workers.Num() < MaxThreads)
+    {
+        Workers.Add(new FEncodeWorkerMJPEG(*this, Workers.Num()));
+    }
+}
+
+bool FEncodeSchedulerMJPEG::RunJobs(FEncodeWorkerMJPEG &Worker)
+{
+    for (;;)
+    {
+        TSharedPtr<FEncodeQueueMJPEG, ESPMode::ThreadSafe> Queue;
+        FEncodeQueueMJPEG::FJob Job;
+        {
+            FScopeLock ScopeLock(&Lock);
+            if (bShutdown || Worker.bStop)
+            {
+                return false;
+            }
+
+            // Threads above the limit stay parked until SetMaxThreads raises it again
+            if (Worker.Index >= MaxThreads)
+            {
+                IdleWorkers.Remove(&Worker);
+                return true;
+            }
+
+            // Highest priority first, the longest waiting queue among equals
+            int32 Best = INDEX_NONE;
+            for (int32 Index = 0; Index < ReadyQueues.Num(); ++Index)
+            {
+                if (Best == INDEX_NONE || ReadyQueues[Index]->Priority > ReadyQueues[Best]->Priority)
+                {
+                    Best = Index;
+                }
+            }
+            if (Best == INDEX_NONE)
+            {
+                IdleWorkers.AddUnique(&Worker);
+                return true;
+            }
+
+            Queue = ReadyQueues[Best];
+            ReadyQueues.RemoveAt(Best);
+            Queue->bReady = false;
+            Queue->bRunning = true;
+            Job = MoveTemp(Queue->WaitingJobs[0]);
+            Queue->WaitingJobs.RemoveAt(0);
+        }
+
+        // Frames that waited past their deadline are stale, encoding them would only delay the next ones
+        if (Job.DeadlineSeconds > 0.0 && FPlatformTime::Seconds() > Job.DeadlineSeconds)
+        {
+            if (Job.Drop)
+            {
+                Job.Drop();
+            }
+        }
+        else if (Job.Encode)
+        {
+            Job.Encode();
+        }
+
+        {
+            FScopeLock ScopeLock(&Lock);
+            Queue->bRunning = false;
+            if (Queue->WaitingJobs.Num() > 0)
+            {
+                // Back of the line, so streams of equal priority take turns
+                Queue->bReady = true;
+                ReadyQueues.Add(Queue);
+            }
+        }
+    }
+}
@@ -0,0 +1,579 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "FrameSourceMJPEG.h"
+#include "StreamManagerMJPEG.h"
+
+#include "Runtime/Engine/Classes/Engine/Engine.h"
+
+#include "UnrealClient.h"
+#include "TextureResource.h"
+#include "Engine/SceneCapture2D.h"
+#include "Components/SceneCaptureComponent2D.h"
+#include "Engine/TextureRenderTarget2D.h"
+
+#include "Engine/GameViewportClient.h"
+#include "Framework/Application/SlateApplication.h"
+#include "Rendering/SlateRenderer.h"
+#include "Widgets/SWindow.h"
+
+#include "RHI.h"
+#include "RHICommandList.h"
+#include "RenderingThread.h"
+#include "RendererInterface.h"
+#include "ScreenRendering.h"
+#include "CommonRenderResources.h"
+#include "PipelineStateCache.h"
+#include "ShaderParameterUtils.h"
+#include "Misc/EngineVersionComparison.h"
+
+#include <atomic>
+
+// Timestamps around the scene render of one capture. The queries are only touched on the render thread
+struct FCaptureGpuTimerMJPEG
+{
+    FRenderQueryRHIRef Begin;
+    FRenderQueryRHIRef End;
+
+    // Exponential moving average, written on the render thread
+    std::atomic<float> AverageMs{0.0f};
+};
+
+FSceneCaptureFrameSourceMJPEG::FSceneCaptureFrameSourceMJPEG(ASceneCapture2D *InCaptureActor, bool bInVerboseLogging, bool bInCaptureOnRequest)
+    : CaptureActor(InCaptureActor), bVerboseLogging(bInVerboseLogging), bCaptureOnRequest(bInCaptureOnRequest),
+      GpuTimer(MakeShared<FCaptureGpuTimerMJPEG, ESPMode::ThreadSafe>())
+{
+}
+
+float FSceneCaptureFrameSourceMJPEG::GetGpuTimeMs() const
+{
+    return GpuTimer->AverageMs.load();
+}
+
+void FSceneCaptureFrameSourceMJPEG::ApplyCostProfile(USceneCaptureComponent2D *Component, ECaptureCostProfileMJPEG Profile)
+{
+    if (!Component || Profile == ECaptureCostProfileMJPEG::Custom)
+    {
+        return;
+    }
+
+    Component->CaptureSource = ESceneCaptureSource::SCS_FinalColorLDR;
+
+    FEngineShowFlags &Flags = Component->ShowFlags;
+    const bool bCinematic = Profile == ECaptureCostProfileMJPEG::Cinematic;
+    const bool bFast = Profile == ECaptureCostProfileMJPEG::Fast;
+
+    Flags.SetTemporalAA(bCinematic);
+    Flags.SetAntiAliasing(!bFast);
+    Flags.SetMotionBlur(bCinematic);
+    Flags.SetDepthOfField(bCinematic);
+    Flags.SetLensFlares(bCinematic);
+
+    Flags.SetBloom(!bFast);
+    Flags.SetAmbientOcclusion(!bFast);
+    Flags.SetVolumetricFog(!bFast);
+    Flags.SetScreenSpaceReflections(!bFast);
+    Flags.SetLumenReflections(!bFast);
+    Flags.SetLumenGlobalIllumination(!bFast);
+}
+
+bool FSceneCaptureFrameSourceMJPEG::IsValidSource() const
+{
+    return CaptureActor.IsValid() && CaptureActor->GetCaptureComponent2D() != nullptr;
+}
+
+void FSceneCaptureFrameSourceMJPEG::SetFrameSize(int32 Width, int32 Height)
+{
+    if (!IsValidSource() || !CaptureActor->GetCaptureComponent2D()->TextureTarget)
+    {
+        return;
+    }
+
+    CaptureActor->GetCaptureComponent2D()->TextureTarget->InitCustomFormat(Width, Height, PF_B8G8R8A8, true); // PF... disables HDR, which is most important since HDR gives gigantic overhead, and is not needed!
+}
+
+bool FSceneCaptureFrameSourceMJPEG::RequestFrame(FRenderRequestStreamMJPEGStruct &Request)
+{
+    if (!IsValidSource() || !CaptureActor->GetCaptureComponent2D()->TextureTarget)
+    {
+        UE_LOG(LogStreamMJPEG, Error, TEXT("CaptureNonBlocking: CaptureComponent was not valid!"));
+        return false;
+    }
+
+    CaptureActor->GetCaptureComponent2D()->TextureTarget->TargetGamma = GEngine->GetDisplayGamma();
+
+    // Render commands run in order: timestamp, scene render, timestamp, readback
+    const bool bTimed = bCaptureOnRequest && GSupportsTimestampRenderQueries;
+    TSharedPtr<FCaptureGpuTimerMJPEG, ESPMode::ThreadSafe> Timer = GpuTimer;
+    if (bTimed)
+    {
+        ENQUEUE_RENDER_COMMAND(StreamMJPEGCaptureBegin)
+        (
+            [Timer](FRHICommandListImmediate &RHICmdList)
+            {
+                if (!Timer->Begin.IsValid())
+                {
+                    Timer->Begin = RHICreateRenderQuery(RQT_AbsoluteTime);
+                    Timer->End = RHICreateRenderQuery(RQT_AbsoluteTime);
+                }
+                RHICmdList.EndRenderQuery(Timer->Begin);
+            });
+    }
+    if (bCaptureOnRequest)
+    {
+        CaptureActor->GetCaptureComponent2D()->CaptureScene();
+    }
+    if (bTimed)
+    {
+        ENQUEUE_RENDER_COMMAND(StreamMJPEGCaptureEnd)
+        (
+            [Timer](FRHICommandListImmediate &RHICmdList)
+            {
+                RHICmdList.EndRenderQuery(Timer->End);
+            });
+    }
+
+    // Get RenderContext
+    FTextureRenderTargetResource *renderTargetResource = CaptureActor->GetCaptureComponent2D()->TextureTarget->GameThread_GetRenderTargetResource();
+    if (bVerboseLogging)
+    {
+        UE_LOG(LogStreamMJPEG, Warning, TEXT("Got display gamma"));
+    }
+    struct FReadSurfaceContext
+    {
+        FRenderTarget *SrcRenderTarget;
+        TArray<FColor> *OutData;
+        FIntRect Rect;
+        FReadSurfaceDataFlags Flags;
+    };
+
+    // Setup GPU command
+    FReadSurfaceContext readSurfaceContext = {
+        renderTargetResource,
+        &(Request.Image),
+        FIntRect(0, 0, renderTargetResource->GetSizeXY().X, renderTargetResource->GetSizeXY().Y),
+        FReadSurfaceDataFlags(RCM_UNorm, CubeFace_MAX)};
+    if (bVerboseLogging)
+    {
+        UE_LOG(LogStreamMJPEG, Warning, TEXT("GPU Command complete"));
+    }
+
+    // Send command to GPU
+    ENQUEUE_RENDER_COMMAND(SceneDrawCompletion)
+    (
+        [readSurfaceContext, bTimed, Timer](FRHICommandListImmediate &RHICmdList)
+        {
+            RHICmdList.ReadSurfaceData(
+                readSurfaceContext.SrcRenderTarget->GetRenderTargetTexture(),
+                readSurfaceContext.Rect,
+                *readSurfaceContext.OutData,
+                readSurfaceContext.Flags);
+
+            // The readback waited for the GPU, so the timestamps are available without stalling
+            uint64 BeginUs = 0;
+            uint64 EndUs = 0;
+            if (bTimed && RHIGetRenderQueryResult(Timer->Begin, BeginUs, true) && RHIGetRenderQueryResult(Timer->End, EndUs, true) && EndUs >= BeginUs)
+            {
+                const float Ms = (EndUs - BeginUs) / 1000.0f;
+                const float Average = Timer->AverageMs.load();
+                Timer->AverageMs = Average > 0.0f ? Average * 0.9f + Ms * 0.1f : Ms;
+            }
+        });
+
+    // Image is written on the render thread, the manager waits for the render commands to run
+    Request.bReadsBackOnRenderThread = true;
+    return true;
+}
+
+FCaptureGroupFrameSourceMJPEG::FCaptureGroupFrameSourceMJPEG(const TArray<ASceneCapture2D *> &InCaptureActors, bool bInCaptureOnRequest)
+    : bCaptureOnRequest(bInCaptureOnRequest), ViewScratch(MakeShared<TArray<FColor>, ESPMode::ThreadSafe>())
+{
+    for (ASceneCapture2D *CaptureActor : InCaptureActors)
+    {
+        CaptureActors.Add(CaptureActor);
+    }
+}
+
+bool FCaptureGroupFrameSourceMJPEG::IsValidSource() const
+{
+    if (CaptureActors.Num() == 0)
+    {
+        return false;
+    }
+    for (const TWeakObjectPtr<ASceneCapture2D> &CaptureActor : CaptureActors)
+    {
+        if (!CaptureActor.IsValid() || !CaptureActor->GetCaptureComponent2D() || !CaptureActor->GetCaptureComponent2D()->TextureTarget)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void FCaptureGroupFrameSourceMJPEG::SetFrameSize(int32 Width, int32 Height)
+{
+    for (const TWeakObjectPtr<ASceneCapture2D> &CaptureActor : CaptureActors)
+    {
+        if (CaptureActor.IsValid() && CaptureActor->GetCaptureComponent2D() && CaptureActor->GetCaptureComponent2D()->TextureTarget)
+        {
+            CaptureActor->GetCaptureComponent2D()->TextureTarget->InitCustomFormat(Width, Height, PF_B8G8R8A8, true);
+        }
+    }
+}
+
+bool FCaptureGroupFrameSourceMJPEG::RequestFrame(FRenderRequestStreamMJPEGStruct &Request)
+{
+    if (!IsValidSource())
+    {
+        UE_LOG(LogStreamMJPEG, Error, TEXT("CaptureNonBlocking: a member of the capture group was not valid!"));
+        return false;
+    }
+
+    // Same size for all members, so the views can be stacked into one image
+    TArray<FRenderTarget *> RenderTargets;
+    FIntPoint Size = FIntPoint::ZeroValue;
+    for (const TWeakObjectPtr<ASceneCapture2D> &CaptureActor : CaptureActors)
+    {
+        UTextureRenderTarget2D *TextureTarget = CaptureActor->GetCaptureComponent2D()->TextureTarget;
+        FTextureRenderTargetResource *RenderTargetResource = TextureTarget->GameThread_GetRenderTargetResource();
+        if (!RenderTargetResource || (RenderTargets.Num() > 0 && RenderTargetResource->GetSizeXY() != Size))
+        {
+            UE_LOG(LogStreamMJPEG, Error, TEXT("CaptureNonBlocking: capture group members need render targets of the same size!"));
+            return false;
+        }
+        Size = RenderTargetResource->GetSizeXY();
+        RenderTargets.Add(RenderTargetResource);
+    }
+
+    // All members render the scene state of this game frame
+    for (const TWeakObjectPtr<ASceneCapture2D> &CaptureActor : CaptureActors)
+    {
+        CaptureActor->GetCaptureComponent2D()->TextureTarget->TargetGamma = GEngine->GetDisplayGamma();
+        if (bCaptureOnRequest)
+        {
+            CaptureActor->GetCaptureComponent2D()->CaptureScene();
+        }
+    }
+
+    // One render command reads back every member after all of them were rendered
+    TArray<FColor> *OutData = &Request.Image;
+    TSharedPtr<TArray<FColor>, ESPMode::ThreadSafe> Scratch = ViewScratch;
+    ENQUEUE_RENDER_COMMAND(StreamMJPEGGroupReadback)
+    (
+        [RenderTargets, Size, OutData, Scratch](FRHICommandListImmediate &RHICmdList)
+        {
+            const int64 ViewPixels = static_cast<int64>(Size.X) * Size.Y;
+            OutData->SetNumUninitialized(ViewPixels * RenderTargets.Num());
+            for (int32 View = 0; View < RenderTargets.Num(); ++View)
+            {
+                RHICmdList.ReadSurfaceData(RenderTargets[View]->GetRenderTargetTexture(), FIntRect(FIntPoint::ZeroValue, Size), *Scratch, FReadSurfaceDataFlags(RCM_UNorm, CubeFace_MAX));
+                if (Scratch->Num() >= ViewPixels)
+                {
+                    FMemory::Memcpy(OutData->GetData() + ViewPixels * View, Scratch->GetData(), ViewPixels * sizeof(FColor));
+                }
+            }
+        });
+
+    Request.bReadsBackOnRenderThread = true;
+    return true;
+}
+
+// Requests waiting for the next present of the viewport window, shared with the Slate render thread
+struct FViewportGrabStateMJPEG
+{
+    struct FPendingFrame
+    {
+        FRenderRequestStreamMJPEGStruct *Request;
+        // Only compared, never dereferenced
+        const SWindow *Window;
+        FIntPoint Size;
+        // Game frame and PresentCount when it was requested, to give up on windows that stopped presenting
+        uint64 GameFrame;
+        uint64 Presents;
+    };
+
+    // A window that was not presented for this many presents of any window, or this many game frames, is taken
+    // as gone (minimized, recreated on a fullscreen switch). Its frames fail instead of holding up the queue
+    static constexpr uint64 MaxPendingPresents = 32;
+    static constexpr uint64 MaxPendingGameFrames = 8;
+
+    // Held while a grab writes into a request, so CancelPendingFrames waits for it
+    FCriticalSection Lock;
+    TArray<FPendingFrame> PendingFrames;
+    uint64 PresentCount = 0;
+
+    // Target of the GPU downscale, only touched on the render thread
+    FTextureRHIRef ScaledTexture;
+
+    void OnBackBufferReady(SWindow &Window, const FTextureRHIRef &BackBuffer);
+
+    // Completes the pending frames requested before game frame MinGameFrame or present MinPresents with an
+    // empty image. Lock must be held
+    void FailStaleFrames(uint64 MinGameFrame, uint64 MinPresents);
+
+private:
+    FRHITexture *Scale(FRHICommandListImmediate &RHICmdList, FRHITexture *BackBuffer, FIntPoint Size);
+};
+
+void FViewportGrabStateMJPEG::OnBackBufferReady(SWindow &Window, const FTextureRHIRef &BackBuffer)
+{
+    FScopeLock ScopeLock(&Lock);
+    PresentCount++;
+    if (PresentCount > MaxPendingPresents)
+    {
+        FailStaleFrames(0, PresentCount - MaxPendingPresents);
+    }
+    if (PendingFrames.Num() == 0 || !BackBuffer.IsValid())
+    {
+        return;
+    }
+
+    FRHICommandListImmediate &RHICmdList = FRHICommandListExecutor::GetImmediateCommandList();
+    for (int32 Index = 0; Index < PendingFrames.Num();)
+    {
+        const FPendingFrame Frame = PendingFrames[Index];
+        if (Frame.Window != &Window)
+        {
+            Index++;
+            continue;
+        }
+        PendingFrames.RemoveAt(Index);
+
+        FRHITexture *Source = BackBuffer->GetSizeXY() == Frame.Size ? BackBuffer.GetReference() : Scale(RHICmdList, BackBuffer, Frame.Size);
+        RHICmdList.ReadSurfaceData(Source, FIntRect(FIntPoint::ZeroValue, Frame.Size), Frame.Request->Image, FReadSurfaceDataFlags(RCM_UNorm, CubeFace_MAX));
+        AStreamManagerMJPEG::CompleteReadback(*Frame.Request);
+    }
+}
+
+void FViewportGrabStateMJPEG::FailStaleFrames(uint64 MinGameFrame, uint64 MinPresents)
+{
+    for (int32 Index = 0; Index < PendingFrames.Num();)
+    {
+        const FPendingFrame Frame = PendingFrames[Index];
+        if (Frame.GameFrame >= MinGameFrame && Frame.Presents >= MinPresents)
+        {
+            Index++;
+            continue;
+        }
+        PendingFrames.RemoveAt(Index);
+
+        Frame.Request->Image.Reset();
+        Frame.Request->bReadbackFailed = true;
+        AStreamManagerMJPEG::CompleteReadback(*Frame.Request);
+    }
+}
+
+FRHITexture *FViewportGrabStateMJPEG::Scale(FRHICommandListImmediate &RHICmdList, FRHITexture *BackBuffer, FIntPoint Size)
+{
+    if (!ScaledTexture.IsValid() || ScaledTexture->GetSizeXY() != Size)
+    {
+        const FRHITextureCreateDesc Desc = FRHITextureCreateDesc::Create2D(TEXT("StreamMJPEGViewportScaled"), Size.X, Size.Y, PF_B8G8R8A8)
+                                               .SetFlags(ETextureCreateFlags::RenderTargetable)
+                                               .SetInitialState(ERHIAccess::RTV);
+        ScaledTexture = RHICreateTexture(Desc);
+    }
+
+    // Slate leaves the back buffer as render target before presenting
+    RHICmdList.Transition(FRHITransitionInfo(BackBuffer, ERHIAccess::RTV, ERHIAccess::SRVGraphics));
+    RHICmdList.Transition(FRHITransitionInfo(ScaledTexture, ERHIAccess::Unknown, ERHIAccess::RTV));
+
+    FRHIRenderPassInfo RenderPassInfo(ScaledTexture, ERenderTargetActions::DontLoad_Store);
+    RHICmdList.BeginRenderPass(RenderPassInfo, TEXT("StreamMJPEGViewportScale"));
+    {
+        RHICmdList.SetViewport(0.0f, 0.0f, 0.0f, Size.X, Size.Y, 1.0f);
+
+        FGlobalShaderMap *ShaderMap = GetGlobalShaderMap(GMaxRHIFeatureLevel);
+        TShaderMapRef<FScreenVS> VertexShader(ShaderMap);
+        TShaderMapRef<FScreenPS> PixelShader(ShaderMap);
+
+        FGraphicsPipelineStateInitializer GraphicsPSOInit;
+        RHICmdList.ApplyCachedRenderTargets(GraphicsPSOInit);
+        GraphicsPSOInit.BlendState = TStaticBlendState<>::GetRHI();
+        GraphicsPSOInit.RasterizerState = TStaticRasterizerState<>::GetRHI();
+        GraphicsPSOInit.DepthStencilState = TStaticDepthStencilState<false, CF_Always>::GetRHI();
+        GraphicsPSOInit.BoundShaderState.VertexDeclarationRHI = GFilterVertexDeclaration.VertexDeclarationRHI;
+        GraphicsPSOInit.BoundShaderState.VertexShaderRHI = VertexShader.GetVertexShader();
+        GraphicsPSOInit.BoundShaderState.PixelShaderRHI = PixelShader.GetPixelShader();
+        GraphicsPSOInit.PrimitiveType = PT_TriangleList;
+        SetGraphicsPipelineState(RHICmdList, GraphicsPSOInit, 0);
+
+        // Bilinear is enough for the usual 2:1 or smaller reduction
+#if UE_VERSION_OLDER_THAN(5, 3, 0)
+        PixelShader->SetParameters(RHICmdList, TStaticSamplerState<SF_Bilinear>::GetRHI(), BackBuffer);
+#else
+        SetShaderParametersLegacyPS(RHICmdList, PixelShader, TStaticSamplerState<SF_Bilinear>::GetRHI(), BackBuffer);
+#endif
+
+        const FIntPoint BackBufferSize = BackBuffer->GetSizeXY();
+        IRendererModule &RendererModule = FModuleManager::GetModuleChecked<IRendererModule>("Renderer");
+        RendererModule.DrawRectangle(RHICmdList, 0, 0, Size.X, Size.Y, 0, 0, BackBufferSize.X, BackBufferSize.Y, Size, BackBufferSize, VertexShader, EDRF_Default);
+    }
+    RHICmdList.EndRenderPass();
+
+    RHICmdList.Transition(FRHITransitionInfo(BackBuffer, ERHIAccess::SRVGraphics, ERHIAccess::RTV));
+    return ScaledTexture;
+}
+
+static TSharedPtr<SWindow> GetGameViewportWindow()
+{
+    if (!FSlateApplication::IsInitialized() || !GEngine || !GEngine->GameViewport)
+    {
+        return nullptr;
+    }
+    return GEngine->GameViewport->GetWindow();
+}
+
+FViewportFrameSourceMJPEG::FViewportFrameSourceMJPEG(int32 InWidth, int32 InHeight)
+    : Width(InWidth), Height(InHeight), State(MakeShared<FViewportGrabStateMJPEG, ESPMode::ThreadSafe>())
+{
+    if (FSlateApplication::IsInitialized() && FSlateApplication::Get().GetRenderer())
+    {
+        // Broadcast on the render thread for every window Slate presents
+        BackBufferReadyHandle = FSlateApplication::Get().GetRenderer()->OnBackBufferReadyToPresent().AddSP(State.ToSharedRef(), &FViewportGrabStateMJPEG::OnBackBufferReady);
+    }
+}
+
+FViewportFrameSourceMJPEG::~FViewportFrameSourceMJPEG()
+{
+    CancelPendingFrames();
+    if (BackBufferReadyHandle.IsValid() && FSlateApplication::IsInitialized() && FSlateApplication::Get().GetRenderer())
+    {
+        FSlateApplication::Get().GetRenderer()->OnBackBufferReadyToPresent().Remove(BackBufferReadyHandle);
+    }
+}
+
+bool FViewportFrameSourceMJPEG::IsValidSource() const
+{
+    return BackBufferReadyHandle.IsValid() && GetGameViewportWindow().IsValid();
+}
+
+void FViewportFrameSourceMJPEG::SetFrameSize(int32 InWidth, int32 InHeight)
+{
+    Width = InWidth;
+    Height = InHeight;
+}
+
+bool FViewportFrameSourceMJPEG::RequestFrame(FRenderRequestStreamMJPEGStruct &Request)
+{
+    const TSharedPtr<SWindow> Window = GetGameViewportWindow();
+    if (!BackBufferReadyHandle.IsValid() || !Window.IsValid())
+    {
+        UE_LOG(LogStreamMJPEG, Error, TEXT("CaptureNonBlocking: No game viewport window to grab!"));
+        return false;
+    }
+
+    // Also when nothing presents at all, e.g. a minimized game window that is the only one
+    if (GFrameCounter > FViewportGrabStateMJPEG::MaxPendingGameFrames)
+    {
+        FScopeLock ScopeLock(&State->Lock);
+        State->FailStaleFrames(GFrameCounter - FViewportGrabStateMJPEG::MaxPendingGameFrames, 0);
+    }
+
+    // Filled when the window is presented next, after this frame was rendered. Registered in OnRequestQueued
+    Request.bReadsBackOnRenderThread = true;
+    Request.bSignalsCompletion = true;
+    return true;
+}
+
+void FViewportFrameSourceMJPEG::OnRequestQueued(FRenderRequestStreamMJPEGStruct &Request)
+{
+    const TSharedPtr<SWindow> Window = GetGameViewportWindow();
+
+    FScopeLock ScopeLock(&State->Lock);
+    if (!Window.IsValid())
+    {
+        // Gone since RequestFrame
+        Request.bReadbackFailed = true;
+        AStreamManagerMJPEG::CompleteReadback(Request);
+        return;
+    }
+    State->PendingFrames.Add({&Request, Window.Get(), FIntPoint(Width, Height), GFrameCounter, State->PresentCount});
+}
+
+void FViewportFrameSourceMJPEG::CancelPendingFrames()
+{
+    FScopeLock ScopeLock(&State->Lock);
+    State->PendingFrames.Reset();
+}
+
+FSyntheticFrameSourceMJPEG::FSyntheticFrameSourceMJPEG(ESyntheticPatternMJPEG InPattern, int32 InWidth, int32 InHeight, uint32 InSeed)
+    : Pattern(InPattern), Width(InWidth), Height(InHeight), Seed(InSeed)
+{
+}
+
+void FSyntheticFrameSourceMJPEG::SetFrameSize(int32 InWidth, int32 InHeight)
+{
+    Width = InWidth;
+    Height = InHeight;
+}
+
+bool FSyntheticFrameSourceMJPEG::RequestFrame(FRenderRequestStreamMJPEGStruct &Request)
+{
+    if (!IsValidSource())
+    {
+        return false;
+    }
+
+    GeneratePattern(Pattern, Width, Height, Seed, FrameIndex, Request.Image);
+    FrameIndex++;
+
+    // Filled synchronously, no render thread involved
+    Request.bReadsBackOnRenderThread = false;
+    return true;
+}
+
+void FSyntheticFrameSourceMJPEG::GeneratePattern(ESyntheticPatternMJPEG Pattern, int32 Width, int32 Height, uint32 Seed, uint64 FrameIndex, TArray<FColor> &OutImage)
+{
+    OutImage.SetNumUninitialized(Width * Height);
+    FColor *Pixels = OutImage.GetData();
+
+    switch (Pattern)
+    {
+    case ESyntheticPatternMJPEG::MovingGradient:
+    {
+        // Scroll 4 px per frame, blue channel pulses with the frame index
+        const uint32 Offset = static_cast<uint32>(FrameIndex * 4) + Seed;
+        const uint8 Blue = static_cast<uint8>((FrameIndex * 3) & 0xFF);
+        for (int32 Y = 0; Y < Height; ++Y)
+        {
+            FColor *Row = Pixels + static_cast<int64>(Y) * Width;
+            const uint8 Green = static_cast<uint8>((((Y + Offset) % Height) * 255) / Height);
+            for (int32 X = 0; X < Width; ++X)
+            {
+                Row[X] = FColor(static_cast<uint8>((((X + Offset) % Width) * 255) / Width), Green, Blue, 255);
+            }
+        }
+        break;
+    }
+    case ESyntheticPatternMJPEG::Noise:
+    {
+        // xorshift32, seeded per frame so every frame is reproducible on its own
+        uint32 State = (Seed ^ static_cast<uint32>(FrameIndex * 2654435761u)) | 1u;
+        for (int64 Index = 0; Index < static_cast<int64>(Width) * Height; ++Index)
+        {
+            State ^= State << 13;
+            State ^= State >> 17;
+            State ^= State << 5;
+            Pixels[Index] = FColor(static_cast<uint8>(State), static_cast<uint8>(State >> 8), static_cast<uint8>(State >> 16), 255);
+        }
+        break;
+    }
+    case ESyntheticPatternMJPEG::Static:
+    default:
+    {
+        // SMPTE-like vertical color bars
+        static const FColor Bars[] = {
+            FColor(192, 192, 192), FColor(192, 192, 0), FColor(0, 192, 192), FColor(0, 192, 0),
+            FColor(192, 0, 192), FColor(192, 0, 0), FColor(0, 0, 192), FColor(16, 16, 16)};
+        const int32 NumBars = UE_ARRAY_COUNT(Bars);
+        for (int32 Y = 0; Y < Height; ++Y)
+        {
+            FColor *Row = Pixels + static_cast<int64>(Y) * Width;
+            for (int32 X = 0; X < Width; ++X)
+            {
+                Row[X] = Bars[(static_cast<int64>(X) * NumBars) / Width];
+            }
+        }
+        break;
+    }
+    }
+}
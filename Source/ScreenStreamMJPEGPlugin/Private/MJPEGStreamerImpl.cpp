@@ -1,6 +1,72 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "MJPEGStreamerImpl.h"
+#include "StreamManagerMJPEG.h"
+
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+
+namespace
+{
+	// A listener or publisher thread started as an engine thread, so it is named in Unreal Insights and
+	// scheduled with engine priorities
+	class FStreamerThreadMJPEG : public FRunnable, public nadjieb::utils::Thread
+	{
+	public:
+		explicit FStreamerThreadMJPEG(std::function<void()> InBody)
+			: Body(MoveTemp(InBody))
+		{
+		}
+
+		virtual ~FStreamerThreadMJPEG() override
+		{
+			join();
+		}
+
+		bool Create(const nadjieb::utils::ThreadPlacement& Placement, int Index)
+		{
+			static const EThreadPriority Priorities[] = {TPri_Lowest, TPri_BelowNormal, TPri_Normal, TPri_AboveNormal, TPri_Highest};
+			const FString Name = FString::Printf(TEXT("%s%d"), UTF8_TO_TCHAR(Placement.name.c_str()), Index);
+			const uint64 AffinityMask = Placement.affinity_mask != 0 ? Placement.affinity_mask : FPlatformAffinity::GetNoAffinityMask();
+			RunnableThread = FRunnableThread::Create(this, *Name, 0, Priorities[static_cast<int>(Placement.priority)], AffinityMask);
+			return RunnableThread != nullptr;
+		}
+
+		virtual uint32 Run() override
+		{
+			Body();
+			return 0;
+		}
+
+		virtual void join() override
+		{
+			if (RunnableThread)
+			{
+				RunnableThread->WaitForCompletion();
+				delete RunnableThread;
+				RunnableThread = nullptr;
+			}
+		}
+
+	private:
+		std::function<void()> Body;
+		FRunnableThread* RunnableThread = nullptr;
+	};
+
+	std::unique_ptr<nadjieb::utils::Thread> CreateUnrealThread(const nadjieb::utils::ThreadPlacement& Placement, int Index, std::function<void()> Body)
+	{
+		// Without multithreading FRunnableThread only fakes threads, which would never run the loops
+		if (FPlatformProcess::SupportsMultithreading())
+		{
+			auto Thread = std::make_unique<FStreamerThreadMJPEG>(Body);
+			if (Thread->Create(Placement, Index))
+			{
+				return Thread;
+			}
+		}
+		return nadjieb::utils::StdThread::create(Placement, Index, MoveTemp(Body));
+	}
+}
 
 FMJPEGStreamerImpl::FMJPEGStreamerImpl()
 {
@@ -12,17 +78,335 @@ FMJPEGStreamerImpl::~FMJPEGStreamerImpl()
 	Stop();
 }
 
-void FMJPEGStreamerImpl::Start(int Port)
+bool FMJPEGStreamerImpl::Start(int Port, const nadjieb::net::SocketOptions& Options, int NumWorkers)
+{
+	Streamer.setSocketOptions(Options);
+	return Streamer.start(Port, NumWorkers > 0 ? NumWorkers : static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+void FMJPEGStreamerImpl::SetThreadPlacement(const nadjieb::utils::ThreadPlacement& Listener, const nadjieb::utils::ThreadPlacement& Publisher, bool bUnrealThreads)
+{
+	Streamer.setThreadPlacement(Listener, Publisher, bUnrealThreads ? nadjieb::utils::ThreadFactory(CreateUnrealThread) : nullptr);
+}
+
+int FMJPEGStreamerImpl::GetPort() const
 {
-	Streamer.start(Port);
+	return Streamer.getPort();
 }
 
 void FMJPEGStreamerImpl::Stop()
 {
+	// Recorder, RTP and shared-memory subscriptions have to go before the publisher drops their topics
+	StopRecording();
+	StopRtp();
+	StopSharedMemory();
 	Streamer.stop();
+
+	if (ReplayServer)
+	{
+		ReplayServer->stopAll();
+	}
 }
 
 void FMJPEGStreamerImpl::Publish(const std::string& Path, const std::string& Buffer)
 {
 	Streamer.publish(Path, Buffer);
 }
+
+void FMJPEGStreamerImpl::Publish(const std::string& Path, std::string&& Buffer, int64 TimestampUs, int64 Sequence)
+{
+	if (Sequence < 0)
+	{
+		Streamer.publish(Path, MoveTemp(Buffer), TimestampUs);
+		return;
+	}
+	Streamer.publish(Path, MoveTemp(Buffer), TimestampUs, static_cast<uint64_t>(Sequence));
+}
+
+void FMJPEGStreamerImpl::SetFramedPath(const std::string& Path, const std::string& ContentType)
+{
+	Streamer.setFramedPath(Path, ContentType);
+}
+
+void FMJPEGStreamerImpl::SetDeltaCoded(const std::string& Path)
+{
+	Streamer.setDeltaCoded(Path);
+}
+
+void FMJPEGStreamerImpl::AddPage(const std::string& Path, const std::string& ContentType, const std::string& Body)
+{
+	nadjieb::net::RouteHandler Handler;
+	Handler.on_request = [ContentType, Body](const nadjieb::net::SocketFD& Sockfd, nadjieb::net::HTTPRequest& Req)
+	{
+		nadjieb::net::OnMessageCallbackResponse CbRes;
+		CbRes.close_conn = !Req.isKeepAlive();
+
+		const std::string& Res = nadjieb::net::ResponseBuilder::forThread()
+			.start(Req.getVersion(), 200, "OK")
+			.connection(!CbRes.close_conn)
+			.header("Content-Type", ContentType)
+			.finish(Body);
+		nadjieb::net::sendAllViaSocket(Sockfd, Res, 1000);
+		return CbRes;
+	};
+	Streamer.addRoute(Path, Handler);
+}
+
+void FMJPEGStreamerImpl::EnableRegionOfInterest(const std::string& Path, bool bClientRequests)
+{
+	// 16x16 is the MCU of 4:2:0 JPEG, so crops never split a block
+	Streamer.enableRegionOfInterest(Path, 16, bClientRequests);
+}
+
+void FMJPEGStreamerImpl::SetListenerThreads(int Count)
+{
+	Streamer.setListenerThreads(Count);
+}
+
+void FMJPEGStreamerImpl::SetUseIoUring(bool bEnable)
+{
+	Streamer.setSendBackend(bEnable ? nadjieb::net::SendBackend::IO_URING : nadjieb::net::SendBackend::POLL);
+}
+
+void FMJPEGStreamerImpl::SetZeroCopyThreshold(int64 Bytes)
+{
+	Streamer.setZeroCopyThreshold(static_cast<size_t>(FMath::Max<int64>(Bytes, 0)));
+}
+
+void FMJPEGStreamerImpl::SetSlowClientPolicy(const nadjieb::net::SlowClientPolicy& Policy)
+{
+	Streamer.setSlowClientPolicy(Policy);
+}
+
+void FMJPEGStreamerImpl::SetAdmissionPolicy(const nadjieb::net::AdmissionPolicy& Policy)
+{
+	Streamer.setAdmissionPolicy(Policy);
+}
+
+void FMJPEGStreamerImpl::ReportCpuLoad(double Load)
+{
+	Streamer.reportCpuLoad(Load);
+}
+
+nadjieb::net::AdmissionStats FMJPEGStreamerImpl::GetAdmissionStats()
+{
+	return Streamer.getAdmissionStats();
+}
+
+int32 FMJPEGStreamerImpl::GetClientCount()
+{
+	return static_cast<int32>(Streamer.getClientCount());
+}
+
+uint64 FMJPEGStreamerImpl::GetJoinCount(const std::string& Path)
+{
+	return static_cast<uint64>(Streamer.getJoinCount(Path));
+}
+
+uint64 FMJPEGStreamerImpl::GetLostFrameCount(const std::string& Path)
+{
+	return static_cast<uint64>(Streamer.getLostFrameCount(Path));
+}
+
+std::vector<nadjieb::net::ClientStats> FMJPEGStreamerImpl::GetClientStats()
+{
+	return Streamer.getClientStats();
+}
+
+std::vector<nadjieb::net::ClientEvent> FMJPEGStreamerImpl::TakeClientEvents()
+{
+	return Streamer.takeClientEvents();
+}
+
+std::vector<std::pair<std::string, nadjieb::net::RegionOfInterest>> FMJPEGStreamerImpl::GetRegionsOfInterest(const std::string& Path)
+{
+	return Streamer.getRegionsOfInterest(Path);
+}
+
+bool FMJPEGStreamerImpl::HasConsumer(const std::string& Path)
+{
+	return Streamer.hasClient(Path) || Streamer.hasSubscriber(Path);
+}
+
+void FMJPEGStreamerImpl::SetMemoryBudget(int64 Bytes)
+{
+	Streamer.getMemoryBudget().setLimit(static_cast<size_t>(FMath::Max<int64>(Bytes, 0)));
+}
+
+nadjieb::utils::MemoryBudget& FMJPEGStreamerImpl::GetMemoryBudget()
+{
+	return Streamer.getMemoryBudget();
+}
+
+bool FMJPEGStreamerImpl::StartRecording(const std::string& Path, const nadjieb::io::RecorderOptions& Options)
+{
+	StopRecording();
+
+	Recorder = std::make_unique<nadjieb::io::Recorder>();
+	if (!Recorder->start(Options))
+	{
+		Recorder.reset();
+		return false;
+	}
+
+	nadjieb::io::Recorder* RecorderPtr = Recorder.get();
+	RecorderSubscription = Streamer.subscribe(Path, [RecorderPtr](const nadjieb::net::FrameBuffer& Frame)
+	{
+		RecorderPtr->push(Frame);
+	});
+	return true;
+}
+
+void FMJPEGStreamerImpl::StopRecording()
+{
+	if (!Recorder)
+	{
+		return;
+	}
+
+	// Unsubscribe first so no callback can touch the recorder while it shuts down
+	Streamer.unsubscribe(RecorderSubscription);
+	RecorderSubscription = 0;
+	Recorder->stop();
+	Recorder.reset();
+}
+
+bool FMJPEGStreamerImpl::IsRecording() const
+{
+	return Recorder != nullptr;
+}
+
+std::string FMJPEGStreamerImpl::GetCurrentRecordingFile() const
+{
+	return Recorder ? Recorder->getCurrentFile() : std::string();
+}
+
+void FMJPEGStreamerImpl::EnableReplay(const std::string& Directory)
+{
+	if (ReplayServer)
+	{
+		ReplayServer->setDirectory(Directory);
+		return;
+	}
+
+	ReplayServer = std::make_unique<nadjieb::io::ReplayServer>();
+	ReplayServer->setDirectory(Directory);
+	Streamer.addRoute(nadjieb::io::ReplayServer::ROUTE_PREFIX, ReplayServer->makeRouteHandler());
+}
+
+bool FMJPEGStreamerImpl::StartRtp(const std::string& Path, const nadjieb::rtp::SenderOptions& Options)
+{
+	StopRtp();
+
+	auto Sender = std::make_unique<nadjieb::rtp::JpegSender>();
+	if (!Sender->start(Options))
+	{
+		return false;
+	}
+
+	nadjieb::rtp::JpegSender* SenderPtr = Sender.get();
+	{
+		std::lock_guard<std::mutex> Lock(RtpMutex);
+		RtpSender = std::move(Sender);
+	}
+	RtpSubscription = Streamer.subscribe(Path, [SenderPtr](const nadjieb::net::FrameBuffer& Frame)
+	{
+		SenderPtr->push(Frame);
+	});
+
+	if (!bSdpRouteAdded)
+	{
+		bSdpRouteAdded = true;
+
+		nadjieb::net::RouteHandler Handler;
+		Handler.on_request = [this](const nadjieb::net::SocketFD& Sockfd, nadjieb::net::HTTPRequest& Req)
+		{
+			std::string Sdp;
+			{
+				std::lock_guard<std::mutex> Lock(RtpMutex);
+				if (RtpSender)
+				{
+					Sdp = RtpSender->getSdp();
+				}
+			}
+
+			nadjieb::net::OnMessageCallbackResponse CbRes;
+			CbRes.close_conn = !Req.isKeepAlive();
+
+			const std::string& Res = nadjieb::net::ResponseBuilder::forThread()
+				.start(Req.getVersion(), Sdp.empty() ? 404 : 200, Sdp.empty() ? "Not Found" : "OK")
+				.connection(!CbRes.close_conn)
+				.header("Content-Type", "application/sdp")
+				.finish(Sdp);
+			nadjieb::net::sendAllViaSocket(Sockfd, Res, 1000);
+			return CbRes;
+		};
+		Streamer.addRoute("/stream.sdp", Handler);
+	}
+	return true;
+}
+
+void FMJPEGStreamerImpl::StopRtp()
+{
+	std::unique_ptr<nadjieb::rtp::JpegSender> Sender;
+	{
+		std::lock_guard<std::mutex> Lock(RtpMutex);
+		Sender = std::move(RtpSender);
+	}
+	if (!Sender)
+	{
+		return;
+	}
+
+	Streamer.unsubscribe(RtpSubscription);
+	RtpSubscription = 0;
+	Sender->stop();
+}
+
+bool FMJPEGStreamerImpl::IsRtpRunning() const
+{
+	std::lock_guard<std::mutex> Lock(RtpMutex);
+	return RtpSender != nullptr;
+}
+
+bool FMJPEGStreamerImpl::StartSharedMemory(const std::string& Path, const nadjieb::shm::RingOptions& Options)
+{
+	StopSharedMemory();
+
+	SharedMemoryWriter = std::make_unique<nadjieb::shm::RingWriter>();
+	if (!SharedMemoryWriter->create(Options))
+	{
+		SharedMemoryWriter.reset();
+		return false;
+	}
+
+	// Runs on the publishing thread, which is the only writer, so the ring needs no lock
+	nadjieb::shm::RingWriter* WriterPtr = SharedMemoryWriter.get();
+	SharedMemorySubscription = Streamer.subscribe(Path, [WriterPtr, bWarned = false](const nadjieb::net::FrameBuffer& Frame) mutable
+	{
+		if (!WriterPtr->write(Frame->data.data(), Frame->data.size(), Frame->sequence, Frame->timestamp_us) && !bWarned)
+		{
+			bWarned = true;
+			UE_LOG(LogStreamMJPEG, Warning, TEXT("Shared memory: frame of %llu bytes does not fit in a slot, skipped"), static_cast<unsigned long long>(Frame->data.size()));
+		}
+	});
+	return true;
+}
+
+void FMJPEGStreamerImpl::StopSharedMemory()
+{
+	if (!SharedMemoryWriter)
+	{
+		return;
+	}
+
+	Streamer.unsubscribe(SharedMemorySubscription);
+	SharedMemorySubscription = 0;
+	SharedMemoryWriter->close();
+	SharedMemoryWriter.reset();
+}
+
+bool FMJPEGStreamerImpl::IsSharedMemoryActive() const
+{
+	return SharedMemoryWriter != nullptr;
+}
@@ -4,6 +4,12 @@
 
 #include "CoreMinimal.h"
 #include "mjpeg_streamer.hpp"
+#include "mjpeg_recording.hpp"
+#include "mjpeg_rtp.hpp"
+#include "mjpeg_shm.hpp"
+
+#include <memory>
+#include <mutex>
 
 /**
  * Pimpl wrapper for nadjieb::MJPEGStreamer
@@ -16,10 +22,97 @@ public:
 	~FMJPEGStreamerImpl();
 
 	// Wrapper methods for MJPEGStreamer functionality
-	void Start(int Port);
+	// False if no port could be bound, see SocketOptions::port_fallback. NumWorkers <= 0 allows one publisher worker per core
+	bool Start(int Port, const nadjieb::net::SocketOptions& Options = nadjieb::net::SocketOptions(), int NumWorkers = 0);
 	void Stop();
+	// Port actually listened on after a successful Start
+	int GetPort() const;
 	void Publish(const std::string& Path, const std::string& Buffer);
+	// Sequence < 0 numbers the frame after the previous one of Path
+	void Publish(const std::string& Path, std::string&& Buffer, int64 TimestampUs = 0, int64 Sequence = -1);
+
+	// Clients of Path get length-prefixed binary frames of ContentType instead of multipart JPEG. Call before Start
+	void SetFramedPath(const std::string& Path, const std::string& ContentType);
+	// Frames of Path build on the ones before, none is skipped to throttle a client. Call before Start
+	void SetDeltaCoded(const std::string& Path);
+	// Serves Body as a static ContentType response at Path. Call before Start
+	void AddPage(const std::string& Path, const std::string& ContentType, const std::string& Body);
+	// Lets clients of Path request ?roi=x,y,w,h[&scale=n]; without bClientRequests only slow client downgrades
+	// use regions. Call before Start
+	void EnableRegionOfInterest(const std::string& Path, bool bClientRequests = true);
+	// Event loops accepting connections and reading requests (SO_REUSEPORT on Linux). Call before Start
+	void SetListenerThreads(int Count);
+	// Affinity and priority of the listener and publisher threads. bUnrealThreads starts them as FRunnableThreads,
+	// which show up by name in Unreal Insights, instead of std::threads. Call before Start
+	void SetThreadPlacement(const nadjieb::utils::ThreadPlacement& Listener, const nadjieb::utils::ThreadPlacement& Publisher, bool bUnrealThreads);
+	// Sends frames through io_uring where the kernel supports it, poll/send otherwise. Call before Start
+	void SetUseIoUring(bool bEnable);
+	// Frames of at least Bytes are sent with MSG_ZEROCOPY where supported (0 = never)
+	void SetZeroCopyThreshold(int64 Bytes);
+	// What happens to clients that cannot keep up (reduced FPS, lower rendition, disconnect)
+	void SetSlowClientPolicy(const nadjieb::net::SlowClientPolicy& Policy);
+
+	// Client caps and load shedding; clients over a cap get 503 with Retry-After
+	void SetAdmissionPolicy(const nadjieb::net::AdmissionPolicy& Policy);
+	// Process CPU load (0..1) for AdmissionPolicy::max_cpu_load
+	void ReportCpuLoad(double Load);
+	nadjieb::net::AdmissionStats GetAdmissionStats();
+	// Stream clients of all paths
+	int32 GetClientCount();
+	// Grows whenever a client starts receiving Path, even if another one left meanwhile
+	uint64 GetJoinCount(const std::string& Path);
+	// Grows whenever a client loses a frame of a delta-coded Path
+	uint64 GetLostFrameCount(const std::string& Path);
+
+	// Delivery statistics of every connected stream client
+	std::vector<nadjieb::net::ClientStats> GetClientStats();
+	// Slow client events since the last call, oldest first
+	std::vector<nadjieb::net::ClientEvent> TakeClientEvents();
+
+	// Regions of Path that have clients right now, with the topic each crop is published on
+	std::vector<std::pair<std::string, nadjieb::net::RegionOfInterest>> GetRegionsOfInterest(const std::string& Path);
+
+	// True if an HTTP client or an in-process subscriber (recorder, RTP, shared memory) takes frames of Path
+	bool HasConsumer(const std::string& Path);
+
+	// Byte budget shared by capture pool, encode queue and publisher (0 = unlimited)
+	void SetMemoryBudget(int64 Bytes);
+	nadjieb::utils::MemoryBudget& GetMemoryBudget();
+
+	// Records every frame published on Path to disk, without re-encoding
+	bool StartRecording(const std::string& Path, const nadjieb::io::RecorderOptions& Options);
+	void StopRecording();
+	bool IsRecording() const;
+	std::string GetCurrentRecordingFile() const;
+
+	// Serves recordings in Directory as /replay/<name>.mjpg. Call before Start
+	void EnableReplay(const std::string& Directory);
+
+	// Sends every frame published on Path as RTP/JPEG to a unicast or multicast address.
+	// The session description is served as /stream.sdp while RTP is running
+	bool StartRtp(const std::string& Path, const nadjieb::rtp::SenderOptions& Options);
+	void StopRtp();
+	bool IsRtpRunning() const;
+
+	// Copies every frame published on Path into a named shared-memory ring for readers on this host
+	bool StartSharedMemory(const std::string& Path, const nadjieb::shm::RingOptions& Options);
+	void StopSharedMemory();
+	bool IsSharedMemoryActive() const;
 
 private:
 	nadjieb::MJPEGStreamer Streamer;
+
+	std::unique_ptr<nadjieb::io::Recorder> Recorder;
+	int RecorderSubscription = 0;
+
+	std::unique_ptr<nadjieb::io::ReplayServer> ReplayServer;
+
+	// Guards RtpSender against the listener thread answering /stream.sdp
+	mutable std::mutex RtpMutex;
+	std::unique_ptr<nadjieb::rtp::JpegSender> RtpSender;
+	int RtpSubscription = 0;
+	bool bSdpRouteAdded = false;
+
+	std::unique_ptr<nadjieb::shm::RingWriter> SharedMemoryWriter;
+	int SharedMemorySubscription = 0;
 };
@@ -0,0 +1,107 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "RawFrameMJPEG.h"
+
+#include "Async/ParallelFor.h"
+
+namespace
+{
+    // Rows converted per ParallelFor task (even, so chroma rows never straddle two tasks)
+    constexpr int32 RowsPerTask = 32;
+
+    void WriteUInt32(uint8 *Out, uint32 Value)
+    {
+        Out[0] = static_cast<uint8>(Value);
+        Out[1] = static_cast<uint8>(Value >> 8);
+        Out[2] = static_cast<uint8>(Value >> 16);
+        Out[3] = static_cast<uint8>(Value >> 24);
+    }
+
+    // BT.601 limited range in 8.8 fixed point. Plain integer loops over whole rows without branches,
+    // which the compiler vectorizes (SSE/AVX/NEON) without platform specific intrinsics.
+    void ConvertLumaRow(const FColor *Src, int32 Width, uint8 *DstY)
+    {
+        for (int32 X = 0; X < Width; ++X)
+        {
+            const int32 R = Src[X].R, G = Src[X].G, B = Src[X].B;
+            DstY[X] = static_cast<uint8>(((66 * R + 129 * G + 25 * B + 128) >> 8) + 16);
+        }
+    }
+
+    // Averages each 2x2 block of two source rows; DstU/DstV advance by Step bytes (2 = NV12 interleaved)
+    void ConvertChromaRow(const FColor *Src0, const FColor *Src1, int32 Width, uint8 *DstU, uint8 *DstV, int32 Step)
+    {
+        const int32 ChromaWidth = (Width + 1) / 2;
+        for (int32 X = 0; X < ChromaWidth; ++X)
+        {
+            const int32 X0 = X * 2;
+            const int32 X1 = FMath::Min(X0 + 1, Width - 1);
+            const int32 R = Src0[X0].R + Src0[X1].R + Src1[X0].R + Src1[X1].R;
+            const int32 G = Src0[X0].G + Src0[X1].G + Src1[X0].G + Src1[X1].G;
+            const int32 B = Src0[X0].B + Src0[X1].B + Src1[X0].B + Src1[X1].B;
+            DstU[X * Step] = static_cast<uint8>(((-38 * R - 74 * G + 112 * B + 512) >> 10) + 128);
+            DstV[X * Step] = static_cast<uint8>(((112 * R - 94 * G - 18 * B + 512) >> 10) + 128);
+        }
+    }
+
+    uint32 GetFourCC(ERawFrameFormatMJPEG Format)
+    {
+        const char *Code = Format == ERawFrameFormatMJPEG::NV12 ? "NV12" : Format == ERawFrameFormatMJPEG::I420 ? "I420" : "BGRA";
+        return static_cast<uint32>(Code[0]) | (static_cast<uint32>(Code[1]) << 8) | (static_cast<uint32>(Code[2]) << 16) | (static_cast<uint32>(Code[3]) << 24);
+    }
+}
+
+int64 FRawFrameMJPEG::GetImageSize(ERawFrameFormatMJPEG Format, int32 Width, int32 Height)
+{
+    const int64 Pixels = static_cast<int64>(Width) * Height;
+    if (Format == ERawFrameFormatMJPEG::BGRA)
+    {
+        return Pixels * 4;
+    }
+
+    const int64 ChromaPixels = static_cast<int64>((Width + 1) / 2) * ((Height + 1) / 2);
+    return Pixels + ChromaPixels * 2;
+}
+
+void FRawFrameMJPEG::Pack(ERawFrameFormatMJPEG Format, const FColor *Pixels, int32 Width, int32 Height, uint8 *Out)
+{
+    WriteUInt32(Out, GetFourCC(Format));
+    WriteUInt32(Out + 4, static_cast<uint32>(Width));
+    WriteUInt32(Out + 8, static_cast<uint32>(Height));
+    WriteUInt32(Out + 12, static_cast<uint32>(Format == ERawFrameFormatMJPEG::BGRA ? Width * 4 : Width));
+
+    uint8 *Image = Out + HeaderSize;
+    if (Format == ERawFrameFormatMJPEG::BGRA)
+    {
+        // FColor is laid out as B, G, R, A in memory
+        FMemory::Memcpy(Image, Pixels, static_cast<SIZE_T>(Width) * Height * sizeof(FColor));
+        return;
+    }
+
+    const int32 ChromaWidth = (Width + 1) / 2;
+    const int32 ChromaHeight = (Height + 1) / 2;
+    uint8 *PlaneY = Image;
+    uint8 *PlaneU = PlaneY + static_cast<int64>(Width) * Height;
+    uint8 *PlaneV = Format == ERawFrameFormatMJPEG::NV12 ? PlaneU + 1 : PlaneU + static_cast<int64>(ChromaWidth) * ChromaHeight;
+    const int32 ChromaStep = Format == ERawFrameFormatMJPEG::NV12 ? 2 : 1;
+    const int64 ChromaStride = static_cast<int64>(ChromaWidth) * ChromaStep;
+
+    const int32 NumTasks = (Height + RowsPerTask - 1) / RowsPerTask;
+    ParallelFor(NumTasks, [&](int32 Task)
+    {
+        const int32 FirstRow = Task * RowsPerTask;
+        const int32 EndRow = FMath::Min(FirstRow + RowsPerTask, Height);
+        for (int32 Y = FirstRow; Y < EndRow; ++Y)
+        {
+            const FColor *Row = Pixels + static_cast<int64>(Y) * Width;
+            ConvertLumaRow(Row, Width, PlaneY + static_cast<int64>(Y) * Width);
+
+            if ((Y & 1) == 0)
+            {
+                const FColor *NextRow = Y + 1 < Height ? Row + Width : Row;
+                const int64 ChromaOffset = static_cast<int64>(Y / 2) * ChromaStride;
+                ConvertChromaRow(Row, NextRow, Width, PlaneU + ChromaOffset, PlaneV + ChromaOffset, ChromaStep);
+            }
+        }
+    });
+}
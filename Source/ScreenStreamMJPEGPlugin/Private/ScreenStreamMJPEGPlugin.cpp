@@ -1,6 +1,7 @@
 // Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
 
 #include "ScreenStreamMJPEGPlugin.h"
+#include "EncodeSchedulerMJPEG.h"
 
 #define LOCTEXT_NAMESPACE "FScreenStreamMJPEGPluginModule"
 
@@ -13,6 +14,7 @@ void FScreenStreamMJPEGPluginModule::ShutdownModule()
 {
 	// This function may be called during shutdown to clean up your module.  For modules that support dynamic reloading,
 	// we call this function before unloading the module.
+	FEncodeSchedulerMJPEG::Get().Shutdown();
 }
 
 #undef LOCTEXT_NAMESPACE
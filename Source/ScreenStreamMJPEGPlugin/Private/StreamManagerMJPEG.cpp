@@ -2,6 +2,7 @@
 
 #include "StreamManagerMJPEG.h"
 #include "MJPEGStreamerImpl.h"
+#include "EncodeSchedulerMJPEG.h"
 
 DEFINE_LOG_CATEGORY(LogStreamMJPEG);
 
@@ -27,6 +28,66 @@ DEFINE_LOG_CATEGORY(LogStreamMJPEG);
 #include "ImageUtils.h"
 
 #include "Modules/ModuleManager.h"
+#include "Misc/Paths.h"
+#include "Async/Async.h"
+
+static const std::string StreamPathMJPEG = "/stream.mjpg";
+static const std::string StreamPathRaw = "/stream.raw";
+static const std::string RawContentType = "application/x-nadjieb-raw-frames";
+static const std::string StreamPathTiles = "/stream.tiles";
+static const std::string TilesContentType = "application/x-nadjieb-tiles";
+static const std::string TileViewerPath = "/tiles.html";
+
+// Path of a single camera of a capture group
+static std::string GetViewPath(int32 View)
+{
+    return "/cam" + std::to_string(View) + ".mjpg";
+}
+
+// Thread names get the index of the thread appended
+static nadjieb::utils::ThreadPlacement ToThreadPlacement(const FStreamThreadPlacementMJPEG &Placement, const char *Name)
+{
+    nadjieb::utils::ThreadPlacement Result;
+    Result.name = Name;
+    Result.affinity_mask = static_cast<uint64>(Placement.AffinityMask);
+    Result.priority = static_cast<nadjieb::utils::ThreadPriority>(Placement.Priority);
+    return Result;
+}
+
+// Shared by the actor, the render commands signalling readback completion and the tasks they start to
+// hand the frames to the encode threads; the latter two may outlive the actor
+struct FReadbackCompletionMJPEG
+{
+    // Held by whoever consumes RenderRequestQueue (Tick, a completion task, EndPlay)
+    FCriticalSection Lock;
+
+    // Null once the actor has ended play
+    AStreamManagerMJPEG *Owner = nullptr;
+
+    // Completions start a task instead of waiting for Tick (bLowLatencyReadback)
+    std::atomic<bool> bEncodeOnCompletion{false};
+
+    // A completion task is queued but has not taken the lock yet; it will see every completion until then
+    std::atomic<bool> bTaskQueued{false};
+
+    static void Signal(const TSharedPtr<FReadbackCompletionMJPEG, ESPMode::ThreadSafe> &Completion)
+    {
+        if (!Completion->bEncodeOnCompletion || Completion->bTaskQueued.exchange(true))
+        {
+            return;
+        }
+
+        AsyncTask(ENamedThreads::AnyHiPriThreadNormalTask, [Completion]()
+        {
+            FScopeLock ScopeLock(&Completion->Lock);
+            Completion->bTaskQueued = false;
+            if (Completion->Owner)
+            {
+                Completion->Owner->ProcessCompletedRequests();
+            }
+        });
+    }
+};
 
 AStreamManagerMJPEG::AStreamManagerMJPEG()
 {
@@ -35,6 +96,8 @@ AStreamManagerMJPEG::AStreamManagerMJPEG()
     
     // Initialize Pimpl
     StreamerImpl = MakeUnique<FMJPEGStreamerImpl>();
+
+    ReadbackCompletion = MakeShared<FReadbackCompletionMJPEG, ESPMode::ThreadSafe>();
 }
 
 // Called when the game starts or when spawned
@@ -42,29 +105,516 @@ void AStreamManagerMJPEG::BeginPlay()
 {
     Super::BeginPlay();
 
-    if (CaptureComponent)
     {
-        SetupCaptureComponent();
+        FScopeLock ScopeLock(&ReadbackCompletion->Lock);
+        ReadbackCompletion->Owner = this;
+    }
+    ReadbackCompletion->bEncodeOnCompletion = bLowLatencyReadback;
+    // Encode threads may not load modules, only use loaded ones
+    IImageWrapperModule &ImageWrapperModule = FModuleManager::LoadModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
+    JpegImageWrapper = ImageWrapperModule.CreateImageWrapper(EImageFormat::JPEG);
+
+    if (MaxEncodeThreads > 0)
+    {
+        FEncodeSchedulerMJPEG::Get().SetMaxThreads(MaxEncodeThreads);
+    }
+    FEncodeSchedulerMJPEG::Get().SetThreadPlacement(EncodeThreadPlacement.GetThreadPriority(), static_cast<uint64>(EncodeThreadPlacement.AffinityMask));
+    EncodeQueue = FEncodeSchedulerMJPEG::Get().CreateQueue();
+    EncodeQueue->SetPriority(EncodePriority);
 
-        StreamerImpl->Start(ServerPort);
+    // A source injected through SetFrameSource takes precedence
+    if (!FrameSource)
+    {
+        CreateDefaultFrameSource();
+    }
+    if (FrameSource)
+    {
+        // Sources are created at this size, later changes go through ApplyFrameFormat
+        FScopeLock PoolLock(&RenderRequestPoolLock);
+        CaptureFormat = {FMath::Max(FrameWidth, 1), FMath::Max(FrameHeight, 1), FMath::Max(FrameSource->GetViewCount(), 1)};
+    }
+
+    if (FrameSource && FrameSource->IsValidSource())
+    {
+        UE_LOG(LogStreamMJPEG, Log, TEXT("Streaming from %s frame source"), FrameSource->GetName());
+        StreamerImpl->SetMemoryBudget(MemoryBudgetBytes);
+        if (bEnableReplay)
+        {
+            StreamerImpl->EnableReplay(TCHAR_TO_UTF8(*GetResolvedRecordingDirectory()));
+        }
+        if (StreamMode != EStreamModeMJPEG::Jpeg)
+        {
+            StreamerImpl->SetFramedPath(StreamPathRaw, RawContentType);
+        }
+        if (bEnableTileStream)
+        {
+            TileStream.SetTileSize(TileSize);
+            TileStream.SetKeyFrameInterval(TileKeyFrameInterval);
+            StreamerImpl->SetFramedPath(StreamPathTiles, TilesContentType);
+            StreamerImpl->SetDeltaCoded(StreamPathTiles);
+            StreamerImpl->AddPage(TileViewerPath, "text/html; charset=utf-8", TCHAR_TO_UTF8(*FTileStreamMJPEG::GetViewerHtml(UTF8_TO_TCHAR(StreamPathTiles.c_str()))));
+        }
+        if (HasRegionTopics())
+        {
+            StreamerImpl->EnableRegionOfInterest(StreamPathMJPEG, bEnableRegionOfInterest);
+        }
+        nadjieb::net::SlowClientPolicy SlowClientPolicy;
+        SlowClientPolicy.action = SlowClientAction == ESlowClientActionMJPEG::Downgrade ? nadjieb::net::SlowClientPolicy::Action::DOWNGRADE
+            : SlowClientAction == ESlowClientActionMJPEG::ReduceFrameRate ? nadjieb::net::SlowClientPolicy::Action::REDUCE_FPS
+            : nadjieb::net::SlowClientPolicy::Action::NONE;
+        SlowClientPolicy.grace_ms = static_cast<long>(FMath::Max(SlowClientGraceSeconds, 0.1f) * 1000.0f);
+        SlowClientPolicy.max_frame_interval = FMath::Clamp(SlowClientMaxFrameInterval, 1, 64);
+        SlowClientPolicy.disconnect_after_ms = static_cast<long>(FMath::Max(SlowClientDisconnectSeconds, 0.0f) * 1000.0f);
+        StreamerImpl->SetSlowClientPolicy(SlowClientPolicy);
+        nadjieb::net::AdmissionPolicy AdmissionPolicy;
+        AdmissionPolicy.max_clients = static_cast<size_t>(FMath::Max(MaxClients, 0));
+        AdmissionPolicy.max_clients_per_path = static_cast<size_t>(FMath::Max(MaxClientsPerStream, 0));
+        AdmissionPolicy.retry_after_s = FMath::Max(RetryAfterSeconds, 0);
+        AdmissionPolicy.max_bandwidth = FMath::Max(MaxBandwidthMBps, 0.0f) * 1024.0 * 1024.0;
+        AdmissionPolicy.max_cpu_load = FMath::Clamp(MaxCpuLoadPercent, 0.0f, 100.0f) / 100.0;
+        AdmissionPolicy.max_frame_interval = FMath::Clamp(MaxShedFrameInterval, 1, 64);
+        StreamerImpl->SetAdmissionPolicy(AdmissionPolicy);
+        StreamerImpl->SetListenerThreads(ListenerThreadCount);
+        StreamerImpl->SetThreadPlacement(ToThreadPlacement(ListenerThreadPlacement, "MJPEGListener"),
+            ToThreadPlacement(PublisherThreadPlacement, "MJPEGPublisher"), bUseUnrealThreads);
+        StreamerImpl->SetUseIoUring(bUseIoUring);
+        StreamerImpl->SetZeroCopyThreshold(bEnableZeroCopy ? static_cast<int64>(ZeroCopyMinFrameKB) * 1024 : 0);
+        nadjieb::net::SocketOptions SocketOptions;
+        SocketOptions.bind_address = TCHAR_TO_UTF8(*BindAddress);
+        SocketOptions.tcp_nodelay = bTcpNoDelay;
+        SocketOptions.send_buffer_size = FMath::Max(SendBufferSizeKB, 0) * 1024;
+        SocketOptions.not_sent_low_watermark = FMath::Max(NotSentLowWatermarkKB, 0) * 1024;
+        SocketOptions.keepalive = bTcpKeepAlive;
+        SocketOptions.keepalive_idle = KeepAliveIdleSeconds;
+        SocketOptions.keepalive_interval = 5;
+        SocketOptions.keepalive_count = 3;
+        SocketOptions.port_fallback = FMath::Max(ServerPortFallbackCount, 0);
+        if (!StreamerImpl->Start(ServerPort, SocketOptions, PublisherThreadCount))
+        {
+            UE_LOG(LogStreamMJPEG, Error, TEXT("Could not listen on %s ports %d-%d, stream not started!"), *BindAddress, ServerPort, ServerPort + SocketOptions.port_fallback);
+            bServerRunning = false;
+            SetActorTickEnabled(false);
+            return;
+        }
+        bServerRunning = true;
+        if (StreamerImpl->GetPort() != ServerPort)
+        {
+            UE_LOG(LogStreamMJPEG, Warning, TEXT("Port %d is taken, streaming on port %d"), ServerPort, StreamerImpl->GetPort());
+        }
+
+        if (bRecordOnBeginPlay)
+        {
+            StartRecording();
+        }
+
+        if (bEnableRtp)
+        {
+            StartRtp();
+        }
+
+        if (bEnableSharedMemory)
+        {
+            StartSharedMemory();
+        }
     }
     else
     {
-        UE_LOG(LogStreamMJPEG, Error, TEXT("No CaptureComponent set!"));
+        UE_LOG(LogStreamMJPEG, Error, TEXT("No valid frame source, stream not started!"));
     }
 }
 
+void AStreamManagerMJPEG::CreateDefaultFrameSource()
+{
+    switch (FrameSourceType)
+    {
+    case EFrameSourceTypeMJPEG::Synthetic:
+        FrameSource = MakeUnique<FSyntheticFrameSourceMJPEG>(SyntheticPattern, FrameWidth, FrameHeight, static_cast<uint32>(SyntheticSeed));
+        break;
+    case EFrameSourceTypeMJPEG::Viewport:
+        FrameSource = MakeUnique<FViewportFrameSourceMJPEG>(FrameWidth, FrameHeight);
+        break;
+    case EFrameSourceTypeMJPEG::CaptureGroup:
+        if (CaptureGroup.Num() == 0)
+        {
+            UE_LOG(LogStreamMJPEG, Error, TEXT("CaptureGroup is empty!"));
+            return;
+        }
+        for (ASceneCapture2D *Capture : CaptureGroup)
+        {
+            SetupCaptureComponent(Capture);
+        }
+        FrameSource = MakeUnique<FCaptureGroupFrameSourceMJPEG>(CaptureGroup, bCaptureOnlyStreamedFrames);
+        break;
+    case EFrameSourceTypeMJPEG::SceneCapture:
+    default:
+        if (!CaptureComponent)
+        {
+            UE_LOG(LogStreamMJPEG, Error, TEXT("No CaptureComponent set!"));
+            return;
+        }
+        SetupCaptureComponent(CaptureComponent);
+        FrameSource = MakeUnique<FSceneCaptureFrameSourceMJPEG>(CaptureComponent, VerboseLogging, bCaptureOnlyStreamedFrames);
+        break;
+    }
+}
+
+void AStreamManagerMJPEG::SetFrameSource(TUniquePtr<IFrameSourceMJPEG> NewFrameSource)
+{
+    FrameSource = MoveTemp(NewFrameSource);
+}
+
 void AStreamManagerMJPEG::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
+    {
+        // Waits for a running completion task; later ones find no owner
+        FScopeLock ScopeLock(&ReadbackCompletion->Lock);
+        ReadbackCompletion->Owner = nullptr;
+        ReadbackCompletion->bEncodeOnCompletion = false;
+    }
+
+    // Waits for a running encode, frames still waiting go back to the pool
+    if (EncodeQueue)
+    {
+        EncodeQueue->Flush();
+    }
+
     StreamerImpl->Stop();
+    bServerRunning = false;
+    FlushRenderRequests();
     Super::EndPlay(EndPlayReason);
 }
 
+void AStreamManagerMJPEG::SetCaptureCostProfile(ECaptureCostProfileMJPEG Profile)
+{
+    CaptureCostProfile = Profile;
+    if (IsValid(CaptureComponent))
+    {
+        FSceneCaptureFrameSourceMJPEG::ApplyCostProfile(CaptureComponent->GetCaptureComponent2D(), Profile);
+    }
+    for (ASceneCapture2D *Capture : CaptureGroup)
+    {
+        if (IsValid(Capture))
+        {
+            FSceneCaptureFrameSourceMJPEG::ApplyCostProfile(Capture->GetCaptureComponent2D(), Profile);
+        }
+    }
+}
+
+void AStreamManagerMJPEG::SetEncodePriority(int32 Priority)
+{
+    EncodePriority = Priority;
+    if (EncodeQueue)
+    {
+        EncodeQueue->SetPriority(Priority);
+    }
+}
+
+float AStreamManagerMJPEG::GetCaptureGpuTimeMs() const
+{
+    return FrameSource ? FrameSource->GetGpuTimeMs() : 0.0f;
+}
+
+void AStreamManagerMJPEG::SetMemoryBudget(int64 Bytes)
+{
+    MemoryBudgetBytes = FMath::Max<int64>(Bytes, 0);
+    StreamerImpl->SetMemoryBudget(MemoryBudgetBytes);
+}
+
+FString AStreamManagerMJPEG::GetResolvedRecordingDirectory() const
+{
+    const FString Directory = RecordingDirectory.IsEmpty() ? FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("StreamRecordings")) : RecordingDirectory;
+    return FPaths::ConvertRelativePathToFull(Directory);
+}
+
+bool AStreamManagerMJPEG::StartRecording()
+{
+    const FString Directory = GetResolvedRecordingDirectory();
+
+    nadjieb::io::RecorderOptions Options;
+    Options.directory = TCHAR_TO_UTF8(*Directory);
+    Options.prefix = TCHAR_TO_UTF8(*GetName());
+    Options.max_file_bytes = static_cast<uint64_t>(FMath::Max(RecordingMaxFileSizeMB, 0)) * 1024 * 1024;
+    Options.max_file_duration_us = static_cast<int64_t>(FMath::Max(RecordingMaxFileDurationSeconds, 0.0f) * 1000000.0);
+
+    if (!StreamerImpl->StartRecording(StreamPathMJPEG, Options))
+    {
+        UE_LOG(LogStreamMJPEG, Error, TEXT("StartRecording: could not start recording to %s"), *Directory);
+        return false;
+    }
+
+    UE_LOG(LogStreamMJPEG, Log, TEXT("Recording stream to %s"), *Directory);
+    return true;
+}
+
+void AStreamManagerMJPEG::StopRecording()
+{
+    StreamerImpl->StopRecording();
+}
+
+bool AStreamManagerMJPEG::StartRtp()
+{
+    nadjieb::rtp::SenderOptions Options;
+    Options.address = TCHAR_TO_UTF8(*RtpAddress);
+    Options.port = RtpPort;
+    Options.ttl = FMath::Clamp(RtpMulticastTtl, 0, 255);
+    Options.interface_address = TCHAR_TO_UTF8(*RtpMulticastInterface);
+    Options.max_packet_size = static_cast<size_t>(FMath::Clamp(RtpMaxPacketSize, 256, 65000));
+
+    if (!StreamerImpl->StartRtp(StreamPathMJPEG, Options))
+    {
+        UE_LOG(LogStreamMJPEG, Error, TEXT("StartRtp: could not send RTP to %s:%d"), *RtpAddress, RtpPort);
+        return false;
+    }
+
+    UE_LOG(LogStreamMJPEG, Log, TEXT("Sending RTP/JPEG to %s:%d"), *RtpAddress, RtpPort);
+    return true;
+}
+
+void AStreamManagerMJPEG::StopRtp()
+{
+    StreamerImpl->StopRtp();
+}
+
+bool AStreamManagerMJPEG::IsRtpRunning() const
+{
+    return StreamerImpl->IsRtpRunning();
+}
+
+bool AStreamManagerMJPEG::StartSharedMemory()
+{
+    if (bSharedMemoryRawFrames && StreamMode == EStreamModeMJPEG::Jpeg)
+    {
+        UE_LOG(LogStreamMJPEG, Error, TEXT("StartSharedMemory: raw frames need StreamMode Raw or JpegAndRaw"));
+        return false;
+    }
+
+    nadjieb::shm::RingOptions Options;
+    Options.name = std::string("/") + TCHAR_TO_UTF8(*SharedMemoryName);
+    Options.slot_count = static_cast<uint32_t>(FMath::Clamp(SharedMemorySlotCount, 2, 64));
+    Options.slot_capacity = static_cast<size_t>(FMath::Clamp(SharedMemorySlotSizeMB, 1, 256)) * 1024 * 1024;
+    Options.content_type = bSharedMemoryRawFrames ? RawContentType : "image/jpeg";
+
+    if (!StreamerImpl->StartSharedMemory(bSharedMemoryRawFrames ? StreamPathRaw : StreamPathMJPEG, Options))
+    {
+        UE_LOG(LogStreamMJPEG, Error, TEXT("StartSharedMemory: could not create shared memory %s"), *SharedMemoryName);
+        return false;
+    }
+
+    UE_LOG(LogStreamMJPEG, Log, TEXT("Writing frames to shared memory %s"), *SharedMemoryName);
+    return true;
+}
+
+void AStreamManagerMJPEG::StopSharedMemory()
+{
+    StreamerImpl->StopSharedMemory();
+}
+
+bool AStreamManagerMJPEG::IsSharedMemoryActive() const
+{
+    return StreamerImpl->IsSharedMemoryActive();
+}
+
+bool AStreamManagerMJPEG::IsRecording() const
+{
+    return StreamerImpl->IsRecording();
+}
+
+FString AStreamManagerMJPEG::GetCurrentRecordingFile() const
+{
+    return FString(UTF8_TO_TCHAR(StreamerImpl->GetCurrentRecordingFile().c_str()));
+}
+
+int32 AStreamManagerMJPEG::GetServerPort() const
+{
+    return bServerRunning ? StreamerImpl->GetPort() : 0;
+}
+
+int64 AStreamManagerMJPEG::GetMemoryUsageBytes() const
+{
+    return static_cast<int64>(StreamerImpl->GetMemoryBudget().getUsage());
+}
+
+void AStreamManagerMJPEG::ApplyFrameFormat()
+{
+    const FFrameFormatMJPEG NewFormat = {FMath::Max(FrameWidth, 1), FMath::Max(FrameHeight, 1), FMath::Max(FrameSource->GetViewCount(), 1)};
+
+    TArray<FRenderRequestStreamMJPEGStruct *> StaleRequests;
+    {
+        FScopeLock PoolLock(&RenderRequestPoolLock);
+        if (NewFormat == CaptureFormat)
+        {
+            return;
+        }
+        CaptureFormat = NewFormat;
+
+        // Requests in flight keep their format and are freed when they come back, see ReleaseRenderRequest
+        for (auto &Pool : RenderRequestPools)
+        {
+            StaleRequests.Append(Pool.Value);
+        }
+        RenderRequestPools.Reset();
+    }
+
+    for (FRenderRequestStreamMJPEGStruct *Request : StaleRequests)
+    {
+        StreamerImpl->GetMemoryBudget().release(static_cast<size_t>(Request->AccountedBytes));
+        delete Request;
+    }
+
+    // Readbacks already enqueued run before the render target is reallocated
+    FrameSource->SetFrameSize(NewFormat.Width, NewFormat.Height);
+    UE_LOG(LogStreamMJPEG, Log, TEXT("Capturing at %dx%d from now on"), NewFormat.Width, NewFormat.Height);
+}
+
+FRenderRequestStreamMJPEGStruct *AStreamManagerMJPEG::AcquireRenderRequest()
+{
+    FFrameFormatMJPEG Format;
+    {
+        FScopeLock PoolLock(&RenderRequestPoolLock);
+        Format = CaptureFormat;
+        TArray<FRenderRequestStreamMJPEGStruct *> *Pool = RenderRequestPools.Find(Format);
+        if (Pool && Pool->Num() > 0)
+        {
+            return Pool->Pop();
+        }
+    }
+
+    // New allocations are what the budget guards against, pooled requests are already charged
+    const int64 FrameBytes = Format.GetNumPixels() * sizeof(FColor);
+    if (!StreamerImpl->GetMemoryBudget().tryAcquire(static_cast<size_t>(FrameBytes)))
+    {
+        return nullptr;
+    }
+
+    FRenderRequestStreamMJPEGStruct *Request = new FRenderRequestStreamMJPEGStruct();
+    Request->Format = Format;
+    Request->AccountedBytes = FrameBytes;
+    Request->Completion = ReadbackCompletion;
+    return Request;
+}
+
+void AStreamManagerMJPEG::ReleaseRenderRequest(FRenderRequestStreamMJPEGStruct *Request)
+{
+    {
+        FScopeLock PoolLock(&RenderRequestPoolLock);
+        // Requests of an old format would only pin memory nobody reuses
+        if (Request->Format == CaptureFormat && !StreamerImpl->GetMemoryBudget().isExceeded())
+        {
+            TArray<FRenderRequestStreamMJPEGStruct *> &Pool = RenderRequestPools.FindOrAdd(Request->Format);
+            if (Pool.Num() < MaxPooledRenderRequests)
+            {
+                Pool.Push(Request);
+                return;
+            }
+        }
+    }
+
+    StreamerImpl->GetMemoryBudget().release(static_cast<size_t>(Request->AccountedBytes));
+    delete Request;
+}
+
+void AStreamManagerMJPEG::UpdateAccountedBytes(FRenderRequestStreamMJPEGStruct *Request)
+{
+    const int64 AllocatedBytes = Request->Image.GetAllocatedSize();
+    if (AllocatedBytes > Request->AccountedBytes)
+    {
+        StreamerImpl->GetMemoryBudget().acquire(static_cast<size_t>(AllocatedBytes - Request->AccountedBytes));
+    }
+    else if (AllocatedBytes < Request->AccountedBytes)
+    {
+        StreamerImpl->GetMemoryBudget().release(static_cast<size_t>(Request->AccountedBytes - AllocatedBytes));
+    }
+    Request->AccountedBytes = AllocatedBytes;
+}
+
+void AStreamManagerMJPEG::CompleteReadback(FRenderRequestStreamMJPEGStruct &Request)
+{
+    // Nothing may touch the request after the flag is set, a consumer can recycle it right away
+    TSharedPtr<FReadbackCompletionMJPEG, ESPMode::ThreadSafe> Completion = Request.Completion;
+    Request.bReadbackComplete = true;
+    if (Completion)
+    {
+        FReadbackCompletionMJPEG::Signal(Completion);
+    }
+}
+
+void AStreamManagerMJPEG::FlushRenderRequests()
+{
+    // The render thread may still be writing into Image of queued requests
+    if (FrameSource)
+    {
+        FrameSource->CancelPendingFrames();
+    }
+    FlushRenderingCommands();
+
+    FRenderRequestStreamMJPEGStruct *Request = nullptr;
+    while (RenderRequestQueue.Dequeue(Request))
+    {
+        QueueSize--;
+        if (Request)
+        {
+            StreamerImpl->GetMemoryBudget().release(static_cast<size_t>(Request->AccountedBytes));
+            delete Request;
+        }
+    }
+
+    FScopeLock PoolLock(&RenderRequestPoolLock);
+    for (auto &Pool : RenderRequestPools)
+    {
+        for (FRenderRequestStreamMJPEGStruct *PooledRequest : Pool.Value)
+        {
+            StreamerImpl->GetMemoryBudget().release(static_cast<size_t>(PooledRequest->AccountedBytes));
+            delete PooledRequest;
+        }
+    }
+    RenderRequestPools.Reset();
+}
+
 // Called every frame
 void AStreamManagerMJPEG::Tick(float DeltaTime)
 {
     Super::Tick(DeltaTime);
 
+    DispatchClientEvents();
+
+    if (MaxCpuLoadPercent > 0.0f)
+    {
+        // Updated by the engine loop once per frame
+        StreamerImpl->ReportCpuLoad(FPlatformTime::GetCPUTime().CPUTimePctRelative / 100.0);
+    }
+
+    const nadjieb::net::AdmissionStats AdmissionStats = StreamerImpl->GetAdmissionStats();
+    if (AdmissionStats.frame_interval != LastShedFrameInterval || AdmissionStats.overloaded != bLastOverloaded)
+    {
+        UE_LOG(LogStreamMJPEG, Warning, TEXT("Load shedding: every client gets every %d. frame (%.1f MB/s sent)%s"), AdmissionStats.frame_interval,
+            AdmissionStats.bandwidth / (1024.0 * 1024.0), AdmissionStats.overloaded ? TEXT(", rejecting new clients") : TEXT(""));
+        LastShedFrameInterval = AdmissionStats.frame_interval;
+        bLastOverloaded = AdmissionStats.overloaded;
+    }
+
+    // Completion tasks take frames as soon as their readback completes, see FReadbackCompletionMJPEG
+    ReadbackCompletion->bEncodeOnCompletion = bLowLatencyReadback;
+
+    // Automatic capture at a fixed rate, independent of the game frame rate
+    if (CaptureFrameRate > 0.0f)
+    {
+        const float CaptureInterval = 1.0f / CaptureFrameRate;
+        CaptureTimeAccumulator += DeltaTime;
+        if (CaptureTimeAccumulator >= CaptureInterval)
+        {
+            // Don't try to catch up after a hitch, one capture per tick at most
+            CaptureTimeAccumulator = FMath::Fmod(CaptureTimeAccumulator, CaptureInterval);
+            CaptureNonBlocking();
+        }
+    }
+
+    if (bLowLatencyReadback)
+    {
+        return;
+    }
+
+    FScopeLock ScopeLock(&ReadbackCompletion->Lock);
+
     // Check for queue overflow (memory leak detection)
     int32 CurrentQueueSize = QueueSize.load();
     
@@ -73,59 +623,102 @@ void AStreamManagerMJPEG::Tick(float DeltaTime)
         UE_LOG(LogStreamMJPEG, Error, TEXT("StreamManagerMJPEG: RenderRequestQueue overflow! Size: %d. Memory leak detected!"), CurrentQueueSize);
         
         // Emergency cleanup: drain queue to prevent OOM
-        while (!RenderRequestQueue.IsEmpty())
-        {
-            FRenderRequestStreamMJPEGStruct* Request = nullptr;
-            RenderRequestQueue.Dequeue(Request);
-            if (Request)
-            {
-                delete Request;
-                QueueSize--;
-            }
-        }
+        FlushRenderRequests();
         UE_LOG(LogStreamMJPEG, Warning, TEXT("StreamManagerMJPEG: Emergency queue cleanup performed"));
         return;
     }
 
-    if (!RenderRequestQueue.IsEmpty())
+    ProcessCompletedRequests();
+}
+
+void AStreamManagerMJPEG::ProcessCompletedRequests()
+{
+    // Over budget: drop the oldest completed raw frames instead of encoding them, keep the newest
+    while (QueueSize.load() > 1 && StreamerImpl->GetMemoryBudget().isExceeded())
     {
-        // Peek the next RenderRequest from queue
-        FRenderRequestStreamMJPEGStruct *nextRenderRequest = nullptr;
-        RenderRequestQueue.Peek(nextRenderRequest);
+        FRenderRequestStreamMJPEGStruct *OldestRequest = nullptr;
+        RenderRequestQueue.Peek(OldestRequest);
+        if (!OldestRequest || !OldestRequest->bReadbackComplete)
+        {
+            break;
+        }
 
-        if (nextRenderRequest)
-        { // nullptr check
-            if (nextRenderRequest->RenderFence.IsFenceComplete())
-            {
-                // Check if rendering is done, indicated by RenderFence
-                // Load the image wrapper module
-                IImageWrapperModule &ImageWrapperModule = FModuleManager::LoadModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
+        RenderRequestQueue.Pop();
+        QueueSize--;
+        ReleaseRenderRequest(OldestRequest);
+        BudgetDroppedFrames++;
+    }
 
-                // Prepare data to be JPEG
-                static TSharedPtr<IImageWrapper> imageWrapper = ImageWrapperModule.CreateImageWrapper(EImageFormat::JPEG); // EImageFormat::JPEG
-                imageWrapper->SetRaw(nextRenderRequest->Image.GetData(), nextRenderRequest->Image.GetAllocatedSize(), FrameWidth, FrameHeight, ERGBFormat::BGRA, 8);
-                const TArray64<uint8> &ImgData = imageWrapper->GetCompressed(0);
+    for (;;)
+    {
+        // Requests complete in the order they were queued
+        FRenderRequestStreamMJPEGStruct *nextRenderRequest = nullptr;
+        if (!RenderRequestQueue.Peek(nextRenderRequest) || !nextRenderRequest || !nextRenderRequest->bReadbackComplete)
+        {
+            break;
+        }
 
-                // Copy TArray64<uint8> to std::vector<uint8_t>
-                std::vector<uint8_t> vectorBuffer(ImgData.GetData(), ImgData.GetData() + ImgData.Num());
+        RenderRequestQueue.Pop();
+        QueueSize--;
+        if (nextRenderRequest->bReadbackFailed)
+        {
+            // The source gave up on it (e.g. the window was never presented), nothing to encode
+            ReleaseRenderRequest(nextRenderRequest);
+            continue;
+        }
+        SubmitEncode(nextRenderRequest);
+    }
+}
 
-                // Construct std::string from std::vector<uint8_t>
-                StreamerImpl->Publish("/stream.mjpg", std::string(vectorBuffer.begin(), vectorBuffer.end()));
+void AStreamManagerMJPEG::SubmitEncode(FRenderRequestStreamMJPEGStruct *Request)
+{
+    // The deadline counts from the capture, time spent in the readback is already gone
+    double DeadlineSeconds = 0.0;
+    if (EncodeDeadlineSeconds > 0.0f)
+    {
+        const int64 NowUs = (FDateTime::UtcNow() - FDateTime(1970, 1, 1)).GetTicks() / ETimespan::TicksPerMicrosecond;
+        const double AgeSeconds = (NowUs - Request->CaptureTimestampUs) / 1000000.0;
+        DeadlineSeconds = FPlatformTime::Seconds() + FMath::Max(EncodeDeadlineSeconds - AgeSeconds, 0.0);
+    }
 
-                ImgCounter += 1;
+    EncodeQueue->Submit(
+        [this, Request]()
+        {
+            EncodeRequest(Request);
+        },
+        [this, Request]()
+        {
+            StaleDroppedFrames++;
+            ReleaseRenderRequest(Request);
+        },
+        DeadlineSeconds);
+}
 
-                // Delete the first element from RenderQueue
-                RenderRequestQueue.Pop();
-                QueueSize--;
-                delete nextRenderRequest;
-            }
-        }
+void AStreamManagerMJPEG::EncodeRequest(FRenderRequestStreamMJPEGStruct *Request)
+{
+    // Readback may have grown the pooled allocation
+    UpdateAccountedBytes(Request);
+
+    if (StreamMode != EStreamModeMJPEG::Raw)
+    {
+        PublishJpegFrame(Request);
     }
+    if (StreamMode != EStreamModeMJPEG::Jpeg)
+    {
+        PublishRawFrame(Request);
+    }
+    if (bEnableTileStream)
+    {
+        PublishTileFrame(Request);
+    }
+
+    ImgCounter += 1;
+    ReleaseRenderRequest(Request);
 }
 
-void AStreamManagerMJPEG::SetupCaptureComponent()
+void AStreamManagerMJPEG::SetupCaptureComponent(ASceneCapture2D *Capture)
 {
-    if (!IsValid(CaptureComponent))
+    if (!IsValid(Capture))
     {
         UE_LOG(LogStreamMJPEG, Error, TEXT("SetupCaptureComponent: CaptureComponent is not valid!"));
         return;
@@ -142,21 +735,184 @@ void AStreamManagerMJPEG::SetupCaptureComponent()
     renderTarget2D->bGPUSharedFlag = true; // demand buffer on GPU
 
     // Assign RenderTarget
-    CaptureComponent->GetCaptureComponent2D()->TextureTarget = renderTarget2D;
+    USceneCaptureComponent2D *CaptureComponent2D = Capture->GetCaptureComponent2D();
+    CaptureComponent2D->TextureTarget = renderTarget2D;
+    CaptureComponent2D->TextureTarget->TargetGamma = GEngine->GetDisplayGamma();
+
+    // The frame source renders the scene right before each readback, so no render is wasted on frames nobody streams
+    CaptureComponent2D->bCaptureEveryFrame = !bCaptureOnlyStreamedFrames;
+    CaptureComponent2D->bCaptureOnMovement = !bCaptureOnlyStreamedFrames;
+    // Keeps temporal history (TAA, eye adaptation) between captures that are several game frames apart
+    CaptureComponent2D->bAlwaysPersistRenderingState = bCaptureOnlyStreamedFrames;
+
     // Set Camera Properties
-    CaptureComponent->GetCaptureComponent2D()->CaptureSource = ESceneCaptureSource::SCS_FinalColorLDR;
-    CaptureComponent->GetCaptureComponent2D()->TextureTarget->TargetGamma = GEngine->GetDisplayGamma();
-    CaptureComponent->GetCaptureComponent2D()->ShowFlags.SetTemporalAA(true);
-    // lookup more showflags in the UE4 documentation..
+    FSceneCaptureFrameSourceMJPEG::ApplyCostProfile(CaptureComponent2D, CaptureCostProfile);
 
     UE_LOG(LogStreamMJPEG, Warning, TEXT("Initialized RenderTarget!"));
 }
 
+static void EncodeAndPublishJpeg(FMJPEGStreamerImpl &Streamer, IImageWrapper &imageWrapper, const std::string &Path, const FColor *Pixels, int32 Width, int32 Height, int64 TimestampUs, int64 FrameNumber)
+{
+    // Prepare data to be JPEG
+    imageWrapper.SetRaw(Pixels, static_cast<int64>(Width) * Height * sizeof(FColor), Width, Height, ERGBFormat::BGRA, 8);
+    const TArray64<uint8> &ImgData = imageWrapper.GetCompressed(0);
+
+    // Single copy into the buffer that the publisher shares between all clients
+    std::string JpegBuffer(reinterpret_cast<const char *>(ImgData.GetData()), static_cast<size_t>(ImgData.Num()));
+    Streamer.Publish(Path, MoveTemp(JpegBuffer), TimestampUs, FrameNumber);
+}
+
+// Copies the part of the frame inside Region to Out, averaging Region.scale x Region.scale blocks.
+// Returns false if the region lies outside the frame.
+static bool CropRegion(const FColor *Pixels, int32 Width, int32 Height, const nadjieb::net::RegionOfInterest &Region, TArray<FColor> &Out, int32 &OutWidth, int32 &OutHeight)
+{
+    // Regions are MCU aligned but may reach past the frame edge
+    const int32 X0 = FMath::Min(Region.x, Width);
+    const int32 Y0 = FMath::Min(Region.y, Height);
+    const int32 Scale = Region.scale;
+    OutWidth = (FMath::Min(Region.x + Region.width, Width) - X0) / Scale;
+    OutHeight = (FMath::Min(Region.y + Region.height, Height) - Y0) / Scale;
+    if (OutWidth <= 0 || OutHeight <= 0)
+    {
+        return false;
+    }
+
+    Out.SetNumUninitialized(OutWidth * OutHeight);
+    FColor *Dst = Out.GetData();
+    if (Scale == 1)
+    {
+        for (int32 Y = 0; Y < OutHeight; ++Y)
+        {
+            FMemory::Memcpy(Dst + static_cast<int64>(Y) * OutWidth, Pixels + static_cast<int64>(Y0 + Y) * Width + X0, OutWidth * sizeof(FColor));
+        }
+        return true;
+    }
+
+    const int32 Area = Scale * Scale;
+    for (int32 Y = 0; Y < OutHeight; ++Y)
+    {
+        for (int32 X = 0; X < OutWidth; ++X)
+        {
+            uint32 B = 0, G = 0, R = 0;
+            for (int32 SY = 0; SY < Scale; ++SY)
+            {
+                const FColor *Src = Pixels + static_cast<int64>(Y0 + Y * Scale + SY) * Width + X0 + X * Scale;
+                for (int32 SX = 0; SX < Scale; ++SX)
+                {
+                    B += Src[SX].B;
+                    G += Src[SX].G;
+                    R += Src[SX].R;
+                }
+            }
+            Dst[static_cast<int64>(Y) * OutWidth + X] = FColor(R / Area, G / Area, B / Area, 255);
+        }
+    }
+    return true;
+}
+
+void AStreamManagerMJPEG::PublishJpegFrame(FRenderRequestStreamMJPEGStruct *Request)
+{
+    // Views of a capture group are stacked, the stream path shows all of them
+    const FFrameFormatMJPEG &Format = Request->Format;
+    const int32 ImageHeight = Format.GetImageHeight();
+    if (Request->Image.Num() < Format.GetNumPixels())
+    {
+        UE_LOG(LogStreamMJPEG, Warning, TEXT("PublishJpegFrame: readback has %d pixels, expected %dx%d"), Request->Image.Num(), Format.Width, ImageHeight);
+        return;
+    }
+
+    EncodeAndPublishJpeg(*StreamerImpl, *JpegImageWrapper, StreamPathMJPEG, Request->Image.GetData(), Format.Width, ImageHeight, Request->CaptureTimestampUs, Request->FrameNumber);
+
+    for (int32 View = 0; Format.ViewCount > 1 && View < Format.ViewCount; ++View)
+    {
+        const std::string ViewPath = GetViewPath(View);
+        if (StreamerImpl->HasConsumer(ViewPath))
+        {
+            const FColor *ViewPixels = Request->Image.GetData() + static_cast<int64>(Format.Width) * Format.Height * View;
+            EncodeAndPublishJpeg(*StreamerImpl, *JpegImageWrapper, ViewPath, ViewPixels, Format.Width, Format.Height, Request->CaptureTimestampUs, Request->FrameNumber);
+        }
+    }
+
+    if (!HasRegionTopics())
+    {
+        return;
+    }
+
+    // One crop and encode per distinct region, shared by every client that asked for it
+    for (const auto &Region : StreamerImpl->GetRegionsOfInterest(StreamPathMJPEG))
+    {
+        int32 RegionWidth = 0;
+        int32 RegionHeight = 0;
+        if (CropRegion(Request->Image.GetData(), Format.Width, ImageHeight, Region.second, RegionOfInterestScratch, RegionWidth, RegionHeight))
+        {
+            EncodeAndPublishJpeg(*StreamerImpl, *JpegImageWrapper, Region.first, RegionOfInterestScratch.GetData(), RegionWidth, RegionHeight, Request->CaptureTimestampUs, Request->FrameNumber);
+        }
+    }
+}
+
+void AStreamManagerMJPEG::PublishRawFrame(FRenderRequestStreamMJPEGStruct *Request)
+{
+    // Unlike JPEG raw frames are not recorded, so don't convert for nobody
+    if (!StreamerImpl->HasConsumer(StreamPathRaw))
+    {
+        return;
+    }
+
+    const FFrameFormatMJPEG &Format = Request->Format;
+    const int32 ImageHeight = Format.GetImageHeight();
+    if (Request->Image.Num() < Format.GetNumPixels())
+    {
+        UE_LOG(LogStreamMJPEG, Warning, TEXT("PublishRawFrame: readback has %d pixels, expected %dx%d"), Request->Image.Num(), Format.Width, ImageHeight);
+        return;
+    }
+
+    // Converted straight into the buffer the publisher shares between all clients
+    std::string RawBuffer;
+    RawBuffer.resize(static_cast<size_t>(FRawFrameMJPEG::HeaderSize + FRawFrameMJPEG::GetImageSize(RawFrameFormat, Format.Width, ImageHeight)));
+    FRawFrameMJPEG::Pack(RawFrameFormat, Request->Image.GetData(), Format.Width, ImageHeight, reinterpret_cast<uint8 *>(&RawBuffer[0]));
+    StreamerImpl->Publish(StreamPathRaw, MoveTemp(RawBuffer), Request->CaptureTimestampUs, Request->FrameNumber);
+}
+
+void AStreamManagerMJPEG::PublishTileFrame(FRenderRequestStreamMJPEGStruct *Request)
+{
+    // Viewers only understand changed tiles on top of a full frame; start over with one whenever a viewer joins,
+    // also when another one left since the last frame, and whenever a viewer lost a frame
+    const uint64 JoinCount = StreamerImpl->GetJoinCount(StreamPathTiles);
+    const uint64 LostFrameCount = StreamerImpl->GetLostFrameCount(StreamPathTiles);
+    if (JoinCount != TileStreamJoinCount || LostFrameCount != TileStreamLostFrameCount)
+    {
+        TileStream.RequestKeyFrame();
+    }
+    TileStreamJoinCount = JoinCount;
+    TileStreamLostFrameCount = LostFrameCount;
+
+    if (!StreamerImpl->HasConsumer(StreamPathTiles))
+    {
+        TileStream.Reset();
+        return;
+    }
+
+    const FFrameFormatMJPEG &Format = Request->Format;
+    const int32 ImageHeight = Format.GetImageHeight();
+    if (Request->Image.Num() < Format.GetNumPixels())
+    {
+        UE_LOG(LogStreamMJPEG, Warning, TEXT("PublishTileFrame: readback has %d pixels, expected %dx%d"), Request->Image.Num(), Format.Width, ImageHeight);
+        return;
+    }
+
+    // Frames without changes are not sent at all, viewers keep showing the last one
+    if (TileStream.Encode(*JpegImageWrapper, Request->Image.GetData(), Format.Width, ImageHeight, TilePayloadScratch))
+    {
+        std::string TileBuffer(reinterpret_cast<const char *>(TilePayloadScratch.GetData()), static_cast<size_t>(TilePayloadScratch.Num()));
+        StreamerImpl->Publish(StreamPathTiles, MoveTemp(TileBuffer), Request->CaptureTimestampUs, Request->FrameNumber);
+    }
+}
+
 void AStreamManagerMJPEG::CaptureNonBlocking()
 {
-    if (!IsValid(CaptureComponent))
+    if (!FrameSource || !FrameSource->IsValidSource())
     {
-        UE_LOG(LogStreamMJPEG, Error, TEXT("CaptureColorNonBlocking: CaptureComponent was not valid!"));
+        UE_LOG(LogStreamMJPEG, Error, TEXT("CaptureNonBlocking: FrameSource was not valid!"));
         return;
     }
     
@@ -177,78 +933,132 @@ void AStreamManagerMJPEG::CaptureNonBlocking()
     {
         UE_LOG(LogStreamMJPEG, Warning, TEXT("Entering: CaptureNonBlocking"));
     }
-    CaptureComponent->GetCaptureComponent2D()->TextureTarget->TargetGamma = GEngine->GetDisplayGamma();
 
-    // Get RenderContext
-    FTextureRenderTargetResource *renderTargetResource = CaptureComponent->GetCaptureComponent2D()->TextureTarget->GameThread_GetRenderTargetResource();
-    if (VerboseLogging)
-    {
-        UE_LOG(LogStreamMJPEG, Warning, TEXT("Got display gamma"));
-    }
-    struct FReadSurfaceContext
-    {
-        FRenderTarget *SrcRenderTarget;
-        TArray<FColor> *OutData;
-        FIntRect Rect;
-        FReadSurfaceDataFlags Flags;
-    };
-    if (VerboseLogging)
+    // Between two captures is the only place the size may change, every request knows its own
+    ApplyFrameFormat();
+
+    // Init new RenderRequest, skipping the capture when the memory budget is exhausted
+    FRenderRequestStreamMJPEGStruct *renderRequest = AcquireRenderRequest();
+    if (!renderRequest)
     {
-        UE_LOG(LogStreamMJPEG, Warning, TEXT("Inited ReadSurfaceContext"));
+        BudgetDroppedFrames++;
+        if (BudgetDroppedFrames % 100 == 1) // Log every 100 skips
+        {
+            UE_LOG(LogStreamMJPEG, Warning, TEXT("CaptureNonBlocking: Skipping capture, memory budget exhausted (%lld of %lld bytes)"), GetMemoryUsageBytes(), MemoryBudgetBytes);
+        }
+        return;
     }
-    // Init new RenderRequest
-    FRenderRequestStreamMJPEGStruct *renderRequest = new FRenderRequestStreamMJPEGStruct();
-    if (VerboseLogging)
+
+    renderRequest->bReadbackComplete = false;
+    renderRequest->bReadbackFailed = false;
+    renderRequest->bSignalsCompletion = false;
+    if (!FrameSource->RequestFrame(*renderRequest))
     {
-        UE_LOG(LogStreamMJPEG, Warning, TEXT("inited renderrequest"));
+        ReleaseRenderRequest(renderRequest);
+        return;
     }
+    renderRequest->CaptureTimestampUs = (FDateTime::UtcNow() - FDateTime(1970, 1, 1)).GetTicks() / ETimespan::TicksPerMicrosecond;
+    renderRequest->FrameNumber = CaptureFrameNumber++;
 
-    // Setup GPU command
-    FReadSurfaceContext readSurfaceContext = {
-        renderTargetResource,
-        &(renderRequest->Image),
-        FIntRect(0, 0, renderTargetResource->GetSizeXY().X, renderTargetResource->GetSizeXY().Y),
-        FReadSurfaceDataFlags(RCM_UNorm, CubeFace_MAX)};
-    if (VerboseLogging)
+    if (!renderRequest->bReadsBackOnRenderThread)
     {
-        UE_LOG(LogStreamMJPEG, Warning, TEXT("GPU Command complete"));
-    }
-    // Send command to GPU
-    /* Up to version 4.22 use this
-    ENQUEUE_UNIQUE_RENDER_COMMAND_ONEPARAMETER(
-        SceneDrawCompletion,//ReadSurfaceCommand,
-        FReadSurfaceContext, Context, readSurfaceContext,
-    {
-        RHICmdList.ReadSurfaceData(
-            Context.SrcRenderTarget->GetRenderTargetTexture(),
-            Context.Rect,
-            *Context.OutData,
-            Context.Flags
-        );
-    });
-    */
-    // Above 4.22 use this
-    ENQUEUE_RENDER_COMMAND(SceneDrawCompletion)
-    (
-        [readSurfaceContext](FRHICommandListImmediate &RHICmdList)
-        {
-            RHICmdList.ReadSurfaceData(
-                readSurfaceContext.SrcRenderTarget->GetRenderTargetTexture(),
-                readSurfaceContext.Rect,
-                *readSurfaceContext.OutData,
-                readSurfaceContext.Flags);
-        });
+        renderRequest->bReadbackComplete = true;
+    }
+    // Once queued, a complete request may be consumed and recycled by another thread at any time
+    const bool bQueueCompletionCommand = renderRequest->bReadsBackOnRenderThread && !renderRequest->bSignalsCompletion;
 
     // Notifiy new task in RenderQueue
     RenderRequestQueue.Enqueue(renderRequest);
     QueueSize++;
 
-    // Set RenderCommandFence
-    renderRequest->RenderFence.BeginFence();
+    if (renderRequest->bSignalsCompletion)
+    {
+        // Not complete yet, so still ours to hand over; the source may complete it from now on
+        FrameSource->OnRequestQueued(*renderRequest);
+    }
+
+    if (bQueueCompletionCommand)
+    {
+        // Render commands run in order, so this one runs right after the source's readback filled Image
+        ENQUEUE_RENDER_COMMAND(StreamMJPEGReadbackComplete)
+        (
+            [renderRequest](FRHICommandListImmediate &)
+            {
+                CompleteReadback(*renderRequest);
+            });
+    }
+    else
+    {
+        // Complete already, or completed by the source at any time, possibly before it was queued
+        FReadbackCompletionMJPEG::Signal(ReadbackCompletion);
+    }
+}
+
+static FStreamClientStatsMJPEG ToClientStats(const nadjieb::net::ClientStats &Stats)
+{
+    FStreamClientStatsMJPEG Out;
+    Out.Address = UTF8_TO_TCHAR(Stats.peer.c_str());
+    Out.Stream = UTF8_TO_TCHAR(Stats.topic.c_str());
+    Out.DeliveredFrames = static_cast<int64>(Stats.delivered_frames);
+    Out.SkippedFrames = static_cast<int64>(Stats.skipped_frames);
+    Out.BytesSent = static_cast<int64>(Stats.bytes_sent);
+    Out.ThroughputKBps = static_cast<float>(Stats.throughput / 1024.0);
+    Out.SecondsBehind = Stats.behind_ms / 1000.0f;
+    Out.FrameInterval = Stats.frame_interval;
+    Out.bDowngraded = Stats.downgraded;
+    return Out;
+}
+
+TArray<FStreamClientStatsMJPEG> AStreamManagerMJPEG::GetClientStats() const
+{
+    TArray<FStreamClientStatsMJPEG> Clients;
+    for (const auto &Stats : StreamerImpl->GetClientStats())
+    {
+        Clients.Add(ToClientStats(Stats));
+    }
+    return Clients;
+}
+
+int32 AStreamManagerMJPEG::GetClientCount() const
+{
+    return StreamerImpl->GetClientCount();
+}
+
+int32 AStreamManagerMJPEG::GetShedFrameInterval() const
+{
+    return StreamerImpl->GetAdmissionStats().frame_interval;
+}
+
+int64 AStreamManagerMJPEG::GetRejectedClientCount() const
+{
+    return static_cast<int64>(StreamerImpl->GetAdmissionStats().rejected_clients);
+}
+
+void AStreamManagerMJPEG::DispatchClientEvents()
+{
+    static const TCHAR *EventNames[] = {TEXT("behind"), TEXT("frame rate reduced"), TEXT("downgraded"), TEXT("recovered"), TEXT("disconnected")};
+
+    for (const auto &ClientEvent : StreamerImpl->TakeClientEvents())
+    {
+        const FStreamClientStatsMJPEG Client = ToClientStats(ClientEvent.stats);
+        const ESlowClientEventMJPEG Event = static_cast<ESlowClientEventMJPEG>(ClientEvent.type);
+        if (VerboseLogging || Event == ESlowClientEventMJPEG::Disconnected)
+        {
+            UE_LOG(LogStreamMJPEG, Log, TEXT("Client %s (%s): %s, %.1f KB/s, every %d. frame"), *Client.Address, *Client.Stream,
+                EventNames[static_cast<int32>(Event)], Client.ThroughputKBps, Client.FrameInterval);
+        }
+        OnSlowClient.Broadcast(Event, Client);
+    }
 }
 
 void AStreamManagerMJPEG::UpdateRenderTargetAfterFrameSizeChanged()
 {
+    // The next capture applies it, see ApplyFrameFormat
+    if (FrameSource)
+    {
+        return;
+    }
+
     if (!IsValid(CaptureComponent))
     {
         UE_LOG(LogStreamMJPEG, Error, TEXT("UpdateRenderTargetAfterFrameSizeChanged: CaptureComponent is not valid!"));
@@ -256,4 +1066,11 @@ void AStreamManagerMJPEG::UpdateRenderTargetAfterFrameSizeChanged()
     }
 
     CaptureComponent->GetCaptureComponent2D()->TextureTarget->InitCustomFormat(FrameWidth, FrameHeight, PF_B8G8R8A8, true); // PF... disables HDR, which is most important since HDR gives gigantic overhead, and is not needed!
-}
\ No newline at end of file
+}
+
+void AStreamManagerMJPEG::SetFrameSize(int32 Width, int32 Height)
+{
+    FrameWidth = FMath::Max(Width, 1);
+    FrameHeight = FMath::Max(Height, 1);
+    UpdateRenderTargetAfterFrameSizeChanged();
+}
@@ -0,0 +1,106 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "StreamManagerMJPEG.h"
+#include "FrameSourceMJPEG.h"
+
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSyntheticPatternDeterminismMJPEGTest, "ScreenStreamMJPEG.Synthetic.PatternIsDeterministic",
+    EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FSyntheticPatternDeterminismMJPEGTest::RunTest(const FString &Parameters)
+{
+    // Odd sizes, so the edges of bars and gradients are covered too
+    const int32 Width = 97;
+    const int32 Height = 61;
+    const uint32 Seed = 42;
+    const uint64 FrameIndex = 7;
+
+    const ESyntheticPatternMJPEG Patterns[] = {ESyntheticPatternMJPEG::MovingGradient, ESyntheticPatternMJPEG::Noise, ESyntheticPatternMJPEG::Static};
+    for (ESyntheticPatternMJPEG Pattern : Patterns)
+    {
+        const FString Name = StaticEnum<ESyntheticPatternMJPEG>()->GetNameStringByValue(static_cast<int64>(Pattern));
+
+        TArray<FColor> First;
+        TArray<FColor> Second;
+        FSyntheticFrameSourceMJPEG::GeneratePattern(Pattern, Width, Height, Seed, FrameIndex, First);
+        // Other contents and size before, nothing of it may leak into the frame
+        Second.Init(FColor::Magenta, 3);
+        FSyntheticFrameSourceMJPEG::GeneratePattern(Pattern, Width, Height, Seed, FrameIndex, Second);
+
+        TestEqual(FString::Printf(TEXT("%s: pixel count"), *Name), First.Num(), Width * Height);
+        TestTrue(FString::Printf(TEXT("%s: same seed and frame index give the same frame"), *Name), First == Second);
+
+        if (Pattern != ESyntheticPatternMJPEG::Static)
+        {
+            TArray<FColor> NextFrame;
+            FSyntheticFrameSourceMJPEG::GeneratePattern(Pattern, Width, Height, Seed, FrameIndex + 1, NextFrame);
+            TestFalse(FString::Printf(TEXT("%s: the next frame differs"), *Name), First == NextFrame);
+        }
+    }
+
+    TArray<FColor> Noise;
+    TArray<FColor> OtherSeedNoise;
+    FSyntheticFrameSourceMJPEG::GeneratePattern(ESyntheticPatternMJPEG::Noise, Width, Height, Seed, FrameIndex, Noise);
+    FSyntheticFrameSourceMJPEG::GeneratePattern(ESyntheticPatternMJPEG::Noise, Width, Height, Seed + 1, FrameIndex, OtherSeedNoise);
+    TestFalse(TEXT("Noise: another seed gives another frame"), Noise == OtherSeedNoise);
+
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSyntheticPublishMJPEGTest, "ScreenStreamMJPEG.StreamManager.PublishesSyntheticFrames",
+    EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FSyntheticPublishMJPEGTest::RunTest(const FString &Parameters)
+{
+    // A world of its own, the editor world may not be playing
+    UWorld *World = UWorld::CreateWorld(EWorldType::Game, false);
+    FWorldContext &WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+    WorldContext.SetCurrentWorld(World);
+    World->InitializeActorsForPlay(FURL());
+    World->BeginPlay();
+
+    AStreamManagerMJPEG *StreamManager = World->SpawnActorDeferred<AStreamManagerMJPEG>(AStreamManagerMJPEG::StaticClass(), FTransform::Identity);
+    StreamManager->BindAddress = TEXT("127.0.0.1");
+    StreamManager->ServerPort = 18080;
+    StreamManager->ServerPortFallbackCount = 32;
+    StreamManager->FrameWidth = 160;
+    StreamManager->FrameHeight = 120;
+    // Frames wait for the ticks below, a slow machine must not drop them as stale
+    StreamManager->EncodeDeadlineSeconds = 0.0f;
+    StreamManager->SetFrameSource(MakeUnique<FSyntheticFrameSourceMJPEG>(ESyntheticPatternMJPEG::MovingGradient, 160, 120, 1));
+    StreamManager->FinishSpawning(FTransform::Identity);
+
+    TestTrue(TEXT("Server is running"), StreamManager->GetServerPort() > 0);
+
+    const int32 FrameCount = 3;
+    const int32 PublishedBefore = StreamManager->GetPublishedFrameCount();
+    for (int32 Frame = 0; Frame < FrameCount; ++Frame)
+    {
+        StreamManager->CaptureNonBlocking();
+    }
+
+    // Tick hands completed frames to the encode threads, which publish them in the background
+    const double Timeout = FPlatformTime::Seconds() + 10.0;
+    while (StreamManager->GetPublishedFrameCount() < PublishedBefore + FrameCount && FPlatformTime::Seconds() < Timeout)
+    {
+        StreamManager->Tick(0.01f);
+        FPlatformProcess::Sleep(0.01f);
+    }
+
+    TestEqual(TEXT("Every captured frame was published"), StreamManager->GetPublishedFrameCount() - PublishedBefore, FrameCount);
+
+    StreamManager->Destroy();
+    GEngine->DestroyWorldContext(World);
+    World->DestroyWorld(false);
+    return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
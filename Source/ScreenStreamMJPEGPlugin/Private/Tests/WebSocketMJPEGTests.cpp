@@ -0,0 +1,81 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "CoreMinimal.h"
+#include "mjpeg_streamer.hpp"
+
+namespace
+{
+    // Masked client frame header, with the shortest length encoding unless Length127 forces the 64-bit one
+    std::string ClientFrameHeader(uint8 Opcode, uint64 Length, bool bLength127 = false)
+    {
+        std::string Header;
+        Header += static_cast<char>(0x80 | Opcode);
+        if (Length < 126 && !bLength127)
+        {
+            Header += static_cast<char>(0x80 | Length);
+        }
+        else if (Length <= 0xFFFF && !bLength127)
+        {
+            Header += static_cast<char>(0x80 | 126);
+            Header += static_cast<char>(Length >> 8);
+            Header += static_cast<char>(Length);
+        }
+        else
+        {
+            Header += static_cast<char>(0x80 | 127);
+            for (int32 Shift = 56; Shift >= 0; Shift -= 8)
+            {
+                Header += static_cast<char>(Length >> Shift);
+            }
+        }
+        return Header + std::string(4, '\x5A');
+    }
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FWebSocketFrameScannerMJPEGTest, "ScreenStreamMJPEG.WebSocket.FrameScanner",
+    EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FWebSocketFrameScannerMJPEGTest::RunTest(const FString &Parameters)
+{
+    using nadjieb::net::websocket::FrameScanner;
+
+    {
+        // A length that used to wrap the parse position back onto the same frame
+        FrameScanner Scanner;
+        TestTrue(TEXT("Length with the top bit set closes"), Scanner.feed(ClientFrameHeader(nadjieb::net::websocket::TEXT, ~uint64(0) - 13)));
+    }
+
+    {
+        // Huge but valid: its payload never ends, nothing after it counts as a frame
+        FrameScanner Scanner;
+        const std::string Frame = ClientFrameHeader(nadjieb::net::websocket::BINARY, (uint64(1) << 63) - 1) + ClientFrameHeader(nadjieb::net::websocket::CLOSE, 0);
+        TestFalse(TEXT("Close inside a huge payload is payload"), Scanner.feed(Frame));
+    }
+
+    {
+        // A ping with a 16-bit length, then a close, cut inside the header, the payload and the close header
+        const std::string Ping = ClientFrameHeader(nadjieb::net::websocket::PING, 300) + std::string(300, '\x88');
+        const std::string Close = ClientFrameHeader(nadjieb::net::websocket::CLOSE, 0);
+
+        FrameScanner Scanner;
+        TestFalse(TEXT("Split header"), Scanner.feed(Ping.substr(0, 3)));
+        TestFalse(TEXT("Split payload"), Scanner.feed(Ping.substr(3, 100)));
+        TestFalse(TEXT("Rest of the ping and start of the close"), Scanner.feed(Ping.substr(103) + Close.substr(0, 1)));
+        TestTrue(TEXT("Rest of the close"), Scanner.feed(Close.substr(1)));
+    }
+
+    {
+        // The same frames in one read, the 64-bit length encoding used for a short payload
+        FrameScanner Scanner;
+        const std::string Frames = ClientFrameHeader(nadjieb::net::websocket::TEXT, 5, true) + "hello" + ClientFrameHeader(nadjieb::net::websocket::CLOSE, 0);
+        TestTrue(TEXT("Close after a text frame in one read"), Scanner.feed(Frames));
+    }
+
+    return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,218 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "TileStreamMJPEG.h"
+
+#include "IImageWrapper.h"
+
+namespace
+{
+    void WriteUInt16(uint8 *Out, uint32 Value)
+    {
+        Out[0] = static_cast<uint8>(Value);
+        Out[1] = static_cast<uint8>(Value >> 8);
+    }
+
+    void WriteUInt32(uint8 *Out, uint32 Value)
+    {
+        Out[0] = static_cast<uint8>(Value);
+        Out[1] = static_cast<uint8>(Value >> 8);
+        Out[2] = static_cast<uint8>(Value >> 16);
+        Out[3] = static_cast<uint8>(Value >> 24);
+    }
+
+    // True if a pixel of the two rows differs in color (alpha is ignored). ORs the XOR of the whole row instead
+    // of returning at the first differing pixel, so the loop has no branch; tiles still stop at the first row that differs.
+    bool RowDiffers(const FColor *Row, const FColor *PreviousRow, int32 Width)
+    {
+        static const uint32 ColorMask = FColor(255, 255, 255, 0).DWColor();
+
+        uint32 Difference = 0;
+        for (int32 X = 0; X < Width; ++X)
+        {
+            Difference |= Row[X].DWColor() ^ PreviousRow[X].DWColor();
+        }
+        return (Difference & ColorMask) != 0;
+    }
+}
+
+void FTileStreamMJPEG::SetTileSize(int32 InTileSize)
+{
+    const int32 NewTileSize = FMath::Clamp(InTileSize, 16, 256) / 16 * 16;
+    if (NewTileSize != TileSize)
+    {
+        // Clients place tiles by position only, but the old grid may cut differently
+        TileSize = NewTileSize;
+        bKeyFrameRequested = true;
+    }
+}
+
+void FTileStreamMJPEG::SetKeyFrameInterval(int32 Interval)
+{
+    KeyFrameInterval = FMath::Max(Interval, 0);
+}
+
+void FTileStreamMJPEG::Reset()
+{
+    PreviousFrame.Empty();
+    PreviousWidth = 0;
+    PreviousHeight = 0;
+    bKeyFrameRequested = true;
+}
+
+bool FTileStreamMJPEG::Encode(IImageWrapper &ImageWrapper, const FColor *Pixels, int32 Width, int32 Height, TArray<uint8> &Out)
+{
+    if (Width <= 0 || Height <= 0 || Width > MAX_uint16 || Height > MAX_uint16)
+    {
+        return false;
+    }
+
+    ++FramesSinceKeyFrame;
+    const bool bKeyFrame = bKeyFrameRequested || Width != PreviousWidth || Height != PreviousHeight
+        || (KeyFrameInterval > 0 && FramesSinceKeyFrame >= KeyFrameInterval);
+    if (bKeyFrame)
+    {
+        // Filled tile by tile below, every tile counts as changed
+        PreviousFrame.SetNumUninitialized(static_cast<int64>(Width) * Height);
+        PreviousWidth = Width;
+        PreviousHeight = Height;
+        FramesSinceKeyFrame = 0;
+        bKeyFrameRequested = false;
+    }
+
+    Out.Reset();
+    Out.AddUninitialized(HeaderSize);
+    TileScratch.SetNumUninitialized(TileSize * TileSize);
+
+    uint32 TileCount = 0;
+    for (int32 TileY = 0; TileY < Height; TileY += TileSize)
+    {
+        const int32 TileHeight = FMath::Min(TileSize, Height - TileY);
+        for (int32 TileX = 0; TileX < Width; TileX += TileSize)
+        {
+            const int32 TileWidth = FMath::Min(TileSize, Width - TileX);
+            const int64 TileOrigin = static_cast<int64>(TileY) * Width + TileX;
+
+            bool bChanged = bKeyFrame;
+            for (int32 Row = 0; !bChanged && Row < TileHeight; ++Row)
+            {
+                const int64 RowOffset = TileOrigin + static_cast<int64>(Row) * Width;
+                bChanged = RowDiffers(Pixels + RowOffset, PreviousFrame.GetData() + RowOffset, TileWidth);
+            }
+            if (!bChanged)
+            {
+                continue;
+            }
+
+            // Clients now see this tile as it is, later frames compare against it
+            for (int32 Row = 0; Row < TileHeight; ++Row)
+            {
+                const int64 RowOffset = TileOrigin + static_cast<int64>(Row) * Width;
+                FMemory::Memcpy(TileScratch.GetData() + Row * TileWidth, Pixels + RowOffset, TileWidth * sizeof(FColor));
+                FMemory::Memcpy(PreviousFrame.GetData() + RowOffset, Pixels + RowOffset, TileWidth * sizeof(FColor));
+            }
+
+            ImageWrapper.SetRaw(TileScratch.GetData(), static_cast<int64>(TileWidth) * TileHeight * sizeof(FColor), TileWidth, TileHeight, ERGBFormat::BGRA, 8);
+            const TArray64<uint8> &Jpeg = ImageWrapper.GetCompressed(0);
+
+            const int32 TileOffset = Out.AddUninitialized(TileHeaderSize + static_cast<int32>(Jpeg.Num()));
+            uint8 *TileOut = Out.GetData() + TileOffset;
+            WriteUInt16(TileOut, static_cast<uint32>(TileX));
+            WriteUInt16(TileOut + 2, static_cast<uint32>(TileY));
+            WriteUInt32(TileOut + 4, static_cast<uint32>(Jpeg.Num()));
+            FMemory::Memcpy(TileOut + TileHeaderSize, Jpeg.GetData(), Jpeg.Num());
+            ++TileCount;
+        }
+    }
+
+    if (TileCount == 0)
+    {
+        return false;
+    }
+
+    uint8 *Header = Out.GetData();
+    Header[0] = 'T';
+    Header[1] = 'I';
+    Header[2] = 'L';
+    Header[3] = 'E';
+    WriteUInt16(Header + 4, static_cast<uint32>(Width));
+    WriteUInt16(Header + 6, static_cast<uint32>(Height));
+    WriteUInt16(Header + 8, static_cast<uint32>(TileSize));
+    WriteUInt16(Header + 10, bKeyFrame ? KeyFrameFlag : 0);
+    WriteUInt32(Header + 12, TileCount);
+    return true;
+}
+
+FString FTileStreamMJPEG::GetViewerHtml(const FString &StreamPath)
+{
+    // Each WebSocket message is 16 bytes of sequence and timestamp (uint64) followed by one payload
+    static const TCHAR *ViewerHtml = TEXT(R"(<!DOCTYPE html>
+<html>
+<head>
+<meta charset="utf-8">
+<title>Tile Stream</title>
+<style>
+body { margin: 0; background: #000; }
+canvas { display: block; margin: auto; max-width: 100vw; max-height: 100vh; }
+</style>
+</head>
+<body>
+<canvas id="view"></canvas>
+<script>
+const canvas = document.getElementById('view');
+const context = canvas.getContext('2d');
+const infoSize = 16;
+let drawn = Promise.resolve();
+let hasKeyFrame = false;
+
+async function draw(buffer) {
+    const header = new DataView(buffer, infoSize);
+    if (header.getUint32(0, true) !== 0x454C4954) { // "TILE"
+        return;
+    }
+    const width = header.getUint16(4, true);
+    const height = header.getUint16(6, true);
+    const keyFrame = (header.getUint16(10, true) & 1) !== 0;
+    const count = header.getUint32(12, true);
+    if (keyFrame) {
+        hasKeyFrame = true;
+        if (canvas.width !== width || canvas.height !== height) {
+            canvas.width = width;
+            canvas.height = height;
+        }
+    }
+    if (!hasKeyFrame) {
+        return;
+    }
+
+    const tiles = [];
+    let offset = 16;
+    for (let i = 0; i < count; ++i) {
+        const x = header.getUint16(offset, true);
+        const y = header.getUint16(offset + 2, true);
+        const size = header.getUint32(offset + 4, true);
+        const jpeg = new Blob([new Uint8Array(buffer, infoSize + offset + 8, size)], { type: 'image/jpeg' });
+        tiles.push(createImageBitmap(jpeg).then(bitmap => ({ x, y, bitmap })));
+        offset += 8 + size;
+    }
+    // Decoded in parallel, drawn together so a frame never shows half updated
+    for (const tile of await Promise.all(tiles)) {
+        context.drawImage(tile.bitmap, tile.x, tile.y);
+        tile.bitmap.close();
+    }
+}
+
+function connect() {
+    const socket = new WebSocket((location.protocol === 'https:' ? 'wss://' : 'ws://') + location.host + '{StreamPath}');
+    socket.binaryType = 'arraybuffer';
+    socket.onopen = () => { hasKeyFrame = false; };
+    socket.onmessage = event => { drawn = drawn.then(() => draw(event.data)).catch(() => {}); };
+    socket.onclose = () => setTimeout(connect, 1000);
+}
+connect();
+</script>
+</body>
+</html>
+)");
+
+    return FString(ViewerHtml).Replace(TEXT("{StreamPath}"), *StreamPath);
+}
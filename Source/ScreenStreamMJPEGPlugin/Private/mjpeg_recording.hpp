@@ -0,0 +1,985 @@
+/*
+Recording of published MJPEG topics for the nadjieb::MJPEGStreamer in mjpeg_streamer.hpp.
+
+Frames are appended exactly as they were published (no re-encoding) to a
+length-prefixed container with a timestamp index:
+
+    FileHeader                              64 bytes
+    { FrameHeader, JPEG bytes } * N         24 bytes + size each
+    IndexEntry * N                          16 bytes each, written on close
+    IndexTrailer                            24 bytes, last bytes of the file
+
+A file without a trailer (crash, power loss) is still readable by scanning the
+frame headers from the start. All integers are little endian.
+*/
+
+#pragma once
+
+#include "mjpeg_streamer.hpp"
+
+#ifdef NADJIEB_MJPEG_STREAMER_PLATFORM_WINDOWS
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#ifdef NADJIEB_MJPEG_STREAMER_PLATFORM_LINUX
+#include <sys/sendfile.h>
+#endif
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// #include <nadjieb/io/recording_format.hpp>
+
+
+namespace nadjieb {
+namespace io {
+namespace recording {
+static const char FILE_MAGIC[8] = {'N', 'M', 'J', 'P', 'R', 'E', 'C', '1'};
+static const char INDEX_MAGIC[8] = {'N', 'M', 'J', 'P', 'I', 'D', 'X', '1'};
+static const uint32_t FRAME_MAGIC = 0x4D415246;  // "FRAM"
+static const uint32_t VERSION = 1;
+static const char* const FILE_EXTENSION = ".mjpr";
+
+#pragma pack(push, 1)
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    int64_t created_us;
+    uint8_t reserved[40];
+};
+
+struct FrameHeader {
+    uint32_t magic;
+    uint32_t size;
+    uint64_t sequence;
+    int64_t timestamp_us;
+};
+
+struct IndexEntry {
+    int64_t timestamp_us;
+    // File offset of the FrameHeader
+    uint64_t offset;
+};
+
+struct IndexTrailer {
+    char magic[8];
+    uint64_t count;
+    uint64_t index_offset;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(FileHeader) == 64, "FileHeader layout");
+static_assert(sizeof(FrameHeader) == 24, "FrameHeader layout");
+static_assert(sizeof(IndexEntry) == 16, "IndexEntry layout");
+static_assert(sizeof(IndexTrailer) == 24, "IndexTrailer layout");
+}  // namespace recording
+}  // namespace io
+}  // namespace nadjieb
+
+// #include <nadjieb/io/recording_writer.hpp>
+
+
+namespace nadjieb {
+namespace io {
+// Appends frames through a large aligned buffer that is only ever written out in whole
+// blocks, so the file can be opened with O_DIRECT and bypass the page cache.
+class RecordingWriter : public nadjieb::utils::NonCopyable {
+   public:
+    static constexpr size_t BLOCK_ALIGNMENT = 4096;
+    static constexpr size_t WRITE_BUFFER_SIZE = 4 * 1024 * 1024;
+
+    virtual ~RecordingWriter() {
+        close();
+        if (buffer_ != nullptr) {
+            ::operator delete(buffer_, std::align_val_t(BLOCK_ALIGNMENT));
+        }
+    }
+
+    bool open(const std::string& path, bool direct_io) {
+        close();
+
+        if (buffer_ == nullptr) {
+            buffer_ = static_cast<char*>(::operator new(WRITE_BUFFER_SIZE, std::align_val_t(BLOCK_ALIGNMENT)));
+        }
+
+#ifdef NADJIEB_MJPEG_STREAMER_PLATFORM_WINDOWS
+        direct_io_ = false;
+        fd_ = ::_open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+        direct_io_ = direct_io;
+        fd_ = ::open(path.c_str(), flags | (direct_io_ ? O_DIRECT : 0), 0644);
+        if (fd_ < 0 && direct_io_) {
+            // Some filesystems (tmpfs, network mounts) reject O_DIRECT
+            direct_io_ = false;
+            fd_ = ::open(path.c_str(), flags, 0644);
+        }
+#else
+        (void)direct_io;
+        direct_io_ = false;
+        fd_ = ::open(path.c_str(), flags, 0644);
+#endif
+#endif
+        if (fd_ < 0) {
+            return false;
+        }
+
+        path_ = path;
+        buffer_used_ = 0;
+        file_size_ = 0;
+        index_.clear();
+        first_timestamp_us_ = 0;
+        last_timestamp_us_ = 0;
+
+        recording::FileHeader header = {};
+        std::memcpy(header.magic, recording::FILE_MAGIC, sizeof(header.magic));
+        header.version = recording::VERSION;
+        header.header_size = sizeof(recording::FileHeader);
+        header.created_us = nadjieb::net::nowMicros();
+        return writeBytes(&header, sizeof(header));
+    }
+
+    bool isOpen() const { return fd_ >= 0; }
+
+    bool append(const nadjieb::net::Frame& frame) {
+        if (!isOpen()) {
+            return false;
+        }
+
+        if (index_.empty()) {
+            first_timestamp_us_ = frame.timestamp_us;
+        }
+        last_timestamp_us_ = frame.timestamp_us;
+
+        index_.push_back(recording::IndexEntry{frame.timestamp_us, file_size_});
+
+        recording::FrameHeader header = {};
+        header.magic = recording::FRAME_MAGIC;
+        header.size = (uint32_t)frame.data.size();
+        header.sequence = frame.sequence;
+        header.timestamp_us = frame.timestamp_us;
+
+        return writeBytes(&header, sizeof(header)) && writeBytes(frame.data.data(), frame.data.size());
+    }
+
+    // Writes the partial last block, the index and the trailer
+    void close() {
+        if (!isOpen()) {
+            return;
+        }
+
+        // The tail is not block sized, leave direct I/O for the last writes
+        disableDirectIO();
+
+        recording::IndexTrailer trailer = {};
+        std::memcpy(trailer.magic, recording::INDEX_MAGIC, sizeof(trailer.magic));
+        trailer.count = index_.size();
+        trailer.index_offset = file_size_;
+
+        bool ok = writeBytes(index_.data(), index_.size() * sizeof(recording::IndexEntry))
+                  && writeBytes(&trailer, sizeof(trailer)) && flushBuffer(buffer_used_);
+        if (!ok) {
+            UE_LOG(LogTemp, Error, TEXT("nadjieb::MJPEGStreamer: failed to finalize recording %s"), *FString(path_.c_str()));
+        }
+
+#ifdef NADJIEB_MJPEG_STREAMER_PLATFORM_WINDOWS
+        ::_close(fd_);
+#else
+        ::close(fd_);
+#endif
+        fd_ = -1;
+    }
+
+    uint64_t getFileSize() const { return file_size_; }
+
+    size_t getFrameCount() const { return index_.size(); }
+
+    int64_t getDurationMicros() const { return last_timestamp_us_ - first_timestamp_us_; }
+
+    const std::string& getPath() const { return path_; }
+
+   private:
+    int fd_ = -1;
+    bool direct_io_ = false;
+    std::string path_;
+    char* buffer_ = nullptr;
+    size_t buffer_used_ = 0;
+    // Logical size including what is still buffered
+    uint64_t file_size_ = 0;
+    std::vector<recording::IndexEntry> index_;
+    int64_t first_timestamp_us_ = 0;
+    int64_t last_timestamp_us_ = 0;
+
+    bool writeBytes(const void* data, size_t size) {
+        auto src = static_cast<const char*>(data);
+        file_size_ += size;
+
+        while (size > 0) {
+            size_t chunk = WRITE_BUFFER_SIZE - buffer_used_;
+            if (chunk > size) {
+                chunk = size;
+            }
+
+            std::memcpy(buffer_ + buffer_used_, src, chunk);
+            buffer_used_ += chunk;
+            src += chunk;
+            size -= chunk;
+
+            if (buffer_used_ == WRITE_BUFFER_SIZE && !flushBuffer(WRITE_BUFFER_SIZE)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool flushBuffer(size_t size) {
+        size_t written = 0;
+        while (written < size) {
+#ifdef NADJIEB_MJPEG_STREAMER_PLATFORM_WINDOWS
+            int res = ::_write(fd_, buffer_ + written, (unsigned int)(size - written));
+#else
+            ssize_t res = ::write(fd_, buffer_ + written, size - written);
+            if (res < 0 && errno == EINTR) {
+                continue;
+            }
+            if (res < 0 && errno == EINVAL && direct_io_) {
+                // Filesystem accepted O_DIRECT on open but not on write
+                disableDirectIO();
+                continue;
+            }
+#endif
+            if (res <= 0) {
+                return false;
+            }
+            written += (size_t)res;
+        }
+
+        buffer_used_ = 0;
+        return true;
+    }
+
+    void disableDirectIO() {
+#if !defined NADJIEB_MJPEG_STREAMER_PLATFORM_WINDOWS && defined O_DIRECT
+        if (direct_io_) {
+            int flags = ::fcntl(fd_, F_GETFL);
+            if (flags >= 0) {
+                ::fcntl(fd_, F_SETFL, flags & ~O_DIRECT);
+            }
+            direct_io_ = false;
+        }
+#endif
+    }
+};
+}  // namespace io
+}  // namespace nadjieb
+
+// #include <nadjieb/io/recorder.hpp>
+
+
+namespace nadjieb {
+namespace io {
+struct RecorderOptions {
+    std::string directory;
+    // File names are <prefix>_<UTC date>_<time>_<part>.mjpr
+    std::string prefix = "stream";
+    // Rotation limits, 0 disables the limit
+    uint64_t max_file_bytes = 1024ull * 1024 * 1024;
+    int64_t max_file_duration_us = 10ll * 60 * 1000 * 1000;
+    bool direct_io = true;
+    // Frames waiting for the I/O thread; newer frames are dropped beyond this
+    size_t max_queued_frames = 64;
+};
+
+// Records every frame of a topic on its own I/O thread. push() is the topic subscriber
+// callback: it only queues a reference to the shared frame buffer, never copies or blocks.
+class Recorder : public nadjieb::utils::NonCopyable, public nadjieb::utils::Runnable {
+   public:
+    virtual ~Recorder() { stop(); }
+
+    bool start(const RecorderOptions& options) {
+        stop();
+
+        state_ = nadjieb::utils::State::BOOTING;
+        options_ = options;
+
+        std::error_code ec;
+        std::filesystem::create_directories(options_.directory, ec);
+        if (ec) {
+            UE_LOG(
+                LogTemp, Error, TEXT("nadjieb::MJPEGStreamer: cannot create recording directory %s"),
+                *FString(options_.directory.c_str()));
+            state_ = nadjieb::utils::State::TERMINATED;
+            return false;
+        }
+
+        end_recorder_ = false;
+        part_ = 0;
+        thread_ = std::thread(&Recorder::run, this);
+        state_ = nadjieb::utils::State::RUNNING;
+        return true;
+    }
+
+    // Writes out everything already queued, then finalizes the current file
+    void stop() {
+        {
+            std::unique_lock<std::mutex> lock(queue_mtx_);
+            if (end_recorder_) {
+                return;
+            }
+            state_ = nadjieb::utils::State::TERMINATING;
+            end_recorder_ = true;
+        }
+        condition_.notify_all();
+
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        state_ = nadjieb::utils::State::TERMINATED;
+    }
+
+    void push(const nadjieb::net::FrameBuffer& frame) {
+        {
+            std::unique_lock<std::mutex> lock(queue_mtx_);
+            if (end_recorder_) {
+                return;
+            }
+
+            if (queue_.size() >= options_.max_queued_frames) {
+                ++dropped_frames_;
+                return;
+            }
+
+            queue_.push_back(frame);
+        }
+        condition_.notify_one();
+    }
+
+    uint64_t getRecordedFrames() const { return recorded_frames_; }
+
+    uint64_t getDroppedFrames() const { return dropped_frames_; }
+
+    std::string getCurrentFile() {
+        std::unique_lock<std::mutex> lock(file_mtx_);
+        return current_file_;
+    }
+
+   private:
+    RecorderOptions options_;
+    RecordingWriter writer_;
+    std::thread thread_;
+    std::deque<nadjieb::net::FrameBuffer> queue_;
+    std::mutex queue_mtx_;
+    std::condition_variable condition_;
+    bool end_recorder_ = true;
+    int part_ = 0;
+    std::string current_file_;
+    std::mutex file_mtx_;
+    std::atomic<uint64_t> recorded_frames_{0};
+    std::atomic<uint64_t> dropped_frames_{0};
+
+    void run() {
+        while (true) {
+            nadjieb::net::FrameBuffer frame;
+            {
+                std::unique_lock<std::mutex> lock(queue_mtx_);
+                condition_.wait(lock, [&]() { return (end_recorder_ || !queue_.empty()); });
+                if (queue_.empty()) {
+                    break;
+                }
+
+                frame = std::move(queue_.front());
+                queue_.pop_front();
+            }
+
+            if (needsRotation(*frame)) {
+                rotate(*frame);
+            }
+
+            if (writer_.append(*frame)) {
+                ++recorded_frames_;
+            } else {
+                ++dropped_frames_;
+            }
+        }
+
+        writer_.close();
+    }
+
+    bool needsRotation(const nadjieb::net::Frame& frame) const {
+        if (!writer_.isOpen()) {
+            return true;
+        }
+
+        if (writer_.getFrameCount() == 0) {
+            return false;
+        }
+
+        if (options_.max_file_bytes != 0
+            && writer_.getFileSize() + frame.data.size() + sizeof(recording::FrameHeader) > options_.max_file_bytes) {
+            return true;
+        }
+
+        return (options_.max_file_duration_us != 0 && writer_.getDurationMicros() >= options_.max_file_duration_us);
+    }
+
+    void rotate(const nadjieb::net::Frame& first_frame) {
+        writer_.close();
+
+        auto path = makeFileName(first_frame.timestamp_us);
+        if (!writer_.open(path, options_.direct_io)) {
+            UE_LOG(
+                LogTemp, Error, TEXT("nadjieb::MJPEGStreamer: cannot open recording %s - Error Code: %d"),
+                *FString(path.c_str()), errno);
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(file_mtx_);
+        current_file_ = path;
+    }
+
+    std::string makeFileName(int64_t timestamp_us) {
+        std::time_t seconds = (std::time_t)(timestamp_us / 1000000);
+        std::tm utc = {};
+#ifdef NADJIEB_MJPEG_STREAMER_PLATFORM_WINDOWS
+        gmtime_s(&utc, &seconds);
+#else
+        gmtime_r(&seconds, &utc);
+#endif
+        char stamp[32];
+        std::strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", &utc);
+
+        auto name = options_.prefix + "_" + stamp + "_" + std::to_string(part_++) + recording::FILE_EXTENSION;
+        return (std::filesystem::path(options_.directory) / name).string();
+    }
+};
+}  // namespace io
+}  // namespace nadjieb
+
+// #include <nadjieb/io/recording_reader.hpp>
+
+
+namespace nadjieb {
+namespace io {
+// Read-only memory mapping of a recording. Frames are never copied out of the mapping;
+// only the index (16 bytes per frame) lives on the heap.
+class RecordingReader : public nadjieb::utils::NonCopyable {
+   public:
+    struct FrameRef {
+        // File offset of the JPEG bytes
+        uint64_t offset;
+        uint32_t size;
+        uint64_t sequence;
+        int64_t timestamp_us;
+        const char* data;
+    };
+
+    virtual ~RecordingReader() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+
+#ifdef NADJIEB_MJPEG_STREAMER_PLATFORM_WINDOWS
+        file_ = ::CreateFileA(
+            path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        LARGE_INTEGER file_size;
+        if (!::GetFileSizeEx(file_, &file_size) || file_size.QuadPart == 0) {
+            close();
+            return false;
+        }
+        size_ = (uint64_t)file_size.QuadPart;
+
+        mapping_ = ::CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_ == nullptr) {
+            close();
+            return false;
+        }
+
+        data_ = static_cast<const char*>(::MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        if (data_ == nullptr) {
+            close();
+            return false;
+        }
+#else
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0) {
+            return false;
+        }
+
+        struct stat st;
+        if (::fstat(fd_, &st) != 0 || st.st_size == 0) {
+            close();
+            return false;
+        }
+        size_ = (uint64_t)st.st_size;
+
+        void* mapped = ::mmap(nullptr, (size_t)size_, PROT_READ, MAP_SHARED, fd_, 0);
+        if (mapped == MAP_FAILED) {
+            close();
+            return false;
+        }
+        data_ = static_cast<const char*>(mapped);
+        ::madvise(mapped, (size_t)size_, MADV_SEQUENTIAL);
+#endif
+
+        if (size_ < sizeof(recording::FileHeader)
+            || std::memcmp(data_, recording::FILE_MAGIC, sizeof(recording::FILE_MAGIC)) != 0) {
+            close();
+            return false;
+        }
+
+        header_size_ = reinterpret_cast<const recording::FileHeader*>(data_)->header_size;
+        if (!loadIndex()) {
+            scanFrames();
+        }
+
+        return !index_.empty();
+    }
+
+    void close() {
+#ifdef NADJIEB_MJPEG_STREAMER_PLATFORM_WINDOWS
+        if (data_ != nullptr) {
+            ::UnmapViewOfFile(data_);
+        }
+        if (mapping_ != nullptr) {
+            ::CloseHandle(mapping_);
+            mapping_ = nullptr;
+        }
+        if (file_ != INVALID_HANDLE_VALUE) {
+            ::CloseHandle(file_);
+            file_ = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (data_ != nullptr) {
+            ::munmap(const_cast<char*>(data_), (size_t)size_);
+        }
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+#endif
+        data_ = nullptr;
+        size_ = 0;
+        index_.clear();
+    }
+
+    size_t getFrameCount() const { return index_.size(); }
+
+    FrameRef getFrame(size_t i) const {
+        auto header = reinterpret_cast<const recording::FrameHeader*>(data_ + index_[i].offset);
+        uint64_t offset = index_[i].offset + sizeof(recording::FrameHeader);
+        return FrameRef{offset, header->size, header->sequence, header->timestamp_us, data_ + offset};
+    }
+
+    int64_t getStartMicros() const { return index_.empty() ? 0 : index_.front().timestamp_us; }
+
+    int64_t getDurationMicros() const {
+        return index_.empty() ? 0 : index_.back().timestamp_us - index_.front().timestamp_us;
+    }
+
+    // First frame at or after offset_us from the start of the recording
+    size_t findFrame(int64_t offset_us) const {
+        int64_t target = getStartMicros() + offset_us;
+        auto it = std::lower_bound(
+            index_.begin(), index_.end(), target,
+            [](const recording::IndexEntry& entry, int64_t t) { return entry.timestamp_us < t; });
+        if (it == index_.end()) {
+            return index_.empty() ? 0 : index_.size() - 1;
+        }
+        return (size_t)(it - index_.begin());
+    }
+
+#ifndef NADJIEB_MJPEG_STREAMER_PLATFORM_WINDOWS
+    // For sendfile(); the mapping stays valid as long as the reader is open
+    int getFileDescriptor() const { return fd_; }
+#endif
+
+   private:
+#ifdef NADJIEB_MJPEG_STREAMER_PLATFORM_WINDOWS
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+    const char* data_ = nullptr;
+    uint64_t size_ = 0;
+    uint32_t header_size_ = 0;
+    std::vector<recording::IndexEntry> index_;
+
+    bool isValidFrameAt(uint64_t offset) const {
+        if (offset + sizeof(recording::FrameHeader) > size_) {
+            return false;
+        }
+        auto header = reinterpret_cast<const recording::FrameHeader*>(data_ + offset);
+        return header->magic == recording::FRAME_MAGIC
+               && offset + sizeof(recording::FrameHeader) + header->size <= size_;
+    }
+
+    bool loadIndex() {
+        if (size_ < header_size_ + sizeof(recording::IndexTrailer)) {
+            return false;
+        }
+
+        auto trailer
+            = reinterpret_cast<const recording::IndexTrailer*>(data_ + size_ - sizeof(recording::IndexTrailer));
+        if (std::memcmp(trailer->magic, recording::INDEX_MAGIC, sizeof(trailer->magic)) != 0
+            || trailer->index_offset + trailer->count * sizeof(recording::IndexEntry)
+                   != size_ - sizeof(recording::IndexTrailer)) {
+            return false;
+        }
+
+        auto entries = reinterpret_cast<const recording::IndexEntry*>(data_ + trailer->index_offset);
+        index_.assign(entries, entries + trailer->count);
+
+        for (const auto& entry : index_) {
+            if (!isValidFrameAt(entry.offset)) {
+                index_.clear();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Recovers the index of a file that was never finalized
+    void scanFrames() {
+        index_.clear();
+        uint64_t offset = header_size_;
+        while (isValidFrameAt(offset)) {
+            auto header = reinterpret_cast<const recording::FrameHeader*>(data_ + offset);
+            index_.push_back(recording::IndexEntry{header->timestamp_us, offset});
+            offset += sizeof(recording::FrameHeader) + header->size;
+        }
+    }
+};
+}  // namespace io
+}  // namespace nadjieb
+
+// #include <nadjieb/io/replay_server.hpp>
+
+
+namespace nadjieb {
+namespace io {
+// Streams one recording to one client at its original pace (scaled by speed),
+// straight from the mapping: sendfile() on Linux, send() from the mapped pages elsewhere.
+class ReplaySession : public nadjieb::utils::NonCopyable {
+   public:
+    ReplaySession(
+        nadjieb::net::SocketFD sockfd,
+        std::unique_ptr<RecordingReader> reader,
+        size_t first_frame,
+        double speed)
+        : sockfd_(sockfd), reader_(std::move(reader)), first_frame_(first_frame), speed_(speed) {
+        thread_ = std::thread(&ReplaySession::run, this);
+    }
+
+    virtual ~ReplaySession() { stop(); }
+
+    // Also shuts the socket down, so a send blocked on a stalled client returns at once and the join
+    // does not hold up the caller's loop
+    void stop() {
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            end_session_ = true;
+        }
+        condition_.notify_all();
+
+#ifdef NADJIEB_MJPEG_STREAMER_PLATFORM_WINDOWS
+        ::shutdown(sockfd_, SD_BOTH);
+#else
+        ::shutdown(sockfd_, SHUT_RDWR);
+#endif
+
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+   private:
+    static constexpr long SEND_TIMEOUT_MS = 1000;
+
+    nadjieb::net::SocketFD sockfd_;
+    std::unique_ptr<RecordingReader> reader_;
+    size_t first_frame_;
+    double speed_;
+    std::thread thread_;
+    std::mutex mtx_;
+    std::condition_variable condition_;
+    std::atomic<bool> end_session_{false};
+
+    void run() {
+        auto start_time = std::chrono::steady_clock::now();
+        int64_t start_us = reader_->getFrame(first_frame_).timestamp_us;
+
+        for (size_t i = first_frame_; i < reader_->getFrameCount(); ++i) {
+            auto frame = reader_->getFrame(i);
+
+            // speed <= 0 sends as fast as the client reads
+            if (speed_ > 0) {
+                auto due = start_time
+                           + std::chrono::microseconds((int64_t)((double)(frame.timestamp_us - start_us) / speed_));
+                std::unique_lock<std::mutex> lock(mtx_);
+                if (condition_.wait_until(lock, due, [&]() { return end_session_.load(); })) {
+                    return;
+                }
+            } else if (end_session_) {
+                return;
+            }
+
+            if (!sendFrame(frame)) {
+                return;
+            }
+        }
+
+        // Tell the client we are done, the listener closes the socket when it hangs up
+#ifdef NADJIEB_MJPEG_STREAMER_PLATFORM_WINDOWS
+        ::shutdown(sockfd_, SD_SEND);
+#else
+        ::shutdown(sockfd_, SHUT_WR);
+#endif
+    }
+
+    bool sendFrame(const RecordingReader::FrameRef& frame) {
+        std::string header
+            = "--nadjiebmjpegstreamer\r\n"
+              "Content-Type: image/jpeg\r\n"
+              "Content-Length: "
+              + std::to_string(frame.size) + "\r\nX-Timestamp: " + std::to_string(frame.timestamp_us)
+              + "\r\n\r\n";
+
+#ifdef NADJIEB_MJPEG_STREAMER_PLATFORM_LINUX
+        nadjieb::net::ConstBuffer header_part[] = {{header.data(), header.size()}};
+        if (!nadjieb::net::sendAllViaSocket(sockfd_, header_part, 1, SEND_TIMEOUT_MS)) {
+            return false;
+        }
+        return sendFileRange(frame.offset, frame.size);
+#else
+        nadjieb::net::ConstBuffer parts[] = {{header.data(), header.size()}, {frame.data, frame.size}};
+        return nadjieb::net::sendAllViaSocket(sockfd_, parts, 2, SEND_TIMEOUT_MS);
+#endif
+    }
+
+#ifdef NADJIEB_MJPEG_STREAMER_PLATFORM_LINUX
+    bool sendFileRange(uint64_t offset, size_t size) {
+        off_t file_offset = (off_t)offset;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SEND_TIMEOUT_MS);
+
+        while (size > 0) {
+            ssize_t sent = ::sendfile(sockfd_, reader_->getFileDescriptor(), &file_offset, size);
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno != EAGAIN) {
+                    return false;
+                }
+
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now());
+                NADJIEB_MJPEG_STREAMER_POLLFD pfd{sockfd_, POLLWRNORM, 0};
+                if (remaining.count() <= 0 || nadjieb::net::pollSockets(&pfd, 1, (long)remaining.count()) <= 0) {
+                    return false;
+                }
+                continue;
+            }
+            if (sent == 0) {
+                return false;
+            }
+            size -= (size_t)sent;
+        }
+        return true;
+    }
+#endif
+};
+
+// Serves <directory>/<name>.mjpr as /replay/<name>.mjpg. Query parameters:
+//   t=<seconds>   start at the first frame at or after this offset into the recording
+//   speed=<x>     playback rate, 1 = original timing, 0 = as fast as possible
+// GET /replay/ lists the available recordings. Each replay holds a thread and a mapping,
+// so at most LIMIT_SESSIONS run at once and further requests get 503.
+class ReplayServer : public nadjieb::utils::NonCopyable {
+   public:
+    static constexpr const char* ROUTE_PREFIX = "/replay/";
+    const static size_t LIMIT_SESSIONS = 16;
+
+    virtual ~ReplayServer() { stopAll(); }
+
+    void setDirectory(const std::string& directory) { directory_ = directory; }
+
+    nadjieb::net::RouteHandler makeRouteHandler() {
+        nadjieb::net::RouteHandler handler;
+        handler.on_request = [this](const nadjieb::net::SocketFD& sockfd, nadjieb::net::HTTPRequest& req) {
+            return handleRequest(sockfd, req);
+        };
+        handler.on_close = [this](const nadjieb::net::SocketFD& sockfd) { stopSession(sockfd); };
+        return handler;
+    }
+
+    void stopAll() {
+        std::unordered_map<nadjieb::net::SocketFD, std::unique_ptr<ReplaySession>> sessions;
+        {
+            std::unique_lock<std::mutex> lock(sessions_mtx_);
+            sessions.swap(sessions_);
+        }
+        sessions.clear();
+    }
+
+   private:
+    std::string directory_;
+    std::unordered_map<nadjieb::net::SocketFD, std::unique_ptr<ReplaySession>> sessions_;
+    std::mutex sessions_mtx_;
+
+    // Sends a complete response and tells the listener whether to keep the connection open
+    static nadjieb::net::OnMessageCallbackResponse sendResponse(
+        const nadjieb::net::SocketFD& sockfd,
+        nadjieb::net::HTTPRequest& req,
+        int status_code,
+        const char* status_text,
+        const std::string& content_type = "",
+        const std::string& body = "") {
+        nadjieb::net::OnMessageCallbackResponse cb_res;
+        cb_res.close_conn = !req.isKeepAlive();
+
+        auto& res = nadjieb::net::ResponseBuilder::forThread().start(req.getVersion(), status_code, status_text);
+        res.connection(!cb_res.close_conn);
+        if (!content_type.empty()) {
+            res.header("Content-Type", content_type);
+        }
+        nadjieb::net::sendAllViaSocket(sockfd, res.finish(body), 1000);
+        return cb_res;
+    }
+
+    nadjieb::net::OnMessageCallbackResponse handleRequest(
+        const nadjieb::net::SocketFD& sockfd,
+        nadjieb::net::HTTPRequest& req) {
+        nadjieb::net::OnMessageCallbackResponse cb_res;
+        std::string name = req.getPath().substr(std::string(ROUTE_PREFIX).size());
+
+        if (name.empty()) {
+            return sendResponse(sockfd, req, 200, "OK", "text/plain", listRecordings());
+        }
+
+        const std::string extension = ".mjpg";
+        bool valid_name = name.size() > extension.size()
+                          && name.compare(name.size() - extension.size(), extension.size(), extension) == 0
+                          && name.find('/') == std::string::npos && name.find('\\') == std::string::npos
+                          && name.find("..") == std::string::npos;
+        if (!valid_name) {
+            return sendResponse(sockfd, req, 404, "Not Found");
+        }
+
+        name.resize(name.size() - extension.size());
+        auto path = (std::filesystem::path(directory_) / (name + recording::FILE_EXTENSION)).string();
+
+        // Holds a slot until the session takes it, so concurrent requests cannot overshoot the limit
+        {
+            std::unique_lock<std::mutex> lock(sessions_mtx_);
+            if (sessions_.size() >= LIMIT_SESSIONS) {
+                lock.unlock();
+                return sendResponse(sockfd, req, 503, "Service Unavailable");
+            }
+            sessions_[sockfd] = nullptr;
+        }
+
+        auto reader = std::make_unique<RecordingReader>();
+        if (directory_.empty() || !reader->open(path)) {
+            releaseSlot(sockfd);
+            return sendResponse(sockfd, req, 404, "Not Found");
+        }
+
+        double start_seconds = std::atof(req.getQueryValue("t").c_str());
+        auto speed_value = req.getQueryValue("speed");
+        double speed = speed_value.empty() ? 1.0 : std::atof(speed_value.c_str());
+        size_t first_frame = reader->findFrame((int64_t)(std::max(start_seconds, 0.0) * 1000000.0));
+
+        nadjieb::net::HTTPResponse init_res;
+        init_res.setVersion(req.getVersion());
+        init_res.setStatusCode(200);
+        init_res.setStatusText("OK");
+        init_res.setValue("Connection", "close");
+        init_res.setValue("Cache-Control", "no-cache, no-store, must-revalidate, pre-check=0, post-check=0, max-age=0");
+        init_res.setValue("Pragma", "no-cache");
+        init_res.setValue("Content-Type", "multipart/x-mixed-replace; boundary=nadjiebmjpegstreamer");
+        init_res.setValue("X-Duration", std::to_string((double)reader->getDurationMicros() / 1000000.0));
+        auto init_res_str = init_res.serialize();
+        nadjieb::net::sendViaSocket(sockfd, init_res_str.c_str(), init_res_str.size(), 0);
+
+        auto session = std::make_unique<ReplaySession>(sockfd, std::move(reader), first_frame, speed);
+        std::unique_lock<std::mutex> lock(sessions_mtx_);
+        sessions_[sockfd] = std::move(session);
+
+        // The session owns the connection until the client hangs up
+        cb_res.mode = nadjieb::net::ConnectionMode::DISCARD;
+        return cb_res;
+    }
+
+    // Called before the listener closes sockfd, so the session never writes to a reused descriptor
+    void stopSession(const nadjieb::net::SocketFD& sockfd) {
+        std::unique_ptr<ReplaySession> session;
+        {
+            std::unique_lock<std::mutex> lock(sessions_mtx_);
+            auto it = sessions_.find(sockfd);
+            if (it == sessions_.end()) {
+                return;
+            }
+            session = std::move(it->second);
+            sessions_.erase(it);
+        }
+        if (session) {
+            session->stop();
+        }
+    }
+
+    void releaseSlot(const nadjieb::net::SocketFD& sockfd) {
+        std::unique_lock<std::mutex> lock(sessions_mtx_);
+        sessions_.erase(sockfd);
+    }
+
+    std::string listRecordings() const {
+        std::vector<std::string> names;
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(directory_, ec)) {
+            if (entry.path().extension() == recording::FILE_EXTENSION) {
+                names.push_back(entry.path().stem().string() + ".mjpg");
+            }
+        }
+        std::sort(names.begin(), names.end());
+
+        std::string body;
+        for (const auto& name : names) {
+            body += name + "\n";
+        }
+        return body;
+    }
+};
+}  // namespace io
+}  // namespace nadjieb
@@ -0,0 +1,496 @@
+/*
+RTP/JPEG output (RFC 2435) for the nadjieb::MJPEGStreamer in mjpeg_streamer.hpp.
+
+The already encoded frames of a topic are split into RTP packets without
+re-encoding: the JPEG headers are parsed once per frame, the quantization
+tables are sent in-band (Q = 255) and the entropy-coded scan data is sent
+straight out of the shared frame buffer. One UDP stream (unicast or multicast)
+serves any number of receivers.
+
+Receivers rebuild the JPEG headers with the standard Huffman tables, so the
+encoder must not use optimized Huffman tables (libjpeg/jpge defaults are fine).
+Only baseline YUV 4:2:2 and 4:2:0 JPEGs up to 2040x2040 can be carried.
+*/
+
+#pragma once
+
+#include "mjpeg_streamer.hpp"
+
+#ifdef NADJIEB_MJPEG_STREAMER_PLATFORM_WINDOWS
+#include <ws2tcpip.h>
+#else
+#include <netinet/in.h>
+#endif
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// #include <nadjieb/rtp/jpeg_parser.hpp>
+
+
+namespace nadjieb {
+namespace rtp {
+// What RFC 2435 needs to know about an encoded JPEG
+struct JpegScanInfo {
+    // 0 = 4:2:2, 1 = 4:2:0; +64 when restart markers are present
+    uint8_t type = 0;
+    uint16_t width = 0;
+    uint16_t height = 0;
+    uint16_t restart_interval = 0;
+    // Luma and chroma tables, 64 bytes each in zigzag order
+    const uint8_t* qtables[2] = {nullptr, nullptr};
+    // Entropy-coded data between SOS and EOI
+    const uint8_t* scan = nullptr;
+    size_t scan_size = 0;
+};
+
+static bool parseJpeg(const std::string& jpeg, JpegScanInfo& info) {
+    auto data = reinterpret_cast<const uint8_t*>(jpeg.data());
+    size_t size = jpeg.size();
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8) {
+        return false;
+    }
+
+    const uint8_t* tables[4] = {nullptr, nullptr, nullptr, nullptr};
+    uint8_t component_tables[3] = {0, 0, 0};
+    bool have_frame = false;
+    size_t pos = 2;
+
+    while (pos + 4 <= size) {
+        if (data[pos] != 0xFF) {
+            return false;
+        }
+
+        uint8_t marker = data[pos + 1];
+        if (marker == 0xFF) {
+            ++pos;
+            continue;
+        }
+
+        size_t length = ((size_t)data[pos + 2] << 8) | data[pos + 3];
+        size_t segment = pos + 4;
+        if (length < 2 || pos + 2 + length > size) {
+            return false;
+        }
+
+        switch (marker) {
+            case 0xDB: {  // DQT, possibly several tables
+                size_t p = segment;
+                while (p < pos + 2 + length) {
+                    uint8_t precision = data[p] >> 4;
+                    uint8_t id = data[p] & 0x0F;
+                    if (precision != 0 || id > 3) {
+                        return false;
+                    }
+                    tables[id] = data + p + 1;
+                    p += 65;
+                }
+                break;
+            }
+            case 0xC0: {  // SOF0, baseline
+                if (data[segment] != 8 || data[segment + 5] != 3) {
+                    return false;
+                }
+                uint16_t height = ((uint16_t)data[segment + 1] << 8) | data[segment + 2];
+                uint16_t width = ((uint16_t)data[segment + 3] << 8) | data[segment + 4];
+                if (width == 0 || height == 0 || width > 2040 || height > 2040) {
+                    return false;
+                }
+                info.width = width;
+                info.height = height;
+
+                const uint8_t* comps = data + segment + 6;
+                if (comps[1] == 0x21) {
+                    info.type = 0;
+                } else if (comps[1] == 0x22) {
+                    info.type = 1;
+                } else {
+                    return false;
+                }
+                if (comps[4] != 0x11 || comps[7] != 0x11) {
+                    return false;
+                }
+                component_tables[0] = comps[2];
+                component_tables[1] = comps[5];
+                component_tables[2] = comps[8];
+                have_frame = true;
+                break;
+            }
+            case 0xC1: case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+            case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+                // Progressive, lossless or arithmetic coded
+                return false;
+            case 0xDD:  // DRI
+                info.restart_interval = ((uint16_t)data[segment] << 8) | data[segment + 1];
+                break;
+            case 0xDA: {  // SOS, scan data follows the header up to EOI
+                if (!have_frame || component_tables[1] != component_tables[2] || component_tables[1] > 3
+                    || component_tables[0] > 3 || tables[component_tables[0]] == nullptr
+                    || tables[component_tables[1]] == nullptr) {
+                    return false;
+                }
+                info.qtables[0] = tables[component_tables[0]];
+                info.qtables[1] = tables[component_tables[1]];
+
+                info.scan = data + pos + 2 + length;
+                size_t end = size;
+                if (end >= 2 && data[end - 2] == 0xFF && data[end - 1] == 0xD9) {
+                    end -= 2;
+                }
+                if (info.scan > data + end) {
+                    return false;
+                }
+                info.scan_size = (size_t)((data + end) - info.scan);
+                if (info.restart_interval != 0) {
+                    info.type += 64;
+                }
+                return true;
+            }
+            default:
+                break;
+        }
+
+        pos += 2 + length;
+    }
+
+    return false;
+}
+}  // namespace rtp
+}  // namespace nadjieb
+
+// #include <nadjieb/rtp/jpeg_sender.hpp>
+
+
+namespace nadjieb {
+namespace rtp {
+struct SenderOptions {
+    std::string address = "239.255.0.1";
+    int port = 5004;
+    // Multicast hop limit; 1 keeps the stream on the local network
+    int ttl = 1;
+    // Deliver multicast to receivers on this host too (needed for loopback testing)
+    bool multicast_loop = true;
+    // Local IPv4 address of the interface multicast leaves through. Empty = routing table default
+    std::string interface_address;
+    // Largest UDP payload, keep below the path MTU to avoid IP fragmentation
+    size_t max_packet_size = 1400;
+    int payload_type = 26;
+};
+
+// Sends every frame of a topic as RTP/JPEG on its own thread. push() is the topic subscriber
+// callback; if the network falls behind only the newest frames are kept.
+class JpegSender : public nadjieb::utils::NonCopyable, public nadjieb::utils::Runnable {
+   public:
+    virtual ~JpegSender() { stop(); }
+
+    bool start(const SenderOptions& options) {
+        stop();
+
+        state_ = nadjieb::utils::State::BOOTING;
+        options_ = options;
+
+        nadjieb::net::initSocket();
+        sockfd_ = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (sockfd_ == NADJIEB_MJPEG_STREAMER_INVALID_SOCKET) {
+            UE_LOG(LogTemp, Error, TEXT("nadjieb::MJPEGStreamer: RTP socket() failed"));
+            state_ = nadjieb::utils::State::TERMINATED;
+            return false;
+        }
+
+        std::memset(&destination_, 0, sizeof(destination_));
+        destination_.sin_family = AF_INET;
+        destination_.sin_port = htons((uint16_t)options_.port);
+        if (inet_pton(AF_INET, options_.address.c_str(), &destination_.sin_addr) != 1) {
+            UE_LOG(
+                LogTemp, Error, TEXT("nadjieb::MJPEGStreamer: invalid RTP address %s"),
+                *FString(options_.address.c_str()));
+            closeSocket();
+            state_ = nadjieb::utils::State::TERMINATED;
+            return false;
+        }
+
+        if (isMulticast()) {
+            int ttl = options_.ttl;
+            ::setsockopt(sockfd_, IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&ttl, sizeof(ttl));
+            int loop = options_.multicast_loop ? 1 : 0;
+            ::setsockopt(sockfd_, IPPROTO_IP, IP_MULTICAST_LOOP, (const char*)&loop, sizeof(loop));
+
+            struct in_addr interface_addr;
+            if (!options_.interface_address.empty()
+                && inet_pton(AF_INET, options_.interface_address.c_str(), &interface_addr) == 1) {
+                ::setsockopt(
+                    sockfd_, IPPROTO_IP, IP_MULTICAST_IF, (const char*)&interface_addr, sizeof(interface_addr));
+            }
+        }
+
+        std::random_device random;
+        ssrc_ = ((uint32_t)random() << 16) ^ (uint32_t)random();
+        sequence_ = (uint16_t)random();
+
+        end_sender_ = false;
+        thread_ = std::thread(&JpegSender::run, this);
+        state_ = nadjieb::utils::State::RUNNING;
+        return true;
+    }
+
+    void stop() {
+        {
+            std::unique_lock<std::mutex> lock(queue_mtx_);
+            if (end_sender_) {
+                return;
+            }
+            state_ = nadjieb::utils::State::TERMINATING;
+            end_sender_ = true;
+        }
+        condition_.notify_all();
+
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+
+        queue_.clear();
+        closeSocket();
+        state_ = nadjieb::utils::State::TERMINATED;
+    }
+
+    void push(const nadjieb::net::FrameBuffer& frame) {
+        {
+            std::unique_lock<std::mutex> lock(queue_mtx_);
+            if (end_sender_) {
+                return;
+            }
+
+            if (queue_.size() >= MAX_QUEUED_FRAMES) {
+                queue_.pop_front();
+                ++dropped_frames_;
+            }
+            queue_.push_back(frame);
+        }
+        condition_.notify_one();
+    }
+
+    // Session description for receivers, e.g. ffplay -protocol_whitelist file,udp,rtp stream.sdp
+    std::string getSdp() const {
+        return "v=0\r\n"
+               "o=- " + std::to_string(ssrc_) + " 1 IN IP4 0.0.0.0\r\n"
+               "s=nadjieb MJPEG\r\n"
+               "c=IN IP4 " + options_.address + (isMulticast() ? "/" + std::to_string(options_.ttl) : "") + "\r\n"
+               "t=0 0\r\n"
+               "m=video " + std::to_string(options_.port) + " RTP/AVP " + std::to_string(options_.payload_type) + "\r\n"
+               "a=rtpmap:" + std::to_string(options_.payload_type) + " JPEG/90000\r\n";
+    }
+
+    uint64_t getSentFrames() const { return sent_frames_; }
+
+    uint64_t getDroppedFrames() const { return dropped_frames_; }
+
+   private:
+    static const size_t MAX_QUEUED_FRAMES = 2;
+    static const size_t RTP_HEADER_SIZE = 12;
+    static const size_t JPEG_HEADER_SIZE = 8;
+    static const size_t RESTART_HEADER_SIZE = 4;
+    static const size_t QTABLE_HEADER_SIZE = 4;
+    // Largest packet header: RTP + JPEG + restart + quantization table header and two tables
+    static const size_t MAX_HEADER_SIZE
+        = RTP_HEADER_SIZE + JPEG_HEADER_SIZE + RESTART_HEADER_SIZE + QTABLE_HEADER_SIZE + 128;
+
+    struct Packet {
+        uint8_t header[MAX_HEADER_SIZE];
+        size_t header_size;
+        const uint8_t* payload;
+        size_t payload_size;
+    };
+
+    SenderOptions options_;
+    nadjieb::net::SocketFD sockfd_ = NADJIEB_MJPEG_STREAMER_INVALID_SOCKET;
+    struct sockaddr_in destination_;
+    uint32_t ssrc_ = 0;
+    uint16_t sequence_ = 0;
+    std::vector<Packet> packets_;
+    std::thread thread_;
+    std::deque<nadjieb::net::FrameBuffer> queue_;
+    std::mutex queue_mtx_;
+    std::condition_variable condition_;
+    bool end_sender_ = true;
+    std::atomic<uint64_t> sent_frames_{0};
+    std::atomic<uint64_t> dropped_frames_{0};
+    bool warned_unsupported_ = false;
+
+    bool isMulticast() const { return (ntohl(destination_.sin_addr.s_addr) & 0xF0000000) == 0xE0000000; }
+
+    void closeSocket() {
+        if (sockfd_ != NADJIEB_MJPEG_STREAMER_INVALID_SOCKET) {
+            nadjieb::net::closeSocket(sockfd_);
+            sockfd_ = NADJIEB_MJPEG_STREAMER_INVALID_SOCKET;
+        }
+    }
+
+    void run() {
+        while (true) {
+            nadjieb::net::FrameBuffer frame;
+            {
+                std::unique_lock<std::mutex> lock(queue_mtx_);
+                condition_.wait(lock, [&]() { return (end_sender_ || !queue_.empty()); });
+                if (end_sender_) {
+                    break;
+                }
+
+                frame = std::move(queue_.front());
+                queue_.pop_front();
+            }
+
+            if (sendFrame(*frame)) {
+                ++sent_frames_;
+            } else {
+                ++dropped_frames_;
+            }
+        }
+    }
+
+    static void put16(uint8_t* p, uint32_t v) {
+        p[0] = (uint8_t)(v >> 8);
+        p[1] = (uint8_t)v;
+    }
+
+    static void put32(uint8_t* p, uint32_t v) {
+        p[0] = (uint8_t)(v >> 24);
+        p[1] = (uint8_t)(v >> 16);
+        p[2] = (uint8_t)(v >> 8);
+        p[3] = (uint8_t)v;
+    }
+
+    bool sendFrame(const nadjieb::net::Frame& frame) {
+        JpegScanInfo info;
+        if (!parseJpeg(frame.data, info)) {
+            if (!warned_unsupported_) {
+                warned_unsupported_ = true;
+                UE_LOG(LogTemp, Warning, TEXT("nadjieb::MJPEGStreamer: frame is not a baseline 4:2:x JPEG, RTP skips it"));
+            }
+            return false;
+        }
+
+        // 90 kHz media clock from the capture time
+        uint32_t rtp_timestamp = (uint32_t)((uint64_t)frame.timestamp_us * 9 / 100);
+        bool has_restart = info.restart_interval != 0;
+
+        packets_.clear();
+        size_t offset = 0;
+        while (offset < info.scan_size || offset == 0) {
+            packets_.emplace_back();
+            Packet& packet = packets_.back();
+            uint8_t* h = packet.header;
+
+            // RTP header (RFC 3550)
+            h[0] = 0x80;
+            h[1] = (uint8_t)(options_.payload_type & 0x7F);
+            put16(h + 2, sequence_++);
+            put32(h + 4, rtp_timestamp);
+            put32(h + 8, ssrc_);
+            size_t size = RTP_HEADER_SIZE;
+
+            // JPEG header: type-specific, fragment offset, type, Q, width/8, height/8
+            h[size] = 0;
+            h[size + 1] = (uint8_t)(offset >> 16);
+            h[size + 2] = (uint8_t)(offset >> 8);
+            h[size + 3] = (uint8_t)offset;
+            h[size + 4] = info.type;
+            h[size + 5] = 255;
+            h[size + 6] = (uint8_t)((info.width + 7) / 8);
+            h[size + 7] = (uint8_t)((info.height + 7) / 8);
+            size += JPEG_HEADER_SIZE;
+
+            if (has_restart) {
+                put16(h + size, info.restart_interval);
+                put16(h + size + 2, 0xFFFF);  // F = L = 1, restart count 0x3FFF
+                size += RESTART_HEADER_SIZE;
+            }
+
+            // Quantization tables travel in the first packet of every frame
+            if (offset == 0) {
+                h[size] = 0;
+                h[size + 1] = 0;
+                put16(h + size + 2, 128);
+                std::memcpy(h + size + QTABLE_HEADER_SIZE, info.qtables[0], 64);
+                std::memcpy(h + size + QTABLE_HEADER_SIZE + 64, info.qtables[1], 64);
+                size += QTABLE_HEADER_SIZE + 128;
+            }
+
+            packet.header_size = size;
+            packet.payload = info.scan + offset;
+            packet.payload_size = options_.max_packet_size > size ? options_.max_packet_size - size : 1;
+            if (packet.payload_size > info.scan_size - offset) {
+                packet.payload_size = info.scan_size - offset;
+            }
+            offset += packet.payload_size;
+
+            if (info.scan_size == 0) {
+                break;
+            }
+        }
+
+        // Marker bit on the last packet of the frame
+        packets_.back().header[1] |= 0x80;
+
+        return sendPackets();
+    }
+
+#if defined NADJIEB_MJPEG_STREAMER_PLATFORM_LINUX && defined MSG_WAITFORONE
+    // All packets of a frame in as few sendmmsg() calls as possible
+    bool sendPackets() {
+        const size_t BATCH_SIZE = 64;
+        struct mmsghdr messages[BATCH_SIZE];
+        struct iovec vecs[BATCH_SIZE][2];
+
+        size_t next = 0;
+        while (next < packets_.size()) {
+            size_t count = std::min(BATCH_SIZE, packets_.size() - next);
+            for (size_t i = 0; i < count; ++i) {
+                Packet& packet = packets_[next + i];
+                vecs[i][0].iov_base = packet.header;
+                vecs[i][0].iov_len = packet.header_size;
+                vecs[i][1].iov_base = const_cast<uint8_t*>(packet.payload);
+                vecs[i][1].iov_len = packet.payload_size;
+
+                std::memset(&messages[i], 0, sizeof(messages[i]));
+                messages[i].msg_hdr.msg_name = &destination_;
+                messages[i].msg_hdr.msg_namelen = sizeof(destination_);
+                messages[i].msg_hdr.msg_iov = vecs[i];
+                messages[i].msg_hdr.msg_iovlen = 2;
+            }
+
+            int sent = ::sendmmsg(sockfd_, messages, (unsigned int)count, 0);
+            if (sent < 0) {
+                if (errno == EINTR || errno == EAGAIN || errno == ENOBUFS) {
+                    continue;
+                }
+                return false;
+            }
+            next += (size_t)sent;
+        }
+        return true;
+    }
+#else
+    bool sendPackets() {
+        for (auto& packet : packets_) {
+            std::string datagram(reinterpret_cast<const char*>(packet.header), packet.header_size);
+            datagram.append(reinterpret_cast<const char*>(packet.payload), packet.payload_size);
+            auto res = ::sendto(
+                sockfd_, datagram.data(), (int)datagram.size(), 0, (const struct sockaddr*)&destination_,
+                sizeof(destination_));
+            if (res == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR) {
+                return false;
+            }
+        }
+        return true;
+    }
+#endif
+};
+}  // namespace rtp
+}  // namespace nadjieb
@@ -0,0 +1,517 @@
+/*
+Shared-memory frame ring for consumers on the same host.
+
+The writer (inside the streamer) copies every frame of a topic into one of a fixed number of
+slots of a named shared-memory object; readers map the same object and pick up the newest frame
+without any socket, so a frame costs one memcpy on each side and no kernel copies.
+
+This header is self-contained (standard library and OS headers only) so that consumer processes
+can include it as their reader library:
+
+    nadjieb::shm::RingReader reader;
+    reader.open("/ScreenStreamMJPEG");
+    nadjieb::shm::RingFrame frame;
+    while (reader.waitForFrame(1000)) {
+        if (reader.readLatest(frame)) { ... frame.data, frame.sequence, frame.timestamp_us ... }
+    }
+
+Every slot is guarded by a sequence lock, so a reader that is overtaken by the writer notices it
+and retries instead of returning a torn frame. On Linux readers block on a futex in the shared
+header and are woken by the writer; on Windows they poll every millisecond.
+*/
+
+#pragma once
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+
+// #include <nadjieb/shm/layout.hpp>
+
+
+namespace nadjieb {
+namespace shm {
+static const char RING_MAGIC[8] = {'N', 'M', 'J', 'S', 'H', 'M', '0', '1'};
+static constexpr uint32_t RING_VERSION = 1;
+static constexpr size_t CACHE_LINE_SIZE = 64;
+
+// Start of the shared object; the slots follow at data_offset
+struct RingHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t slot_count;
+    // Largest frame a slot can hold
+    uint64_t slot_capacity;
+    // Distance between two slots, slot header included
+    uint64_t slot_stride;
+    uint64_t data_offset;
+    // e.g. "image/jpeg"; tells readers what the frames are
+    char content_type[64];
+
+    // Number of frames written so far; frame n lives in slot n % slot_count
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> write_index;
+    // Bumped after every frame, readers wait on it
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> notify;
+    // Readers currently blocked in waitForFrame(), the writer skips the wake-up syscall when 0
+    std::atomic<uint32_t> waiters;
+    // Set when the writer goes away; readers should reopen by name
+    std::atomic<uint32_t> closed;
+};
+
+struct alignas(CACHE_LINE_SIZE) SlotHeader {
+    // 2n+1 while frame n is being written, 2n+2 once it is complete
+    std::atomic<uint64_t> state;
+    uint64_t size;
+    uint64_t sequence;
+    int64_t timestamp_us;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared-memory ring needs lock-free 64-bit atomics");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared-memory ring needs lock-free 32-bit atomics");
+
+static size_t alignUp(size_t value, size_t alignment) { return (value + alignment - 1) / alignment * alignment; }
+
+// True for a ring whose writer has gone away, the only kind another writer may take the name of
+static bool isClosedRing(const void* address, size_t size) {
+    if (address == nullptr || size < sizeof(RingHeader)) {
+        return false;
+    }
+    auto header = static_cast<const RingHeader*>(address);
+    return std::memcmp(header->magic, RING_MAGIC, sizeof(RING_MAGIC)) == 0
+           && header->closed.load(std::memory_order_acquire) != 0;
+}
+
+// Maps a named shared-memory object; the writer creates it, readers open it
+class Mapping {
+   public:
+    ~Mapping() { close(); }
+
+    // Fails while another writer's ring holds the name. A closed ring is replaced; the ring of a writer
+    // that crashed is never marked closed and has to be removed by hand
+    bool create(const std::string& name, size_t size) {
+        close();
+#if defined(_WIN32)
+        handle_ = ::CreateFileMappingA(
+            INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size,
+            windowsName(name).c_str());
+        if (handle_ == nullptr) {
+            return false;
+        }
+        // The object lives on while readers still map it, it can only be reused in place
+        bool exists = ::GetLastError() == ERROR_ALREADY_EXISTS;
+        address_ = ::MapViewOfFile(handle_, FILE_MAP_ALL_ACCESS, 0, 0, size);
+        if (exists && !isClosedRing(address_, size)) {
+            close();
+            return false;
+        }
+#else
+        int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0 && errno == EEXIST && isClosed(name)) {
+            // Readers still mapping the old object keep it until they reopen by name
+            ::shm_unlink(name.c_str());
+            fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        }
+        if (fd < 0) {
+            return false;
+        }
+        if (::ftruncate(fd, (off_t)size) != 0) {
+            ::close(fd);
+            ::shm_unlink(name.c_str());
+            return false;
+        }
+        void* address = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        address_ = (address == MAP_FAILED) ? nullptr : address;
+        owner_ = true;
+#endif
+        name_ = name;
+        size_ = size;
+        if (address_ == nullptr) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    bool open(const std::string& name) {
+        close();
+#if defined(_WIN32)
+        handle_ = ::OpenFileMappingA(FILE_MAP_READ, FALSE, windowsName(name).c_str());
+        if (handle_ == nullptr) {
+            return false;
+        }
+        address_ = ::MapViewOfFile(handle_, FILE_MAP_READ, 0, 0, 0);
+        MEMORY_BASIC_INFORMATION info;
+        if (address_ != nullptr && ::VirtualQuery(address_, &info, sizeof(info)) != 0) {
+            size_ = info.RegionSize;
+        }
+#else
+        int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+            ::close(fd);
+            return false;
+        }
+        size_ = (size_t)st.st_size;
+        // Writable only so readers can register as futex waiters
+        void* address = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        address_ = (address == MAP_FAILED) ? nullptr : address;
+#endif
+        name_ = name;
+        if (address_ == nullptr) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+#if defined(_WIN32)
+        if (address_ != nullptr) {
+            ::UnmapViewOfFile(address_);
+        }
+        if (handle_ != nullptr) {
+            ::CloseHandle(handle_);
+            handle_ = nullptr;
+        }
+#else
+        if (address_ != nullptr) {
+            ::munmap(address_, size_);
+        }
+        if (owner_) {
+            ::shm_unlink(name_.c_str());
+            owner_ = false;
+        }
+#endif
+        address_ = nullptr;
+        size_ = 0;
+    }
+
+    void* data() const { return address_; }
+
+    size_t size() const { return size_; }
+
+   private:
+    std::string name_;
+    void* address_ = nullptr;
+    size_t size_ = 0;
+#if defined(_WIN32)
+    HANDLE handle_ = nullptr;
+
+    static std::string windowsName(const std::string& name) {
+        return "Local\\" + ((!name.empty() && name[0] == '/') ? name.substr(1) : name);
+    }
+#else
+    bool owner_ = false;
+
+    static bool isClosed(const std::string& name) {
+        Mapping existing;
+        return existing.open(name) && isClosedRing(existing.data(), existing.size());
+    }
+#endif
+};
+
+#if defined(__linux__)
+// Process-shared (not FUTEX_PRIVATE) so waits work across processes mapping the same object
+static void futexWait(const std::atomic<uint32_t>* word, uint32_t expected, int timeout_ms) {
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+    ::syscall(SYS_futex, (const uint32_t*)word, FUTEX_WAIT, expected, &timeout, nullptr, 0);
+}
+
+static void futexWakeAll(const std::atomic<uint32_t>* word) {
+    ::syscall(SYS_futex, (const uint32_t*)word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+#endif
+}  // namespace shm
+}  // namespace nadjieb
+
+// #include <nadjieb/shm/ring_writer.hpp>
+
+
+namespace nadjieb {
+namespace shm {
+struct RingOptions {
+    // Shared-memory object name, POSIX style ("/name"); on Windows it becomes Local\name
+    std::string name = "/ScreenStreamMJPEG";
+    uint32_t slot_count = 4;
+    // Frames larger than this are skipped
+    size_t slot_capacity = 8 * 1024 * 1024;
+    std::string content_type = "image/jpeg";
+};
+
+// Not thread safe: write() must be called from one thread at a time (the topic's publishing thread)
+class RingWriter {
+   public:
+    ~RingWriter() { close(); }
+
+    bool create(const RingOptions& options) {
+        close();
+
+        if (options.slot_count == 0 || options.slot_capacity == 0) {
+            return false;
+        }
+
+        size_t data_offset = alignUp(sizeof(RingHeader), CACHE_LINE_SIZE);
+        size_t slot_stride = alignUp(sizeof(SlotHeader) + options.slot_capacity, CACHE_LINE_SIZE);
+        if (!mapping_.create(options.name, data_offset + slot_stride * options.slot_count)) {
+            return false;
+        }
+
+        header_ = new (mapping_.data()) RingHeader();
+        header_->version = RING_VERSION;
+        header_->slot_count = options.slot_count;
+        header_->slot_capacity = options.slot_capacity;
+        header_->slot_stride = slot_stride;
+        header_->data_offset = data_offset;
+        std::strncpy(header_->content_type, options.content_type.c_str(), sizeof(header_->content_type) - 1);
+        header_->write_index.store(0);
+        header_->notify.store(0);
+        header_->waiters.store(0);
+        header_->closed.store(0);
+
+        for (uint32_t i = 0; i < options.slot_count; ++i) {
+            new (slot(i)) SlotHeader();
+            slot(i)->state.store(0);
+        }
+
+        // Magic last: a reader never sees a half initialized header
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(header_->magic, RING_MAGIC, sizeof(RING_MAGIC));
+
+        next_index_ = 0;
+        return true;
+    }
+
+    void close() {
+        if (header_ == nullptr) {
+            return;
+        }
+
+        header_->closed.store(1, std::memory_order_release);
+        header_->notify.fetch_add(1);
+        wakeReaders();
+
+        header_ = nullptr;
+        mapping_.close();
+    }
+
+    bool isOpen() const { return header_ != nullptr; }
+
+    // Returns false if the frame does not fit in a slot
+    bool write(const char* data, size_t size, uint64_t sequence, int64_t timestamp_us) {
+        if (header_ == nullptr || size > header_->slot_capacity) {
+            return false;
+        }
+
+        uint64_t index = next_index_++;
+        SlotHeader* target = slot((uint32_t)(index % header_->slot_count));
+
+        target->state.store(index * 2 + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        target->size = size;
+        target->sequence = sequence;
+        target->timestamp_us = timestamp_us;
+        std::memcpy(reinterpret_cast<char*>(target) + sizeof(SlotHeader), data, size);
+
+        target->state.store(index * 2 + 2, std::memory_order_release);
+        header_->write_index.store(index + 1, std::memory_order_release);
+        // Sequentially consistent with the waiter count, so a reader going to sleep is always woken
+        header_->notify.fetch_add(1);
+        wakeReaders();
+        return true;
+    }
+
+   private:
+    Mapping mapping_;
+    RingHeader* header_ = nullptr;
+    uint64_t next_index_ = 0;
+
+    SlotHeader* slot(uint32_t i) {
+        return reinterpret_cast<SlotHeader*>(
+            static_cast<char*>(mapping_.data()) + header_->data_offset + header_->slot_stride * i);
+    }
+
+    void wakeReaders() {
+#if defined(__linux__)
+        if (header_->waiters.load() != 0) {
+            futexWakeAll(&header_->notify);
+        }
+#endif
+    }
+};
+}  // namespace shm
+}  // namespace nadjieb
+
+// #include <nadjieb/shm/ring_reader.hpp>
+
+
+namespace nadjieb {
+namespace shm {
+struct RingFrame {
+    std::string data;
+    uint64_t sequence = 0;
+    int64_t timestamp_us = 0;
+    // Position in the ring; consecutive reads that skip values missed frames
+    uint64_t index = 0;
+};
+
+class RingReader {
+   public:
+    // Fails until a writer has created the ring
+    bool open(const std::string& name) {
+        close();
+        if (!mapping_.open(name) || mapping_.size() < sizeof(RingHeader)) {
+            mapping_.close();
+            return false;
+        }
+
+        header_ = static_cast<RingHeader*>(mapping_.data());
+        if (std::memcmp(header_->magic, RING_MAGIC, sizeof(RING_MAGIC)) != 0 || header_->version != RING_VERSION
+            || header_->data_offset + header_->slot_stride * header_->slot_count > mapping_.size()) {
+            close();
+            return false;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        last_index_ = 0;
+        dropped_frames_ = 0;
+        return true;
+    }
+
+    void close() {
+        header_ = nullptr;
+        mapping_.close();
+    }
+
+    bool isOpen() const { return header_ != nullptr; }
+
+    // The writer has shut down; reopen to follow a new one
+    bool isWriterClosed() const { return header_ == nullptr || header_->closed.load(std::memory_order_acquire) != 0; }
+
+    std::string getContentType() const { return header_ ? std::string(header_->content_type) : std::string(); }
+
+    // True once a frame newer than the last one read is available, false on timeout or writer shutdown
+    bool waitForFrame(int timeout_ms) {
+        if (header_ == nullptr) {
+            return false;
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (true) {
+            uint32_t notify = header_->notify.load(std::memory_order_acquire);
+            if (header_->write_index.load(std::memory_order_acquire) > last_index_) {
+                return true;
+            }
+            if (isWriterClosed()) {
+                return false;
+            }
+
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                 deadline - std::chrono::steady_clock::now())
+                                 .count();
+            if (remaining <= 0) {
+                return false;
+            }
+
+#if defined(__linux__)
+            // The kernel re-checks notify, so a frame written since the load above is never slept through
+            header_->waiters.fetch_add(1);
+            futexWait(&header_->notify, notify, (int)remaining);
+            header_->waiters.fetch_sub(1);
+#else
+            (void)notify;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+        }
+    }
+
+    // Copies the newest complete frame into frame; false if there is none newer than the last one read
+    bool readLatest(RingFrame& frame) {
+        if (header_ == nullptr) {
+            return false;
+        }
+
+        while (true) {
+            uint64_t count = header_->write_index.load(std::memory_order_acquire);
+            if (count == 0 || count <= last_index_) {
+                return false;
+            }
+
+            uint64_t index = count - 1;
+            const SlotHeader* source = slot((uint32_t)(index % header_->slot_count));
+
+            uint64_t before = source->state.load(std::memory_order_acquire);
+            if (before != index * 2 + 2) {
+                // Already being overwritten by a newer frame
+                continue;
+            }
+
+            size_t size = (size_t)source->size;
+            if (size > header_->slot_capacity) {
+                continue;
+            }
+            frame.sequence = source->sequence;
+            frame.timestamp_us = source->timestamp_us;
+            frame.data.resize(size);
+            std::memcpy(&frame.data[0], reinterpret_cast<const char*>(source) + sizeof(SlotHeader), size);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (source->state.load(std::memory_order_relaxed) != before) {
+                continue;
+            }
+
+            if (last_index_ != 0 && index > last_index_) {
+                dropped_frames_ += index - last_index_;
+            }
+            last_index_ = index + 1;
+            frame.index = index;
+            return true;
+        }
+    }
+
+    // Frames the writer produced that this reader never saw
+    uint64_t getDroppedFrames() const { return dropped_frames_; }
+
+   private:
+    Mapping mapping_;
+    RingHeader* header_ = nullptr;
+    uint64_t last_index_ = 0;
+    uint64_t dropped_frames_ = 0;
+
+    const SlotHeader* slot(uint32_t i) const {
+        return reinterpret_cast<const SlotHeader*>(
+            static_cast<const char*>(mapping_.data()) + header_->data_offset + header_->slot_stride * i);
+    }
+};
+}  // namespace shm
+}  // namespace nadjieb
@@ -49,6 +49,8 @@ SOFTWARE.
 // #include <nadjieb/net/http_request.hpp>
 
 
+#include <algorithm>
+#include <cctype>
 #include <sstream>
 #include <string>
 #include <unordered_map>
@@ -71,8 +73,7 @@ class HTTPRequest {
         std::string line;
         std::getline(iss, line);
 
-        while (true) {
-            std::getline(iss, line);
+        while (std::getline(iss, line)) {
             if (line == "\r") {
                 break;
             }
@@ -84,22 +85,77 @@ class HTTPRequest {
             std::getline(iss_header, value, ' ');
             std::getline(iss_header, value, '\r');
 
+            // Header names are case-insensitive
+            std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return (char)std::tolower(c); });
             headers_[key] = value;
         }
 
-        body_ = iss.str().substr(iss.tellg());
+        auto body_start = iss.tellg();
+        body_ = (body_start < 0) ? "" : iss.str().substr((size_t)body_start);
     }
 
     const std::string& getMethod() const { return method_; }
 
     const std::string& getTarget() const { return target_; }
 
+    // Target without the query string
+    std::string getPath() const { return target_.substr(0, target_.find('?')); }
+
+    bool hasQueryKey(const std::string& key) const {
+        auto query_start = target_.find('?');
+        if (query_start == std::string::npos) {
+            return false;
+        }
+
+        std::istringstream iss(target_.substr(query_start + 1));
+        std::string pair;
+        while (std::getline(iss, pair, '&')) {
+            if (pair.substr(0, pair.find('=')) == key) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Value of key in the query string, empty if absent (no percent-decoding)
+    std::string getQueryValue(const std::string& key) const {
+        auto query_start = target_.find('?');
+        if (query_start == std::string::npos) {
+            return "";
+        }
+
+        std::istringstream iss(target_.substr(query_start + 1));
+        std::string pair;
+        while (std::getline(iss, pair, '&')) {
+            auto eq = pair.find('=');
+            if (pair.substr(0, eq) == key) {
+                return (eq == std::string::npos) ? "" : pair.substr(eq + 1);
+            }
+        }
+        return "";
+    }
+
     const std::string& getVersion() const { return version_; }
 
-    const std::string& getValue(const std::string& key) { return headers_[key]; }
+    const std::string& getValue(std::string key) {
+        std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        return headers_[key];
+    }
 
     const std::string& getBody() const { return body_; }
 
+    // HTTP/1.1 keeps the connection unless the client says close, HTTP/1.0 only if it asks for keep-alive
+    bool isKeepAlive() {
+        std::string connection = getValue("Connection");
+        std::transform(connection.begin(), connection.end(), connection.begin(), [](unsigned char c) {
+            return (char)std::tolower(c);
+        });
+        if (version_ == "HTTP/1.1") {
+            return connection.find("close") == std::string::npos;
+        }
+        return connection.find("keep-alive") != std::string::npos;
+    }
+
    private:
     std::string method_;
     std::string target_;
@@ -113,9 +169,11 @@ class HTTPRequest {
 // #include <nadjieb/net/http_response.hpp>
 
 
-#include <sstream>
+#include <charconv>
+#include <cstdint>
 #include <string>
-#include <unordered_map>
+#include <utility>
+#include <vector>
 
 // Reference https://developer.mozilla.org/en-US/docs/Web/HTTP/Messages#http_responses
 
@@ -123,34 +181,319 @@ namespace nadjieb {
 namespace net {
 class HTTPResponse {
    public:
-    std::string serialize() {
-        const std::string delimiter = "\r\n";
-        std::stringstream stream;
-
-        stream << version_ << ' ' << status_code_ << ' ' << status_text_ << delimiter;
+    std::string serialize() const {
+        std::string out;
+        serializeTo(out);
+        return out;
+    }
 
+    // Appends to out; headers keep the order they were set in
+    void serializeTo(std::string& out) const {
+        size_t size = version_.size() + status_text_.size() + body_.size() + 16;
         for (const auto& header : headers_) {
-            stream << header.first << ": " << header.second << delimiter;
+            size += header.first.size() + header.second.size() + 4;
         }
-
-        stream << delimiter << body_;
-
-        return stream.str();
+        out.reserve(out.size() + size);
+
+        out += version_;
+        out += ' ';
+        out += std::to_string(status_code_);
+        out += ' ';
+        out += status_text_;
+        out += "\r\n";
+        for (const auto& header : headers_) {
+            out += header.first;
+            out += ": ";
+            out += header.second;
+            out += "\r\n";
+        }
+        out += "\r\n";
+        out += body_;
     }
 
     void setVersion(const std::string& version) { version_ = version; }
     void setStatusCode(const int& status_code) { status_code_ = status_code; }
     void setStatusText(const std::string& status_text) { status_text_ = status_text; }
-    void setValue(const std::string& key, const std::string& value) { headers_[key] = value; }
+    void setValue(const std::string& key, const std::string& value) {
+        for (auto& header : headers_) {
+            if (header.first == key) {
+                header.second = value;
+                return;
+            }
+        }
+        headers_.emplace_back(key, value);
+    }
     void setBody(const std::string& body) { body_ = body; }
 
    private:
     std::string version_;
-    int status_code_;
+    int status_code_ = 200;
     std::string status_text_;
-    std::unordered_map<std::string, std::string> headers_;
+    std::vector<std::pair<std::string, std::string>> headers_;
     std::string body_;
 };
+
+// Formats a response straight into a buffer that keeps its capacity from one request to the next,
+// so answering a polling client allocates nothing once the buffer has grown.
+class ResponseBuilder {
+   public:
+    ResponseBuilder& start(const std::string& version, int status_code, const char* status_text) {
+        buffer_.clear();
+        buffer_ += version.empty() ? "HTTP/1.1" : version;
+        buffer_ += ' ';
+        appendNumber((uint64_t)status_code);
+        buffer_ += ' ';
+        buffer_ += status_text;
+        buffer_ += "\r\n";
+        return *this;
+    }
+
+    ResponseBuilder& header(const char* key, const char* value, size_t size) {
+        buffer_ += key;
+        buffer_ += ": ";
+        buffer_.append(value, size);
+        buffer_ += "\r\n";
+        return *this;
+    }
+
+    ResponseBuilder& header(const char* key, const char* value) { return header(key, value, std::char_traits<char>::length(value)); }
+
+    ResponseBuilder& header(const char* key, const std::string& value) { return header(key, value.data(), value.size()); }
+
+    ResponseBuilder& header(const char* key, uint64_t value) {
+        buffer_ += key;
+        buffer_ += ": ";
+        appendNumber(value);
+        buffer_ += "\r\n";
+        return *this;
+    }
+
+    ResponseBuilder& connection(bool keep_alive) { return header("Connection", keep_alive ? "keep-alive" : "close"); }
+
+    // Ends the headers of a response whose body_size bytes are sent separately
+    const std::string& finishHeaders(size_t body_size) {
+        header("Content-Length", (uint64_t)body_size);
+        buffer_ += "\r\n";
+        return buffer_;
+    }
+
+    const std::string& finish(const char* body = "", size_t size = 0) {
+        finishHeaders(size);
+        buffer_.append(body, size);
+        return buffer_;
+    }
+
+    const std::string& finish(const std::string& body) { return finish(body.data(), body.size()); }
+
+    // Ends the headers of a response that streams until the connection closes (no Content-Length)
+    const std::string& finishStream() {
+        buffer_ += "\r\n";
+        return buffer_;
+    }
+
+    // One builder per thread: every listener or session thread formats into its own buffer
+    static ResponseBuilder& forThread() {
+        thread_local ResponseBuilder builder;
+        return builder;
+    }
+
+   private:
+    std::string buffer_;
+
+    void appendNumber(uint64_t value) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        buffer_.append(digits, result.ptr);
+    }
+};
+}  // namespace net
+}  // namespace nadjieb
+
+// #include <nadjieb/net/websocket.hpp>
+
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Reference https://www.rfc-editor.org/rfc/rfc6455
+
+namespace nadjieb {
+namespace net {
+namespace websocket {
+enum Opcode : uint8_t { CONTINUATION = 0x0, TEXT = 0x1, BINARY = 0x2, CLOSE = 0x8, PING = 0x9, PONG = 0xA };
+
+// Size of the header that precedes every JPEG inside a binary message:
+// uint64 sequence, int64 capture timestamp (µs since the Unix epoch), both little endian
+static const size_t FRAME_INFO_SIZE = 16;
+
+static std::string sha1(const std::string& message) {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    auto rotl = [](uint32_t x, int n) { return (x << n) | (x >> (32 - n)); };
+
+    std::string data = message;
+    uint64_t bit_length = (uint64_t)message.size() * 8;
+    data += (char)0x80;
+    while (data.size() % 64 != 56) {
+        data += (char)0x00;
+    }
+    for (int i = 7; i >= 0; --i) {
+        data += (char)((bit_length >> (i * 8)) & 0xFF);
+    }
+
+    for (size_t chunk = 0; chunk < data.size(); chunk += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = ((uint32_t)(uint8_t)data[chunk + i * 4] << 24) | ((uint32_t)(uint8_t)data[chunk + i * 4 + 1] << 16)
+                   | ((uint32_t)(uint8_t)data[chunk + i * 4 + 2] << 8) | (uint32_t)(uint8_t)data[chunk + i * 4 + 3];
+        }
+        for (int i = 16; i < 80; ++i) {
+            w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t temp = rotl(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotl(b, 30);
+            b = a;
+            a = temp;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+
+    std::string digest(20, 0);
+    for (int i = 0; i < 20; ++i) {
+        digest[i] = (char)((h[i / 4] >> (24 - (i % 4) * 8)) & 0xFF);
+    }
+    return digest;
+}
+
+static std::string base64(const std::string& input) {
+    static const char* table = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string output;
+    size_t i = 0;
+    for (; i + 2 < input.size(); i += 3) {
+        uint32_t n = ((uint8_t)input[i] << 16) | ((uint8_t)input[i + 1] << 8) | (uint8_t)input[i + 2];
+        output += table[(n >> 18) & 63];
+        output += table[(n >> 12) & 63];
+        output += table[(n >> 6) & 63];
+        output += table[n & 63];
+    }
+    if (i < input.size()) {
+        uint32_t n = (uint8_t)input[i] << 16;
+        if (i + 1 < input.size()) {
+            n |= (uint8_t)input[i + 1] << 8;
+        }
+        output += table[(n >> 18) & 63];
+        output += table[(n >> 12) & 63];
+        output += (i + 1 < input.size()) ? table[(n >> 6) & 63] : '=';
+        output += '=';
+    }
+    return output;
+}
+
+static std::string computeAcceptKey(const std::string& client_key) {
+    return base64(sha1(client_key + "258EAFA5-E914-47CA-95C5-C4ABCEB2CD11"));
+}
+
+// Unmasked server-to-client frame header for a single-fragment message
+static std::string buildFrameHeader(Opcode opcode, uint64_t payload_size) {
+    std::string header;
+    header += (char)(0x80 | opcode);
+    if (payload_size < 126) {
+        header += (char)payload_size;
+    } else if (payload_size <= 0xFFFF) {
+        header += (char)126;
+        header += (char)((payload_size >> 8) & 0xFF);
+        header += (char)(payload_size & 0xFF);
+    } else {
+        header += (char)127;
+        for (int i = 7; i >= 0; --i) {
+            header += (char)((payload_size >> (i * 8)) & 0xFF);
+        }
+    }
+    return header;
+}
+
+// Follows the frames a client sends, across reads. Clients only ever get frames pushed to them,
+// so everything else they send (pings, text) is skipped without being buffered; only the headers
+// are kept until they are complete.
+class FrameScanner {
+   public:
+    // Scans the next bytes read from the client. True once a close frame arrives, or a frame
+    // length no client may send (RFC 6455 5.2: the most significant bit must be 0)
+    bool feed(const std::string& data) {
+        size_t pos = 0;
+        while (pos < data.size()) {
+            if (remaining_ > 0) {
+                auto skipped = std::min<uint64_t>(remaining_, data.size() - pos);
+                remaining_ -= skipped;
+                pos += (size_t)skipped;
+                continue;
+            }
+
+            header_ += data[pos++];
+            if (header_.size() < headerSize()) {
+                continue;
+            }
+
+            if (((uint8_t)header_[0] & 0x0F) == CLOSE) {
+                return true;
+            }
+
+            uint64_t length = (uint8_t)header_[1] & 0x7F;
+            if (length >= 126) {
+                size_t length_size = length == 126 ? 2 : 8;
+                length = 0;
+                for (size_t i = 0; i < length_size; ++i) {
+                    length = (length << 8) | (uint8_t)header_[2 + i];
+                }
+                if (length >> 63) {
+                    return true;
+                }
+            }
+            remaining_ = length;
+            header_.clear();
+        }
+        return false;
+    }
+
+   private:
+    // Bytes of the current header, as far as header_ tells already
+    size_t headerSize() const {
+        if (header_.size() < 2) {
+            return 2;
+        }
+        auto length = (uint8_t)header_[1] & 0x7F;
+        bool masked = ((uint8_t)header_[1] & 0x80) != 0;
+        return 2 + (length == 126 ? 2 : length == 127 ? 8 : 0) + (masked ? 4 : 0);
+    }
+
+    std::string header_;
+    // Payload bytes of the current frame not read yet
+    uint64_t remaining_ = 0;
+};
+}  // namespace websocket
 }  // namespace net
 }  // namespace nadjieb
 
@@ -189,23 +532,36 @@ class HTTPResponse {
 #elif defined NADJIEB_MJPEG_STREAMER_PLATFORM_LINUX
 #include <arpa/inet.h>
 #include <errno.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <poll.h>
 #include <signal.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
+
+// Kernel 4.14+ headers
+#if defined MSG_ZEROCOPY && defined SO_ZEROCOPY && defined SO_EE_ORIGIN_ZEROCOPY
+#define NADJIEB_MJPEG_STREAMER_HAS_ZEROCOPY
+#endif
 #elif defined NADJIEB_MJPEG_STREAMER_PLATFORM_DARWIN
 #include <arpa/inet.h>
 #include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <poll.h>
 #include <signal.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #else
 #error "Unsupported OS, please commit an issue."
 #endif
 
+#include <chrono>
 #include <stdexcept>
 #include <string>
 
@@ -284,6 +640,18 @@ static void setSocketReuseAddress(SocketFD sockfd) {
     panicIfUnexpected(res == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR, "setSocketReuseAddress() failed", sockfd);
 }
 
+// Lets several sockets bind the same port, with the kernel spreading new connections across them.
+// Only Linux balances that way (Darwin hands everything to the last socket), so elsewhere this is a no-op.
+static bool setSocketReusePort(SocketFD sockfd) {
+#if defined NADJIEB_MJPEG_STREAMER_PLATFORM_LINUX && defined SO_REUSEPORT
+    const int enable = 1;
+    return ::setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, (const char*)&enable, sizeof(int)) == 0;
+#else
+    (void)sockfd;
+    return false;
+#endif
+}
+
 static void setSocketNonblock(SocketFD sockfd) {
     unsigned long ul = true;
     int res;
@@ -295,21 +663,28 @@ static void setSocketNonblock(SocketFD sockfd) {
     panicIfUnexpected(res == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR, "setSocketNonblock() failed", sockfd);
 }
 
-static void bindSocket(SocketFD sockfd, const char* ip, int port) {
+// On failure sockfd is closed and false returned
+static bool bindSocket(SocketFD sockfd, const char* ip, int port) {
     struct sockaddr_in ip_addr;
     ip_addr.sin_family = AF_INET;
     ip_addr.sin_port = htons((uint16_t)port);
     ip_addr.sin_addr.s_addr = INADDR_ANY;
     auto res = inet_pton(AF_INET, ip, &ip_addr.sin_addr);
     panicIfUnexpected(res <= 0, "inet_pton() failed", sockfd);
+    if (res <= 0) {
+        return false;
+    }
 
     res = ::bind(sockfd, (struct sockaddr*)&ip_addr, sizeof(ip_addr));
     panicIfUnexpected(res == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR, "bindSocket() failed", sockfd);
+    return res != NADJIEB_MJPEG_STREAMER_SOCKET_ERROR;
 }
 
-static void listenOnSocket(SocketFD sockfd, int backlog) {
+// On failure sockfd is closed and false returned
+static bool listenOnSocket(SocketFD sockfd, int backlog) {
     auto res = ::listen(sockfd, backlog);
     panicIfUnexpected(res == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR, "listenOnSocket() failed", sockfd);
+    return res != NADJIEB_MJPEG_STREAMER_SOCKET_ERROR;
 }
 
 static SocketFD acceptNewSocket(SocketFD sockfd) {
@@ -339,6 +714,284 @@ static int pollSockets(NADJIEB_MJPEG_STREAMER_POLLFD* fds, size_t nfds, long tim
     return poll(fds, nfds, timeout);
 #endif
 }
+
+struct ConstBuffer {
+    const char* data;
+    size_t size;
+};
+
+// Sends all buffers in order with as few syscalls as possible (writev-style gather),
+// waiting up to timeout ms in total for a nonblocking socket to drain.
+// flags may add MSG_ZEROCOPY (Linux): zerocopy_calls then counts the send calls that got a
+// completion id, and the buffers must stay untouched until those completions arrive.
+// sent_bytes receives what went out even on failure: a message cut short leaves the peer out of sync.
+static bool sendAllViaSocket(
+    SocketFD socket,
+    ConstBuffer* buffers,
+    size_t count,
+    long timeout,
+    int flags = 0,
+    uint32_t* zerocopy_calls = nullptr,
+    size_t* sent_bytes = nullptr) {
+    const size_t MAX_BUFFERS = 8;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+
+    while (count > 0) {
+        if (buffers[0].size == 0) {
+            ++buffers;
+            --count;
+            continue;
+        }
+
+        size_t n = (count < MAX_BUFFERS) ? count : MAX_BUFFERS;
+#ifdef NADJIEB_MJPEG_STREAMER_PLATFORM_WINDOWS
+        WSABUF vec[MAX_BUFFERS];
+        for (size_t i = 0; i < n; ++i) {
+            vec[i].buf = const_cast<char*>(buffers[i].data);
+            vec[i].len = (ULONG)buffers[i].size;
+        }
+        DWORD sent_bytes = 0;
+        long long sent = (WSASend(socket, vec, (DWORD)n, &sent_bytes, 0, nullptr, nullptr) == 0)
+                             ? (long long)sent_bytes
+                             : NADJIEB_MJPEG_STREAMER_SOCKET_ERROR;
+#else
+        struct iovec vec[MAX_BUFFERS];
+        for (size_t i = 0; i < n; ++i) {
+            vec[i].iov_base = const_cast<char*>(buffers[i].data);
+            vec[i].iov_len = buffers[i].size;
+        }
+        struct msghdr msg = {};
+        msg.msg_iov = vec;
+        msg.msg_iovlen = n;
+#ifdef MSG_NOSIGNAL
+        long long sent = ::sendmsg(socket, &msg, flags | MSG_NOSIGNAL);
+#else
+        long long sent = ::sendmsg(socket, &msg, flags);
+#endif
+#endif
+#ifdef NADJIEB_MJPEG_STREAMER_HAS_ZEROCOPY
+        if (sent == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR && errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {
+            // Out of pinned-page budget (optmem_max): copy instead
+            flags &= ~MSG_ZEROCOPY;
+            continue;
+        }
+        if (sent > 0 && (flags & MSG_ZEROCOPY) && zerocopy_calls != nullptr) {
+            ++*zerocopy_calls;
+        }
+#endif
+        if (sent == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR) {
+            if (NADJIEB_MJPEG_STREAMER_ERRNO != NADJIEB_MJPEG_STREAMER_EWOULDBLOCK) {
+                return false;
+            }
+
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now());
+            if (remaining.count() <= 0) {
+                return false;
+            }
+
+            NADJIEB_MJPEG_STREAMER_POLLFD pfd{socket, POLLWRNORM, 0};
+            if (pollSockets(&pfd, 1, (long)remaining.count()) <= 0) {
+                return false;
+            }
+            continue;
+        }
+
+        // Advance past what the kernel took
+        size_t advance = (size_t)sent;
+        if (sent_bytes != nullptr) {
+            *sent_bytes += advance;
+        }
+        while (advance > 0 && count > 0) {
+            if (advance >= buffers[0].size) {
+                advance -= buffers[0].size;
+                ++buffers;
+                --count;
+            } else {
+                buffers[0].data += advance;
+                buffers[0].size -= advance;
+                advance = 0;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Pending error of sockfd (SO_ERROR), 0 if the socket is fine
+static int getSocketError(SocketFD sockfd) {
+    int error = 0;
+    socklen_t size = sizeof(error);
+    if (::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, (char*)&error, &size) == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR) {
+        return -1;
+    }
+    return error;
+}
+
+// Ends both directions of sockfd without closing it; the event loop sees the hangup and closes it
+static void shutdownSocket(SocketFD sockfd) {
+#ifdef NADJIEB_MJPEG_STREAMER_PLATFORM_WINDOWS
+    ::shutdown(sockfd, SD_BOTH);
+#else
+    ::shutdown(sockfd, SHUT_RDWR);
+#endif
+}
+
+// "address:port" of the remote end of sockfd, empty if it is not an IPv4 connection
+static std::string getPeerName(SocketFD sockfd) {
+    struct sockaddr_in addr = {};
+    socklen_t size = sizeof(addr);
+    if (::getpeername(sockfd, (struct sockaddr*)&addr, &size) == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR
+        || addr.sin_family != AF_INET) {
+        return std::string();
+    }
+
+    char text[INET_ADDRSTRLEN] = {};
+    if (inet_ntop(AF_INET, &addr.sin_addr, text, sizeof(text)) == nullptr) {
+        return std::string();
+    }
+    return std::string(text) + ":" + std::to_string(ntohs(addr.sin_port));
+}
+
+// Local port sockfd is bound to, 0 if unknown
+static int getSocketPort(SocketFD sockfd) {
+    struct sockaddr_in addr = {};
+    socklen_t size = sizeof(addr);
+    if (::getsockname(sockfd, (struct sockaddr*)&addr, &size) == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR
+        || addr.sin_family != AF_INET) {
+        return 0;
+    }
+    return ntohs(addr.sin_port);
+}
+
+// Loopback UDP socket connected to itself. Polled next to other sockets, wake() makes it readable, so a
+// thread blocked in pollSockets() returns at once instead of at a timeout. A socket rather than a pipe
+// because WSAPoll only takes sockets.
+class WakeSocket {
+   public:
+    WakeSocket() = default;
+    WakeSocket(const WakeSocket&) = delete;
+    WakeSocket& operator=(const WakeSocket&) = delete;
+    ~WakeSocket() { close(); }
+
+    bool open() {
+        close();
+        sockfd_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+        if (sockfd_ == NADJIEB_MJPEG_STREAMER_INVALID_SOCKET) {
+            return false;
+        }
+
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t size = sizeof(addr);
+        if (::bind(sockfd_, (struct sockaddr*)&addr, sizeof(addr)) == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR
+            || ::getsockname(sockfd_, (struct sockaddr*)&addr, &size) == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR
+            || ::connect(sockfd_, (struct sockaddr*)&addr, sizeof(addr)) == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR) {
+            close();
+            return false;
+        }
+        setSocketNonblock(sockfd_);
+        return true;
+    }
+
+    void close() {
+        if (sockfd_ != NADJIEB_MJPEG_STREAMER_INVALID_SOCKET) {
+            closeSocket(sockfd_);
+            sockfd_ = NADJIEB_MJPEG_STREAMER_INVALID_SOCKET;
+        }
+    }
+
+    SocketFD fd() const { return sockfd_; }
+
+    bool isOpen() const { return sockfd_ != NADJIEB_MJPEG_STREAMER_INVALID_SOCKET; }
+
+    // Safe from any thread
+    void wake() {
+        char byte = 0;
+        sendViaSocket(sockfd_, &byte, 1, 0);
+    }
+
+    // Called by the polling thread once the socket is readable
+    void drain() {
+        char buff[64];
+        while (readFromSocket(sockfd_, buff, sizeof(buff), 0) > 0) {
+        }
+    }
+
+   private:
+    SocketFD sockfd_ = NADJIEB_MJPEG_STREAMER_INVALID_SOCKET;
+};
+
+// TCP tuning of the listening address and of every accepted connection. The defaults leave
+// everything to the OS, as before these options existed.
+struct SocketOptions {
+    // IPv4 address to listen on; "127.0.0.1" keeps the server local
+    std::string bind_address = "0.0.0.0";
+    // If the port is taken, the next port_fallback ports are tried in order
+    int port_fallback = 0;
+    // SO_SNDBUF in bytes, 0 = OS default (autotuned on Linux)
+    int send_buffer_size = 0;
+    // TCP_NOTSENT_LOWAT in bytes, 0 = off (Linux, macOS). The socket only counts as writable while
+    // less than this is waiting to be sent, so workers skip frames for a client with a backlog
+    // instead of queueing them behind megabytes of older ones in the kernel.
+    int not_sent_low_watermark = 0;
+    bool tcp_nodelay = false;
+    // SO_KEEPALIVE, so dead viewers behind NATs are noticed; times in seconds, 0 = OS default
+    bool keepalive = false;
+    int keepalive_idle = 0;
+    int keepalive_interval = 0;
+    int keepalive_count = 0;
+};
+
+static void setSocketOption(SocketFD sockfd, int level, int name, int value, const char* what) {
+    if (::setsockopt(sockfd, level, name, (const char*)&value, sizeof(value)) == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR) {
+        FString what_(what);
+        UE_LOG(LogTemp, Warning, TEXT("nadjieb::MJPEGStreamer: setting %s failed"), *what_);
+    }
+}
+
+// Applies options to an accepted connection
+static void applySocketOptions(SocketFD sockfd, const SocketOptions& options) {
+    if (options.tcp_nodelay) {
+        setSocketOption(sockfd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+    }
+    if (options.send_buffer_size > 0) {
+        setSocketOption(sockfd, SOL_SOCKET, SO_SNDBUF, options.send_buffer_size, "SO_SNDBUF");
+    }
+#ifdef TCP_NOTSENT_LOWAT
+    if (options.not_sent_low_watermark > 0) {
+        setSocketOption(sockfd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, options.not_sent_low_watermark, "TCP_NOTSENT_LOWAT");
+    }
+#endif
+    if (options.keepalive) {
+        setSocketOption(sockfd, SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE");
+#if defined TCP_KEEPIDLE
+        if (options.keepalive_idle > 0) {
+            setSocketOption(sockfd, IPPROTO_TCP, TCP_KEEPIDLE, options.keepalive_idle, "TCP_KEEPIDLE");
+        }
+#elif defined TCP_KEEPALIVE
+        if (options.keepalive_idle > 0) {
+            setSocketOption(sockfd, IPPROTO_TCP, TCP_KEEPALIVE, options.keepalive_idle, "TCP_KEEPALIVE");
+        }
+#endif
+#ifdef TCP_KEEPINTVL
+        if (options.keepalive_interval > 0) {
+            setSocketOption(sockfd, IPPROTO_TCP, TCP_KEEPINTVL, options.keepalive_interval, "TCP_KEEPINTVL");
+        }
+#endif
+#ifdef TCP_KEEPCNT
+        if (options.keepalive_count > 0) {
+            setSocketOption(sockfd, IPPROTO_TCP, TCP_KEEPCNT, options.keepalive_count, "TCP_KEEPCNT");
+        }
+#endif
+    }
+}
+
+static bool sendAllViaSocket(SocketFD socket, const std::string& data, long timeout) {
+    ConstBuffer part{data.data(), data.size()};
+    return sendAllViaSocket(socket, &part, 1, timeout);
+}
 }  // namespace net
 }  // namespace nadjieb
 
@@ -364,6 +1017,8 @@ class NonCopyable {
 // #include <nadjieb/utils/runnable.hpp>
 
 
+#include <atomic>
+
 namespace nadjieb {
 namespace utils {
 enum class State { UNSPECIFIED = 0, NEW, BOOTING, RUNNING, TERMINATING, TERMINATED };
@@ -374,200 +1029,622 @@ class Runnable {
     bool isRunning() { return (state_ == State::RUNNING); }
 
    protected:
-    State state_ = State::NEW;
+    std::atomic<State> state_{State::NEW};
 };
 }  // namespace utils
 }  // namespace nadjieb
 
+// #include <nadjieb/utils/thread.hpp>
+
 
+#include <cstdint>
 #include <functional>
-#include <iostream>
-#include <stdexcept>
+#include <memory>
+#include <string>
 #include <thread>
-#include <vector>
+
+#ifdef NADJIEB_MJPEG_STREAMER_PLATFORM_LINUX
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#elif defined NADJIEB_MJPEG_STREAMER_PLATFORM_DARWIN
+#include <pthread.h>
+#endif
 
 namespace nadjieb {
-namespace net {
+namespace utils {
+enum class ThreadPriority { LOWEST, BELOW_NORMAL, NORMAL, ABOVE_NORMAL, HIGHEST };
+
+// Where the threads of one role (listener loops, publisher workers) run
+struct ThreadPlacement {
+    // Prefix of the thread names, the index of the thread is appended. At most 15 characters in total on Linux
+    std::string name;
+    // Bit n allows CPU n, 0 = any
+    uint64_t affinity_mask = 0;
+    ThreadPriority priority = ThreadPriority::NORMAL;
+};
 
-struct OnMessageCallbackResponse {
-    bool close_conn = false;
-    bool end_listener = false;
+// A thread started by a ThreadFactory
+class Thread {
+   public:
+    virtual ~Thread() = default;
+    virtual void join() = 0;
 };
 
-using OnMessageCallback = std::function<OnMessageCallbackResponse(const SocketFD&, const std::string&)>;
-using OnBeforeCloseCallback = std::function<void(const SocketFD&)>;
+// Starts a thread running fn, placed as asked. Hosts with their own threading (named and profiled threads,
+// engine-level priorities) install one; the default is StdThread.
+using ThreadFactory
+    = std::function<std::unique_ptr<Thread>(const ThreadPlacement& placement, int index, std::function<void()> fn)>;
+
+// Applies name, affinity and priority to the calling thread; failures are logged and otherwise ignored.
+// Linux raises priority above NORMAL only with CAP_SYS_NICE; macOS has neither affinity nor per-thread nice.
+static void applyThreadPlacement(const ThreadPlacement& placement, int index) {
+    std::string name = placement.name + std::to_string(index);
+#ifdef NADJIEB_MJPEG_STREAMER_PLATFORM_LINUX
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+    if (placement.affinity_mask != 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu = 0; cpu < 64; ++cpu) {
+            if ((placement.affinity_mask >> cpu) & 1) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            UE_LOG(LogTemp, Warning, TEXT("nadjieb::MJPEGStreamer: setting the affinity of %s failed"), *FString(name.c_str()));
+        }
+    }
+    static const int NICE[] = {10, 5, 0, -5, -10};
+    int nice = NICE[(int)placement.priority];
+    if (nice != 0 && setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), nice) != 0) {
+        UE_LOG(LogTemp, Warning, TEXT("nadjieb::MJPEGStreamer: setting the priority of %s failed"), *FString(name.c_str()));
+    }
+#elif defined NADJIEB_MJPEG_STREAMER_PLATFORM_DARWIN
+    pthread_setname_np(name.c_str());
+#elif defined NADJIEB_MJPEG_STREAMER_PLATFORM_WINDOWS
+    SetThreadDescription(GetCurrentThread(), std::wstring(name.begin(), name.end()).c_str());
+    if (placement.affinity_mask != 0 && SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)placement.affinity_mask) == 0) {
+        UE_LOG(LogTemp, Warning, TEXT("nadjieb::MJPEGStreamer: setting the affinity of %s failed"), *FString(name.c_str()));
+    }
+    static const int PRIORITY[] = {THREAD_PRIORITY_LOWEST, THREAD_PRIORITY_BELOW_NORMAL, THREAD_PRIORITY_NORMAL,
+                                   THREAD_PRIORITY_ABOVE_NORMAL, THREAD_PRIORITY_HIGHEST};
+    SetThreadPriority(GetCurrentThread(), PRIORITY[(int)placement.priority]);
+#endif
+}
 
-class Listener : public nadjieb::utils::NonCopyable, public nadjieb::utils::Runnable {
+class StdThread : public Thread {
    public:
-    virtual ~Listener() { stop(); }
+    explicit StdThread(std::thread&& thread) : thread_(std::move(thread)) {}
 
-    Listener& withOnMessageCallback(const OnMessageCallback& callback) {
-        on_message_cb_ = callback;
-        return *this;
-    }
+    ~StdThread() override { join(); }
 
-    Listener& withOnBeforeCloseCallback(const OnBeforeCloseCallback& callback) {
-        on_before_close_cb_ = callback;
-        return *this;
+    void join() override {
+        if (thread_.joinable()) {
+            thread_.join();
+        }
     }
 
-    void stop() {
-        end_listener_ = true;
-        if (thread_listener_.joinable()) {
-            thread_listener_.join();
-        }
+    static std::unique_ptr<Thread> create(const ThreadPlacement& placement, int index, std::function<void()> fn) {
+        return std::make_unique<StdThread>(std::thread([placement, index, fn = std::move(fn)]() {
+            applyThreadPlacement(placement, index);
+            fn();
+        }));
     }
 
-    void runAsync(int port) { thread_listener_ = std::thread(&Listener::run, this, port); }
+   private:
+    std::thread thread_;
+};
+}  // namespace utils
+}  // namespace nadjieb
 
-    void run(int port) {
-        state_ = nadjieb::utils::State::BOOTING;
+// #include <nadjieb/utils/memory_budget.hpp>
+
+
+#include <atomic>
+#include <cstddef>
+
+namespace nadjieb {
+namespace utils {
+// Byte budget shared by every stage of the pipeline that holds frames.
+// A limit of 0 means unlimited; usage is still tracked.
+class MemoryBudget {
+   public:
+    void setLimit(size_t limit) { limit_ = limit; }
+
+    size_t getLimit() const { return limit_; }
+
+    size_t getUsage() const { return usage_; }
+
+    bool isExceeded() const {
+        size_t limit = limit_;
+        return (limit != 0) && (usage_ > limit);
+    }
+
+    // Reserves bytes only if they fit in the budget
+    bool tryAcquire(size_t bytes) {
+        size_t usage = usage_.load();
+        do {
+            size_t limit = limit_;
+            if ((limit != 0) && (usage + bytes > limit)) {
+                return false;
+            }
+        } while (!usage_.compare_exchange_weak(usage, usage + bytes));
+        return true;
+    }
+
+    // Reserves bytes unconditionally (memory that already exists, e.g. an encoded frame)
+    void acquire(size_t bytes) { usage_ += bytes; }
+
+    void release(size_t bytes) { usage_ -= bytes; }
+
+   private:
+    std::atomic<size_t> usage_{0};
+    std::atomic<size_t> limit_{0};
+};
+}  // namespace utils
+}  // namespace nadjieb
+
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace nadjieb {
+namespace net {
+
+// What the listener does with data arriving on a connection after this response
+enum class ConnectionMode {
+    // Split into HTTP requests, one callback per request (keep-alive and pipelining)
+    REQUESTS,
+    // Handed to the callback as read, e.g. WebSocket frames
+    PASSTHROUGH,
+    // The connection is a one-way stream now; anything the client sends is dropped
+    DISCARD
+};
+
+struct OnMessageCallbackResponse {
+    bool close_conn = false;
+    bool end_listener = false;
+    ConnectionMode mode = ConnectionMode::REQUESTS;
+};
+
+using OnMessageCallback = std::function<OnMessageCallbackResponse(const SocketFD&, const std::string&)>;
+using OnBeforeCloseCallback = std::function<void(const SocketFD&)>;
+// Drains the socket's error queue (MSG_ERRQUEUE), e.g. zero-copy completions
+using OnErrorQueueCallback = std::function<void(const SocketFD&)>;
+
+struct RouteHandler {
+    std::function<OnMessageCallbackResponse(const SocketFD&, HTTPRequest&)> on_request;
+    OnBeforeCloseCallback on_close;
+};
+
+// Accepts connections and reads requests on one or more event loop threads. Each loop polls its own
+// connections; with several loops on Linux every loop also binds its own SO_REUSEPORT socket, so the
+// kernel spreads a reconnect storm across them instead of serializing it on one accept queue.
+// Elsewhere the loops share one listening socket and whichever wakes first accepts.
+// The callbacks are invoked from all loop threads concurrently.
+class Listener : public nadjieb::utils::NonCopyable, public nadjieb::utils::Runnable {
+   public:
+    virtual ~Listener() { stop(); }
+
+    Listener& withOnMessageCallback(const OnMessageCallback& callback) {
+        on_message_cb_ = callback;
+        return *this;
+    }
+
+    Listener& withOnBeforeCloseCallback(const OnBeforeCloseCallback& callback) {
+        on_before_close_cb_ = callback;
+        return *this;
+    }
+
+    // Without it, POLLERR always closes the connection
+    Listener& withOnErrorQueueCallback(const OnErrorQueueCallback& callback) {
+        on_error_queue_cb_ = callback;
+        return *this;
+    }
+
+    // Name, affinity and priority of the loop threads and how they are started. Takes effect on the next runAsync()
+    Listener& withThreads(const nadjieb::utils::ThreadPlacement& placement, const nadjieb::utils::ThreadFactory& factory) {
+        placement_ = placement;
+        thread_factory_ = factory;
+        return *this;
+    }
+
+    // Returns as soon as the loops are out of poll, which the wake sockets make immediate
+    void stop() {
+        wakeAll();
+        for (auto& loop : loops_) {
+            if (loop->thread) {
+                loop->thread->join();
+            }
+        }
+        if (!loops_.empty()) {
+            // After the wake sockets are closed with their loops
+            loops_.clear();
+            destroySocket();
+        }
+    }
+
+    // Binds port, or the first free one of the next options.port_fallback, and starts the loops.
+    // Returns false without starting anything if none could be bound.
+    bool runAsync(int port, int num_threads = 1, const SocketOptions& options = SocketOptions()) {
+        stop();
+
+        state_ = nadjieb::utils::State::BOOTING;
         panicIfUnexpected(on_message_cb_ == nullptr, "not setting on_message_cb");
         panicIfUnexpected(on_before_close_cb_ == nullptr, "not setting on_before_close_cb");
 
         end_listener_ = false;
-
+        options_ = options;
         initSocket();
-        listen_sd_ = createSocket(AF_INET, SOCK_STREAM, 0);
-        setSocketReuseAddress(listen_sd_);
-        setSocketNonblock(listen_sd_);
-        bindSocket(listen_sd_, "0.0.0.0", port);
-        listenOnSocket(listen_sd_, SOMAXCONN);
 
-        fds_.emplace_back(NADJIEB_MJPEG_STREAMER_POLLFD{listen_sd_, POLLRDNORM, 0});
-
-        std::string buff(4096, 0);
+        num_threads = std::max(num_threads, 1);
+        bool reuse_port = false;
+        for (int i = 0; i < num_threads; ++i) {
+            auto loop = std::make_unique<EventLoop>();
+            if (i == 0) {
+                for (int attempt = 0; attempt <= std::max(options_.port_fallback, 0); ++attempt) {
+                    loop->listen_sd = openListenSocket(options_.bind_address, port + attempt, num_threads > 1, reuse_port);
+                    if (loop->listen_sd != NADJIEB_MJPEG_STREAMER_INVALID_SOCKET) {
+                        break;
+                    }
+                }
+                loop->owns_listen_sd = true;
+                if (loop->listen_sd == NADJIEB_MJPEG_STREAMER_INVALID_SOCKET) {
+                    state_ = nadjieb::utils::State::TERMINATED;
+                    destroySocket();
+                    return false;
+                }
+                // Port 0 lets the OS pick one
+                bound_port_ = getSocketPort(loop->listen_sd);
+            } else if (reuse_port) {
+                loop->listen_sd = openListenSocket(options_.bind_address, bound_port_, true, reuse_port);
+                loop->owns_listen_sd = true;
+                if (loop->listen_sd == NADJIEB_MJPEG_STREAMER_INVALID_SOCKET) {
+                    // The port got taken between two binds; the remaining loops share the last socket
+                    loop->listen_sd = loops_.back()->listen_sd;
+                    loop->owns_listen_sd = false;
+                    reuse_port = false;
+                }
+            } else {
+                loop->listen_sd = loops_.front()->listen_sd;
+                loop->owns_listen_sd = false;
+            }
+            loop->fds.emplace_back(NADJIEB_MJPEG_STREAMER_POLLFD{loop->listen_sd, POLLRDNORM, 0});
+            if (loop->waker.open()) {
+                loop->fds.emplace_back(NADJIEB_MJPEG_STREAMER_POLLFD{loop->waker.fd(), POLLRDNORM, 0});
+            }
+            loops_.push_back(std::move(loop));
+        }
 
+        running_loops_ = (int)loops_.size();
         state_ = nadjieb::utils::State::RUNNING;
 
+        auto factory = thread_factory_ ? thread_factory_ : nadjieb::utils::StdThread::create;
+        for (size_t i = 0; i < loops_.size(); ++i) {
+            auto* loop = loops_[i].get();
+            loop->thread = factory(placement_, (int)i, [this, loop]() { run(loop); });
+        }
+        return true;
+    }
+
+    // Port the listener is bound to, valid once runAsync() succeeded
+    int getPort() const { return bound_port_; }
+
+    // Event loop threads actually running, at most the number asked for in runAsync()
+    int getThreadCount() const { return running_loops_; }
+
+    // Whether the loops have their own SO_REUSEPORT sockets or share one
+    bool isReusePort() const { return loops_.size() > 1 && loops_[1]->owns_listen_sd; }
+
+   private:
+    struct Connection {
+        ConnectionMode mode = ConnectionMode::REQUESTS;
+        // Bytes of an incomplete (or not yet handled pipelined) request
+        std::string pending;
+    };
+
+    // Everything a loop touches is only touched by its own thread
+    struct EventLoop {
+        SocketFD listen_sd = NADJIEB_MJPEG_STREAMER_INVALID_SOCKET;
+        bool owns_listen_sd = false;
+        // Makes stop() and end_listener responses reach a loop blocked in poll
+        WakeSocket waker;
+        std::vector<NADJIEB_MJPEG_STREAMER_POLLFD> fds;
+        std::unordered_map<SocketFD, Connection> connections;
+        std::unique_ptr<nadjieb::utils::Thread> thread;
+    };
+
+    std::vector<std::unique_ptr<EventLoop>> loops_;
+    std::atomic<bool> end_listener_{true};
+    std::atomic<int> running_loops_{0};
+    std::atomic<int> bound_port_{0};
+
+    // Without a wake socket a loop falls back to polling with this timeout
+    const static long POLL_FALLBACK_TIMEOUT_MS = 100;
+
+    // Longest request head accepted; larger ones close the connection
+    const static size_t LIMIT_REQUEST_SIZE = 64 * 1024;
+    // completeRequestSize() of a request that can never be accepted
+    const static size_t INVALID_REQUEST_SIZE = (size_t)-1;
+
+    OnMessageCallback on_message_cb_;
+    OnBeforeCloseCallback on_before_close_cb_;
+    OnErrorQueueCallback on_error_queue_cb_;
+    // Written by runAsync() before the loops start, read-only afterwards
+    SocketOptions options_;
+    nadjieb::utils::ThreadPlacement placement_{"MJPEGListener"};
+    nadjieb::utils::ThreadFactory thread_factory_;
+
+    // Nonblocking listening socket on port, or NADJIEB_MJPEG_STREAMER_INVALID_SOCKET.
+    // reuse_port reports whether SO_REUSEPORT could be set (only tried if want_reuse_port).
+    static SocketFD openListenSocket(const std::string& address, int port, bool want_reuse_port, bool& reuse_port) {
+        auto sockfd = createSocket(AF_INET, SOCK_STREAM, 0);
+        if (sockfd == NADJIEB_MJPEG_STREAMER_INVALID_SOCKET) {
+            return NADJIEB_MJPEG_STREAMER_INVALID_SOCKET;
+        }
+
+        setSocketReuseAddress(sockfd);
+        reuse_port = want_reuse_port && setSocketReusePort(sockfd);
+        setSocketNonblock(sockfd);
+        if (!bindSocket(sockfd, address.c_str(), port) || !listenOnSocket(sockfd, SOMAXCONN)) {
+            return NADJIEB_MJPEG_STREAMER_INVALID_SOCKET;
+        }
+        return sockfd;
+    }
+
+    void run(EventLoop* loop) {
+        auto& fds = loop->fds;
+        std::string buff(4096, 0);
+
+        long timeout = loop->waker.isOpen() ? -1 : POLL_FALLBACK_TIMEOUT_MS;
         while (!end_listener_) {
-            int socket_count = pollSockets(&fds_[0], fds_.size(), 100);
+            int socket_count = pollSockets(&fds[0], fds.size(), timeout);
 
-            panicIfUnexpected(socket_count == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR, "pollSockets() failed");
+            if (panicIfUnexpected(socket_count == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR, "pollSockets() failed")) {
+                break;
+            }
 
             if (socket_count == 0) {
                 continue;
             }
 
-            size_t current_size = fds_.size();
+            size_t current_size = fds.size();
             bool compress_array = false;
             for (size_t i = 0; i < current_size; ++i) {
-                if (fds_[i].revents == 0) {
+                if (fds[i].revents == 0) {
                     continue;
                 }
 
-                if (fds_[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
-                    on_before_close_cb_(fds_[i].fd);
-                    closeSocket(fds_[i].fd);
-                    fds_[i].fd = NADJIEB_MJPEG_STREAMER_INVALID_SOCKET;
-                    compress_array = true;
+                if (fds[i].fd == loop->waker.fd()) {
+                    loop->waker.drain();
                     continue;
                 }
 
-                panicIfUnexpected(fds_[i].revents != POLLRDNORM, "revents != POLLRDNORM");
+                if (fds[i].fd == loop->listen_sd) {
+                    if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                        // Stop accepting on this loop; the socket is closed with the loop
+                        panicIfUnexpected(true, "listening socket failed");
+                        fds[i].fd = NADJIEB_MJPEG_STREAMER_INVALID_SOCKET;
+                        compress_array = true;
+                        continue;
+                    }
 
-                if (fds_[i].fd == listen_sd_) {
                     do {
-                        auto new_socket = acceptNewSocket(listen_sd_);
+                        auto new_socket = acceptNewSocket(loop->listen_sd);
                         if (new_socket == NADJIEB_MJPEG_STREAMER_INVALID_SOCKET) {
+                            // EWOULDBLOCK also when another loop sharing the socket was faster
                             panicIfUnexpected(
                                 NADJIEB_MJPEG_STREAMER_ERRNO != NADJIEB_MJPEG_STREAMER_EWOULDBLOCK, "accept() failed");
                             break;
                         }
 
                         setSocketNonblock(new_socket);
+                        applySocketOptions(new_socket, options_);
 
-                        fds_.emplace_back(NADJIEB_MJPEG_STREAMER_POLLFD{new_socket, POLLRDNORM, 0});
+                        fds.emplace_back(NADJIEB_MJPEG_STREAMER_POLLFD{new_socket, POLLRDNORM, 0});
                     } while (true);
-                } else {
-                    std::string data;
-                    bool close_conn = false;
+                    continue;
+                }
 
-                    do {
-                        auto size = readFromSocket(fds_[i].fd, &buff[0], buff.size(), 0);
-                        if (size == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR) {
-                            if (NADJIEB_MJPEG_STREAMER_ERRNO != NADJIEB_MJPEG_STREAMER_EWOULDBLOCK) {
-                                std::cerr << "readFromSocket() failed" << std::endl;
-                                close_conn = true;
-                            }
-                            break;
-                        }
+                if ((fds[i].revents & POLLERR) && !(fds[i].revents & (POLLHUP | POLLNVAL)) && on_error_queue_cb_
+                    && getSocketError(fds[i].fd) == 0) {
+                    // Only notifications queued on the socket (zero-copy completions), the connection is fine
+                    on_error_queue_cb_(fds[i].fd);
+                    if (!(fds[i].revents & POLLRDNORM)) {
+                        continue;
+                    }
+                } else if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                    closeConnection(*loop, fds[i].fd);
+                    fds[i].fd = NADJIEB_MJPEG_STREAMER_INVALID_SOCKET;
+                    compress_array = true;
+                    continue;
+                }
 
-                        if (size == 0) {
+                std::string data;
+                bool close_conn = false;
+
+                do {
+                    auto size = readFromSocket(fds[i].fd, &buff[0], buff.size(), 0);
+                    if (size == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR) {
+                        if (NADJIEB_MJPEG_STREAMER_ERRNO != NADJIEB_MJPEG_STREAMER_EWOULDBLOCK) {
+                            // Mostly peers resetting the connection, which is routine
+                            UE_LOG(LogTemp, Verbose, TEXT("nadjieb::MJPEGStreamer: readFromSocket() failed"));
                             close_conn = true;
-                            break;
                         }
+                        break;
+                    }
 
-                        data += buff.substr(0, size);
-                    } while (true);
+                    if (size == 0) {
+                        close_conn = true;
+                        break;
+                    }
 
-                    if (!close_conn) {
-                        auto resp = on_message_cb_(fds_[i].fd, data);
-                        if (resp.close_conn) {
-                            close_conn = resp.close_conn;
-                        }
+                    data.append(buff, 0, size);
+                } while (true);
 
-                        if (resp.end_listener) {
-                            end_listener_ = resp.end_listener;
-                        }
-                    }
+                if (!close_conn) {
+                    close_conn = dispatch(*loop, fds[i].fd, data);
+                }
 
-                    if (close_conn) {
-                        on_before_close_cb_(fds_[i].fd);
-                        closeSocket(fds_[i].fd);
-                        fds_[i].fd = NADJIEB_MJPEG_STREAMER_INVALID_SOCKET;
-                        compress_array = true;
-                    }
+                if (close_conn) {
+                    closeConnection(*loop, fds[i].fd);
+                    fds[i].fd = NADJIEB_MJPEG_STREAMER_INVALID_SOCKET;
+                    compress_array = true;
                 }
             }
 
             if (compress_array) {
-                compress();
+                compress(fds);
             }
         }
 
-        closeAll();
+        closeAll(*loop);
     }
 
-   private:
-    SocketFD listen_sd_ = NADJIEB_MJPEG_STREAMER_INVALID_SOCKET;
-    bool end_listener_ = true;
-    std::vector<NADJIEB_MJPEG_STREAMER_POLLFD> fds_;
-    OnMessageCallback on_message_cb_;
-    OnBeforeCloseCallback on_before_close_cb_;
-    std::thread thread_listener_;
+    // Length of the first complete request in data (head plus Content-Length body), 0 if incomplete,
+    // INVALID_REQUEST_SIZE if its Content-Length exceeds LIMIT_REQUEST_SIZE
+    static size_t completeRequestSize(const std::string& data) {
+        auto head_end = data.find("\r\n\r\n");
+        if (head_end == std::string::npos) {
+            return 0;
+        }
+        head_end += 4;
+
+        size_t body_size = 0;
+        size_t line = data.find("\r\n") + 2;
+        while (line < head_end - 2) {
+            size_t line_end = data.find("\r\n", line);
+            const char content_length[] = "content-length:";
+            size_t name_size = sizeof(content_length) - 1;
+            if (line_end - line > name_size) {
+                bool match = true;
+                for (size_t k = 0; k < name_size && match; ++k) {
+                    match = std::tolower((unsigned char)data[line + k]) == content_length[k];
+                }
+                if (match) {
+                    // Bounded before it is added to head_end, a huge value would wrap around
+                    auto value = std::strtoull(data.c_str() + line + name_size, nullptr, 10);
+                    if (value > LIMIT_REQUEST_SIZE) {
+                        return INVALID_REQUEST_SIZE;
+                    }
+                    body_size = (size_t)value;
+                }
+            }
+            line = line_end + 2;
+        }
 
-    void compress() {
-        for (auto it = fds_.begin(); it != fds_.end();) {
-            if (it->fd == NADJIEB_MJPEG_STREAMER_INVALID_SOCKET) {
-                it = fds_.erase(it);
-            } else {
-                ++it;
+        return (data.size() >= head_end + body_size) ? head_end + body_size : 0;
+    }
+
+    // Hands data read from sockfd to the callback; returns true if the connection has to close
+    bool dispatch(EventLoop& loop, const SocketFD& sockfd, const std::string& data) {
+        auto& connection = loop.connections[sockfd];
+        if (connection.mode == ConnectionMode::DISCARD) {
+            return false;
+        }
+        if (connection.mode == ConnectionMode::PASSTHROUGH) {
+            return handle(sockfd, connection, data);
+        }
+
+        connection.pending += data;
+        while (connection.mode == ConnectionMode::REQUESTS) {
+            size_t request_size = completeRequestSize(connection.pending);
+            if (request_size == INVALID_REQUEST_SIZE) {
+                return true;
+            }
+            if (request_size == 0) {
+                return connection.pending.size() > LIMIT_REQUEST_SIZE;
+            }
+
+            std::string request = connection.pending.substr(0, request_size);
+            connection.pending.erase(0, request_size);
+            if (handle(sockfd, connection, request)) {
+                return true;
             }
         }
+
+        // Left HTTP halfway through the buffer: the rest already belongs to the new protocol
+        std::string rest;
+        rest.swap(connection.pending);
+        if (connection.mode == ConnectionMode::PASSTHROUGH && !rest.empty()) {
+            return handle(sockfd, connection, rest);
+        }
+        return false;
     }
 
-    void closeAll() {
-        state_ = nadjieb::utils::State::TERMINATING;
-        for (auto& pfd : fds_) {
-            if (pfd.fd >= 0) {
-                on_before_close_cb_(pfd.fd);
-                closeSocket(pfd.fd);
+    bool handle(const SocketFD& sockfd, Connection& connection, const std::string& message) {
+        auto resp = on_message_cb_(sockfd, message);
+        if (resp.end_listener) {
+            wakeAll();
+        }
+        connection.mode = resp.mode;
+        return resp.close_conn;
+    }
+
+    // Ends every loop; the other loops would otherwise sleep in poll until their next connection event
+    void wakeAll() {
+        end_listener_ = true;
+        for (auto& loop : loops_) {
+            if (loop->waker.isOpen()) {
+                loop->waker.wake();
             }
         }
+    }
 
-        fds_.clear();
-        destroySocket();
-        state_ = nadjieb::utils::State::TERMINATED;
+    void closeConnection(EventLoop& loop, SocketFD sockfd) {
+        loop.connections.erase(sockfd);
+        on_before_close_cb_(sockfd);
+        closeSocket(sockfd);
+    }
+
+    static void compress(std::vector<NADJIEB_MJPEG_STREAMER_POLLFD>& fds) {
+        fds.erase(
+            std::remove_if(
+                fds.begin(),
+                fds.end(),
+                [](const NADJIEB_MJPEG_STREAMER_POLLFD& pfd) { return pfd.fd == NADJIEB_MJPEG_STREAMER_INVALID_SOCKET; }),
+            fds.end());
+    }
+
+    // Runs on the loop's own thread as it exits; the last loop out terminates the listener
+    void closeAll(EventLoop& loop) {
+        state_ = nadjieb::utils::State::TERMINATING;
+        for (auto& pfd : loop.fds) {
+            if (pfd.fd != NADJIEB_MJPEG_STREAMER_INVALID_SOCKET && pfd.fd != loop.listen_sd && pfd.fd != loop.waker.fd()) {
+                closeConnection(loop, pfd.fd);
+            }
+        }
+        loop.connections.clear();
+        loop.fds.clear();
+
+        if (--running_loops_ == 0) {
+            // Shared sockets are owned by an earlier loop, so every loop is done with them by now
+            for (auto& other : loops_) {
+                if (other->owns_listen_sd) {
+                    closeSocket(other->listen_sd);
+                }
+            }
+            state_ = nadjieb::utils::State::TERMINATED;
+        }
     }
 
-    void panicIfUnexpected(bool condition, const std::string& message) {
+    bool panicIfUnexpected(bool condition, const std::string& message) {
         if (condition) {
-            closeAll();
             FString message_(message .c_str());
             UE_LOG(LogTemp, Error, TEXT("nadjieb::MJPEGStreamer: %s"), *message_);
             //throw std::runtime_error(message);
         }
+        return condition;
     }
 };
 }  // namespace net
@@ -583,29 +1660,88 @@ class Listener : public nadjieb::utils::NonCopyable, public nadjieb::utils::Runn
 
 // #include <nadjieb/net/socket.hpp>
 
+// #include <nadjieb/utils/memory_budget.hpp>
+
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <shared_mutex>
 #include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace nadjieb {
 namespace net {
+// How frames are framed on the wire for a client
+enum class Transport { MULTIPART, WEBSOCKET, FRAMED };
+
+// FRAMED transport: every frame is preceded by uint64 size, uint64 sequence and int64 timestamp (little endian)
+static const size_t FRAMED_HEADER_SIZE = 24;
+
+struct Client {
+    NADJIEB_MJPEG_STREAMER_POLLFD pfd;
+    Transport transport;
+};
+
+// Encoded frame plus the metadata consumers need (recording index, latency measurement)
+struct Frame {
+    std::string data;
+    uint64_t sequence = 0;
+    // Capture time, microseconds since the Unix epoch
+    int64_t timestamp_us = 0;
+};
+
+// Shared by the topic, every queued payload and every subscriber; never copied per client
+using FrameBuffer = std::shared_ptr<const Frame>;
+
+using FrameCallback = std::function<void(const FrameBuffer&)>;
+
+static int64_t nowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+// Wraps an encoded frame, charging its size to budget until the last reference is gone
+static FrameBuffer makeFrameBuffer(
+    std::string&& data,
+    uint64_t sequence,
+    int64_t timestamp_us,
+    nadjieb::utils::MemoryBudget* budget) {
+    size_t bytes = data.capacity() + sizeof(Frame);
+    if (budget != nullptr) {
+        budget->acquire(bytes);
+    }
+
+    auto* frame = new Frame{std::move(data), sequence, timestamp_us};
+    return FrameBuffer(frame, [budget, bytes](const Frame* frame) {
+        if (budget != nullptr) {
+            budget->release(bytes);
+        }
+        delete frame;
+    });
+}
+
 class Topic {
    public:
-    void setBuffer(const std::string& buffer) {
+    void setBuffer(const FrameBuffer& buffer) {
         std::unique_lock lock(buffer_mtx_);
         buffer_ = buffer;
     }
 
-    std::string getBuffer() {
+    FrameBuffer getBuffer() {
         std::shared_lock lock(buffer_mtx_);
         return buffer_;
     }
 
-    void addClient(const SocketFD& sockfd) {
+    void addClient(const SocketFD& sockfd, Transport transport = Transport::MULTIPART) {
         std::unique_lock client_lock(client_by_sockfd_mtx_);
-        client_by_sockfd_[sockfd] = NADJIEB_MJPEG_STREAMER_POLLFD{sockfd, POLLWRNORM, 0};
+        client_by_sockfd_[sockfd] = Client{NADJIEB_MJPEG_STREAMER_POLLFD{sockfd, POLLWRNORM, 0}, transport};
 
         std::unique_lock queue_size_lock(queue_size_by_sockfd__mtx_);
         queue_size_by_sockfd_[sockfd] = 0;
@@ -624,10 +1760,20 @@ class Topic {
         return !client_by_sockfd_.empty();
     }
 
-    std::vector<NADJIEB_MJPEG_STREAMER_POLLFD> getClients() {
+    bool findClient(const SocketFD& sockfd, Client& client) {
+        std::shared_lock lock(client_by_sockfd_mtx_);
+        auto it = client_by_sockfd_.find(sockfd);
+        if (it == client_by_sockfd_.end()) {
+            return false;
+        }
+        client = it->second;
+        return true;
+    }
+
+    std::vector<Client> getClients() {
         std::shared_lock lock(client_by_sockfd_mtx_);
 
-        std::vector<NADJIEB_MJPEG_STREAMER_POLLFD> clients;
+        std::vector<Client> clients;
         for (const auto& client : client_by_sockfd_) {
             clients.push_back(client.second);
         }
@@ -637,187 +1783,1832 @@ class Topic {
 
     int getQueueSize(const SocketFD& sockfd) {
         std::shared_lock queue_size_lock(queue_size_by_sockfd__mtx_);
-        return queue_size_by_sockfd_[sockfd];
+        auto it = queue_size_by_sockfd_.find(sockfd);
+        return (it != queue_size_by_sockfd_.end()) ? it->second : 0;
     }
 
     void increaseQueue(const SocketFD& sockfd) {
         std::unique_lock queue_size_lock(queue_size_by_sockfd__mtx_);
-        ++queue_size_by_sockfd_[sockfd];
+        auto it = queue_size_by_sockfd_.find(sockfd);
+        if (it != queue_size_by_sockfd_.end()) {
+            ++it->second;
+        }
     }
 
     void decreaseQueue(const SocketFD& sockfd) {
         std::unique_lock queue_size_lock(queue_size_by_sockfd__mtx_);
-        --queue_size_by_sockfd_[sockfd];
+        auto it = queue_size_by_sockfd_.find(sockfd);
+        if (it != queue_size_by_sockfd_.end()) {
+            --it->second;
+        }
+    }
+
+    uint64_t nextSequence() { return next_sequence_++; }
+
+    // For frames numbered by the caller; later nextSequence() calls continue after sequence
+    void useSequence(uint64_t sequence) {
+        uint64_t next = next_sequence_.load();
+        while (next <= sequence && !next_sequence_.compare_exchange_weak(next, sequence + 1)) {
+        }
+    }
+
+    // Non-empty for topics that carry something other than JPEG; their HTTP clients get the FRAMED transport
+    void setContentType(const std::string& content_type) {
+        std::unique_lock lock(content_type_mtx_);
+        content_type_ = content_type;
+    }
+
+    std::string getContentType() {
+        std::shared_lock lock(content_type_mtx_);
+        return content_type_;
+    }
+
+    // Frames of a delta-coded topic only make sense on top of the ones before (e.g. changed tiles).
+    // They are never thinned out to a lower frame rate, and every one a client loses anyway is counted
+    void setDeltaCoded(bool delta_coded) { delta_coded_ = delta_coded; }
+
+    bool isDeltaCoded() const { return delta_coded_; }
+
+    void onFrameLost() {
+        if (delta_coded_) {
+            ++lost_frames_;
+        }
+    }
+
+    uint64_t getLostFrames() const { return lost_frames_; }
+
+    // In-process consumers (e.g. the recorder) get every frame, independent of HTTP clients
+    void addSubscriber(int id, const FrameCallback& callback) {
+        std::unique_lock lock(subscribers_mtx_);
+        subscribers_.emplace_back(id, callback);
+    }
+
+    // Once this returns the callback is not running and will not be called again
+    void removeSubscriber(int id) {
+        std::unique_lock lock(subscribers_mtx_);
+        subscribers_.erase(
+            std::remove_if(
+                subscribers_.begin(), subscribers_.end(), [id](const auto& sub) { return sub.first == id; }),
+            subscribers_.end());
+    }
+
+    bool hasSubscriber() {
+        std::shared_lock lock(subscribers_mtx_);
+        return !subscribers_.empty();
+    }
+
+    void notifySubscribers(const FrameBuffer& buffer) {
+        std::shared_lock lock(subscribers_mtx_);
+        for (const auto& sub : subscribers_) {
+            sub.second(buffer);
+        }
     }
 
    private:
-    std::string buffer_;
+    FrameBuffer buffer_;
     std::shared_mutex buffer_mtx_;
 
-    std::unordered_map<SocketFD, NADJIEB_MJPEG_STREAMER_POLLFD> client_by_sockfd_;
+    std::unordered_map<SocketFD, Client> client_by_sockfd_;
     std::shared_mutex client_by_sockfd_mtx_;
 
     std::unordered_map<SocketFD, int> queue_size_by_sockfd_;
     std::shared_mutex queue_size_by_sockfd__mtx_;
+
+    std::atomic<uint64_t> next_sequence_{0};
+
+    std::string content_type_;
+    std::shared_mutex content_type_mtx_;
+
+    std::atomic<bool> delta_coded_{false};
+    std::atomic<uint64_t> lost_frames_{0};
+
+    std::vector<std::pair<int, FrameCallback>> subscribers_;
+    std::shared_mutex subscribers_mtx_;
 };
 }  // namespace net
 }  // namespace nadjieb
 
-// #include <nadjieb/utils/non_copyable.hpp>
-
-// #include <nadjieb/utils/runnable.hpp>
+// #include <nadjieb/net/client_health.hpp>
 
+// #include <nadjieb/net/socket.hpp>
 
-#include <algorithm>
-#include <condition_variable>
+#include <chrono>
+#include <deque>
 #include <mutex>
-#include <queue>
 #include <string>
-#include <thread>
 #include <unordered_map>
-#include <utility>
 #include <vector>
 
 namespace nadjieb {
 namespace net {
-class Publisher : public nadjieb::utils::NonCopyable, public nadjieb::utils::Runnable {
-   public:
-    virtual ~Publisher() { stop(); }
+// What the publisher does about a client that skips frames because it cannot keep up
+struct SlowClientPolicy {
+    enum class Action {
+        // Only skip the frames the client has no room for
+        NONE,
+        // Deliver every 2nd frame, then every 4th, ... for each grace period the client stays behind
+        REDUCE_FPS,
+        // Move the client to a half resolution rendition of its stream, see Publisher::setDowngradeResolver.
+        // Streams without one fall back to REDUCE_FPS.
+        DOWNGRADE
+    };
 
-    void start(int num_workers = std::thread::hardware_concurrency()) {
-        state_ = nadjieb::utils::State::BOOTING;
-        end_publisher_ = false;
-        workers_.reserve(num_workers);
-        for (auto i = 0; i < num_workers; ++i) {
-            workers_.emplace_back(&Publisher::worker, this);
-        }
-        state_ = nadjieb::utils::State::RUNNING;
-    }
+    Action action = Action::NONE;
+    // How long a client is behind before the action is taken, and between further steps
+    long grace_ms = 2000;
+    // A client that skipped nothing for this long has caught up; REDUCE_FPS steps back up at this pace
+    long recovery_ms = 3000;
+    // REDUCE_FPS never delivers less than every max_frame_interval-th frame
+    int max_frame_interval = 8;
+    // Disconnect clients still behind after this long, whatever the action; 0 = never
+    long disconnect_after_ms = 0;
+};
 
-    void stop() {
-        state_ = nadjieb::utils::State::TERMINATING;
-        end_publisher_ = true;
-        condition_.notify_all();
+struct ClientStats {
+    SocketFD sockfd = NADJIEB_MJPEG_STREAMER_INVALID_SOCKET;
+    // Remote "address:port"
+    std::string peer;
+    // Path (or region topic) the client currently receives
+    std::string topic;
+    uint64_t delivered_frames = 0;
+    uint64_t skipped_frames = 0;
+    uint64_t bytes_sent = 0;
+    // Bytes per second, averaged over the last few seconds
+    double throughput = 0;
+    // Since when the client is skipping frames, 0 while it keeps up
+    long behind_ms = 0;
+    // Every frame_interval-th frame of the topic is delivered
+    int frame_interval = 1;
+    bool downgraded = false;
+};
 
-        if (!workers_.empty()) {
-            for (auto& w : workers_) {
-                if (w.joinable()) {
-                    w.join();
-                }
-            }
-            workers_.clear();
-        }
+enum class ClientEventType { BEHIND, REDUCED_FPS, DOWNGRADED, RECOVERED, DISCONNECTED };
 
-        topics_.clear();
-        path_by_client_.clear();
+struct ClientEvent {
+    ClientEventType type;
+    ClientStats stats;
+};
 
-        while (!payloads_.empty()) {
-            payloads_.pop();
-        }
-        state_ = nadjieb::utils::State::TERMINATED;
+// Delivery accounting and SlowClientPolicy state of every client. The publisher reports each
+// delivered and skipped frame and carries out the step onSkipped() decides on.
+class ClientHealth {
+   public:
+    enum class Step { NONE, DOWNGRADE, DISCONNECT };
+
+    void setPolicy(const SlowClientPolicy& policy) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        policy_ = policy;
+    }
+
+    void add(const SocketFD& sockfd, const std::string& topic) {
+        State state;
+        state.stats.sockfd = sockfd;
+        state.stats.peer = getPeerName(sockfd);
+        state.stats.topic = topic;
+        state.window_start = Clock::now();
+
+        std::unique_lock<std::mutex> lock(mtx_);
+        states_[sockfd] = std::move(state);
+    }
+
+    void remove(const SocketFD& sockfd) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        states_.erase(sockfd);
+    }
+
+    void clear() {
+        std::unique_lock<std::mutex> lock(mtx_);
+        states_.clear();
+        events_.clear();
+    }
+
+    // False for frames left out to reduce the client's FPS
+    bool wants(const SocketFD& sockfd, uint64_t sequence) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        auto it = states_.find(sockfd);
+        return it == states_.end() || sequence % (uint64_t)it->second.stats.frame_interval == 0;
+    }
+
+    void onDelivered(const SocketFD& sockfd, size_t bytes) {
+        auto now = Clock::now();
+        std::unique_lock<std::mutex> lock(mtx_);
+        auto it = states_.find(sockfd);
+        if (it == states_.end()) {
+            return;
+        }
+
+        auto& state = it->second;
+        ++state.stats.delivered_frames;
+        state.stats.bytes_sent += bytes;
+        state.window_bytes += bytes;
+        updateThroughput(state, now);
+
+        if (elapsedMs(state.last_skip, now) < policy_.recovery_ms
+            || elapsedMs(state.last_step, now) < policy_.recovery_ms) {
+            return;
+        }
+        if (state.behind) {
+            state.behind = false;
+            state.last_step = now;
+            pushEvent(ClientEventType::RECOVERED, state, now);
+        }
+        if (state.stats.frame_interval > 1) {
+            state.stats.frame_interval /= 2;
+            state.last_step = now;
+        }
+    }
+
+    Step onSkipped(const SocketFD& sockfd) {
+        auto now = Clock::now();
+        std::unique_lock<std::mutex> lock(mtx_);
+        auto it = states_.find(sockfd);
+        if (it == states_.end()) {
+            return Step::NONE;
+        }
+
+        auto& state = it->second;
+        ++state.stats.skipped_frames;
+        state.last_skip = now;
+        updateThroughput(state, now);
+
+        if (!state.behind) {
+            state.behind = true;
+            state.behind_since = now;
+            state.last_step = now;
+            pushEvent(ClientEventType::BEHIND, state, now);
+            return Step::NONE;
+        }
+
+        if (policy_.disconnect_after_ms > 0 && elapsedMs(state.behind_since, now) >= policy_.disconnect_after_ms) {
+            if (!state.disconnecting) {
+                state.disconnecting = true;
+                pushEvent(ClientEventType::DISCONNECTED, state, now);
+                return Step::DISCONNECT;
+            }
+            return Step::NONE;
+        }
+
+        if (policy_.action == SlowClientPolicy::Action::NONE || elapsedMs(state.last_step, now) < policy_.grace_ms) {
+            return Step::NONE;
+        }
+        state.last_step = now;
+
+        if (policy_.action == SlowClientPolicy::Action::DOWNGRADE && !state.stats.downgraded) {
+            return Step::DOWNGRADE;
+        }
+        reduceFps(state, now);
+        return Step::NONE;
+    }
+
+    // Outcome of Step::DOWNGRADE: the client now receives topic, or (empty) it could not be moved
+    void onDowngraded(const SocketFD& sockfd, const std::string& topic) {
+        auto now = Clock::now();
+        std::unique_lock<std::mutex> lock(mtx_);
+        auto it = states_.find(sockfd);
+        if (it == states_.end()) {
+            return;
+        }
+
+        auto& state = it->second;
+        if (topic.empty()) {
+            reduceFps(state, now);
+            return;
+        }
+        state.stats.topic = topic;
+        state.stats.downgraded = true;
+        pushEvent(ClientEventType::DOWNGRADED, state, now);
+    }
+
+    std::vector<ClientStats> getStats() {
+        auto now = Clock::now();
+        std::vector<ClientStats> stats;
+        std::unique_lock<std::mutex> lock(mtx_);
+        stats.reserve(states_.size());
+        for (auto& state : states_) {
+            stats.push_back(snapshot(state.second, now));
+        }
+        return stats;
+    }
+
+    // Events since the last call, oldest first
+    std::vector<ClientEvent> takeEvents() {
+        std::unique_lock<std::mutex> lock(mtx_);
+        std::vector<ClientEvent> events(
+            std::make_move_iterator(events_.begin()), std::make_move_iterator(events_.end()));
+        events_.clear();
+        return events;
+    }
+
+   private:
+    using Clock = std::chrono::steady_clock;
+
+    struct State {
+        ClientStats stats;
+        bool behind = false;
+        bool disconnecting = false;
+        Clock::time_point behind_since;
+        Clock::time_point last_skip;
+        // Last policy step (or start of being behind); steps are at least a grace period apart
+        Clock::time_point last_step;
+        Clock::time_point window_start;
+        uint64_t window_bytes = 0;
+    };
+
+    SlowClientPolicy policy_;
+    std::unordered_map<SocketFD, State> states_;
+    std::deque<ClientEvent> events_;
+    std::mutex mtx_;
+
+    // Events nobody collects are dropped, oldest first
+    const static size_t LIMIT_EVENTS = 256;
+    const static long THROUGHPUT_WINDOW_MS = 1000;
+
+    static long elapsedMs(Clock::time_point since, Clock::time_point now) {
+        return (long)std::chrono::duration_cast<std::chrono::milliseconds>(now - since).count();
+    }
+
+    static void updateThroughput(State& state, Clock::time_point now) {
+        long elapsed = elapsedMs(state.window_start, now);
+        if (elapsed < THROUGHPUT_WINDOW_MS) {
+            return;
+        }
+        double current = (double)state.window_bytes * 1000.0 / (double)elapsed;
+        state.stats.throughput = (state.stats.throughput == 0) ? current : (state.stats.throughput + current) / 2;
+        state.window_bytes = 0;
+        state.window_start = now;
+    }
+
+    void reduceFps(State& state, Clock::time_point now) {
+        if (state.stats.frame_interval >= policy_.max_frame_interval) {
+            return;
+        }
+        state.stats.frame_interval = std::min(state.stats.frame_interval * 2, policy_.max_frame_interval);
+        pushEvent(ClientEventType::REDUCED_FPS, state, now);
+    }
+
+    static ClientStats snapshot(const State& state, Clock::time_point now) {
+        ClientStats stats = state.stats;
+        stats.behind_ms = state.behind ? std::max(elapsedMs(state.behind_since, now), 1L) : 0;
+        return stats;
+    }
+
+    void pushEvent(ClientEventType type, const State& state, Clock::time_point now) {
+        if (events_.size() >= LIMIT_EVENTS) {
+            events_.pop_front();
+        }
+        events_.push_back(ClientEvent{type, snapshot(state, now)});
+    }
+};
+}  // namespace net
+}  // namespace nadjieb
+
+// #include <nadjieb/net/load_shedder.hpp>
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace nadjieb {
+namespace net {
+// Limits on stream clients and on the load they cause; 0 disables a limit
+struct AdmissionPolicy {
+    // Stream clients (HTTP and WebSocket) of the whole server
+    size_t max_clients = 0;
+    // Stream clients of one path, its regions and lower renditions included
+    size_t max_clients_per_path = 0;
+    // Sent as Retry-After with the 503 that turns a client away
+    int retry_after_s = 5;
+    // Bytes per second sent to all clients together
+    double max_bandwidth = 0;
+    // Host CPU load (0..1), as reported through LoadShedder::reportCpuLoad()
+    double max_cpu_load = 0;
+    // Shedding delivers every 2nd, 4th, ... frame to all clients, at most every max_frame_interval-th.
+    // Only while it is there and the load is still too high are new clients turned away
+    int max_frame_interval = 8;
+    // The load is measured over this long, and shedding takes at most one step per period
+    long interval_ms = 1000;
+};
+
+enum class Admission { ADMITTED, SERVER_FULL, PATH_FULL, OVERLOADED };
+
+struct AdmissionStats {
+    // Every frame_interval-th frame is delivered to clients
+    int frame_interval = 1;
+    // New clients are turned away for load
+    bool overloaded = false;
+    // Bytes per second sent during the last period
+    double bandwidth = 0;
+    double cpu_load = 0;
+    uint64_t rejected_clients = 0;
+};
+
+// Lowers the frame rate of all clients while bandwidth or CPU load exceed the AdmissionPolicy: above the
+// limits the interval between delivered frames doubles once per period, below 3/4 of them it halves again.
+// Local subscribers (recorder, RTP, shared memory) always get every frame.
+class LoadShedder {
+   public:
+    void setPolicy(const AdmissionPolicy& policy) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        policy_ = policy;
+        policy_.max_frame_interval = std::max(policy_.max_frame_interval, 1);
+        frame_interval_ = std::min(frame_interval_.load(), policy_.max_frame_interval);
+    }
+
+    AdmissionPolicy getPolicy() {
+        std::unique_lock<std::mutex> lock(mtx_);
+        return policy_;
+    }
+
+    void reportCpuLoad(double load) { cpu_load_ = load; }
+
+    void onSent(size_t bytes) { window_bytes_ += bytes; }
+
+    void onRejected() { ++rejected_; }
+
+    // False for frames left out of every client's stream
+    bool wants(uint64_t sequence) const { return sequence % (uint64_t)frame_interval_.load() == 0; }
+
+    bool isOverloaded() const { return overloaded_; }
+
+    // Called for every published frame; takes a step once per period
+    void update() {
+        auto now = Clock::now();
+        std::unique_lock<std::mutex> lock(mtx_, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            return;
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - window_start_).count();
+        if (elapsed < std::max(policy_.interval_ms, 1L)) {
+            return;
+        }
+
+        bandwidth_ = (double)window_bytes_.exchange(0) * 1000.0 / (double)elapsed;
+        window_start_ = now;
+
+        double load = 0;
+        if (policy_.max_bandwidth > 0) {
+            load = std::max(load, bandwidth_.load() / policy_.max_bandwidth);
+        }
+        if (policy_.max_cpu_load > 0) {
+            load = std::max(load, cpu_load_.load() / policy_.max_cpu_load);
+        }
+
+        int interval = frame_interval_;
+        if (load > 1.0) {
+            if (interval < policy_.max_frame_interval) {
+                frame_interval_ = std::min(interval * 2, policy_.max_frame_interval);
+            } else {
+                overloaded_ = true;
+            }
+        } else if (load < 0.75) {
+            overloaded_ = false;
+            if (interval > 1) {
+                frame_interval_ = interval / 2;
+            }
+        }
+    }
+
+    AdmissionStats getStats() const {
+        AdmissionStats stats;
+        stats.frame_interval = frame_interval_;
+        stats.overloaded = overloaded_;
+        stats.bandwidth = bandwidth_;
+        stats.cpu_load = cpu_load_;
+        stats.rejected_clients = rejected_;
+        return stats;
+    }
+
+    void clear() {
+        std::unique_lock<std::mutex> lock(mtx_);
+        frame_interval_ = 1;
+        overloaded_ = false;
+        window_bytes_ = 0;
+        window_start_ = Clock::now();
+    }
+
+   private:
+    using Clock = std::chrono::steady_clock;
+
+    AdmissionPolicy policy_;
+    std::atomic<int> frame_interval_{1};
+    std::atomic<bool> overloaded_{false};
+    std::atomic<double> bandwidth_{0};
+    std::atomic<double> cpu_load_{0};
+    std::atomic<uint64_t> window_bytes_{0};
+    std::atomic<uint64_t> rejected_{0};
+    Clock::time_point window_start_ = Clock::now();
+    // Guards policy_ and window_start_
+    std::mutex mtx_;
+};
+}  // namespace net
+}  // namespace nadjieb
+
+// #include <nadjieb/net/uring.hpp>
+
+
+#if defined NADJIEB_MJPEG_STREAMER_PLATFORM_LINUX && defined __has_include
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+// Kernel headers of 5.11 or later
+#ifdef IORING_FEAT_EXT_ARG
+#define NADJIEB_MJPEG_STREAMER_HAS_IO_URING
+#endif
+#endif
+#endif
+
+#ifdef NADJIEB_MJPEG_STREAMER_HAS_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+namespace nadjieb {
+namespace net {
+// Minimal io_uring submission/completion ring over the raw syscalls (no liburing), so the plugin
+// builds with toolchains that do not ship it. Without kernel headers for io_uring, or on other
+// platforms, init() fails and callers keep using poll.
+class Ring {
+   public:
+    Ring() = default;
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+    ~Ring() { close(); }
+
+#ifdef NADJIEB_MJPEG_STREAMER_HAS_IO_URING
+    bool init(unsigned entries) {
+        close();
+
+        struct io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        int fd = (int)::syscall(__NR_io_uring_setup, entries, &params);
+        if (fd < 0) {
+            return false;
+        }
+        // Timed waits (5.11) and no dropped completions (5.5) keep the send loop simple
+        if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP)) {
+            ::close(fd);
+            return false;
+        }
+        ring_fd_ = fd;
+
+        sq_map_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_map_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) {
+            sq_map_size_ = cq_map_size_ = std::max(sq_map_size_, cq_map_size_);
+        }
+
+        sq_map_ = ::mmap(nullptr, sq_map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        cq_map_ = single_mmap ? sq_map_
+                              : ::mmap(
+                                  nullptr, cq_map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                  IORING_OFF_CQ_RING);
+        sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+        sqes_ = (struct io_uring_sqe*)::mmap(
+            nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sq_map_ == MAP_FAILED || cq_map_ == MAP_FAILED || sqes_ == MAP_FAILED) {
+            close();
+            return false;
+        }
+
+        auto* sq = (char*)sq_map_;
+        sq_head_ = (std::atomic<unsigned>*)(sq + params.sq_off.head);
+        sq_tail_ = (std::atomic<unsigned>*)(sq + params.sq_off.tail);
+        sq_mask_ = *(unsigned*)(sq + params.sq_off.ring_mask);
+        sq_entries_ = params.sq_entries;
+        sq_array_ = (unsigned*)(sq + params.sq_off.array);
+
+        auto* cq = (char*)cq_map_;
+        cq_head_ = (std::atomic<unsigned>*)(cq + params.cq_off.head);
+        cq_tail_ = (std::atomic<unsigned>*)(cq + params.cq_off.tail);
+        cq_mask_ = *(unsigned*)(cq + params.cq_off.ring_mask);
+        cqes_ = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+        local_tail_ = sq_tail_->load(std::memory_order_relaxed);
+        return true;
+    }
+
+    void close() {
+        if (sqes_ != nullptr && sqes_ != MAP_FAILED) {
+            ::munmap(sqes_, sqes_size_);
+        }
+        if (cq_map_ != nullptr && cq_map_ != MAP_FAILED && cq_map_ != sq_map_) {
+            ::munmap(cq_map_, cq_map_size_);
+        }
+        if (sq_map_ != nullptr && sq_map_ != MAP_FAILED) {
+            ::munmap(sq_map_, sq_map_size_);
+        }
+        sqes_ = nullptr;
+        cq_map_ = sq_map_ = nullptr;
+        if (ring_fd_ >= 0) {
+            ::close(ring_fd_);
+            ring_fd_ = -1;
+        }
+    }
+
+    bool isOpen() const { return ring_fd_ >= 0; }
+
+    // Zeroed entry to fill in, or nullptr when the submission queue is full (submit first)
+    struct io_uring_sqe* getSqe() {
+        unsigned head = sq_head_->load(std::memory_order_acquire);
+        if (local_tail_ - head >= sq_entries_) {
+            return nullptr;
+        }
+        unsigned index = local_tail_ & sq_mask_;
+        auto* sqe = &sqes_[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sq_array_[index] = index;
+        ++local_tail_;
+        return sqe;
+    }
+
+    // Submits everything queued by getSqe() and waits up to timeout_ms for at least min_complete
+    // completions. One syscall for the whole batch; returns false on errors other than a timeout.
+    bool submitAndWait(unsigned min_complete, long timeout_ms) {
+        unsigned to_submit = local_tail_ - sq_tail_->load(std::memory_order_relaxed);
+        sq_tail_->store(local_tail_, std::memory_order_release);
+
+        struct __kernel_timespec ts;
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+        struct io_uring_getevents_arg arg;
+        std::memset(&arg, 0, sizeof(arg));
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+
+        unsigned flags = IORING_ENTER_EXT_ARG | (min_complete > 0 ? IORING_ENTER_GETEVENTS : 0);
+        int res = (int)::syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, &arg, sizeof(arg));
+        return res >= 0 || errno == ETIME || errno == EINTR || errno == EBUSY;
+    }
+
+    // Calls on_complete(user_data, res) for every completion available, returns how many
+    template <typename F>
+    unsigned drain(F&& on_complete) {
+        unsigned head = cq_head_->load(std::memory_order_relaxed);
+        unsigned tail = cq_tail_->load(std::memory_order_acquire);
+        unsigned count = 0;
+        for (; head != tail; ++head, ++count) {
+            const auto& cqe = cqes_[head & cq_mask_];
+            on_complete(cqe.user_data, cqe.res);
+        }
+        cq_head_->store(head, std::memory_order_release);
+        return count;
+    }
+
+    // Probes once per process whether the running kernel lets us create a usable ring
+    static bool isSupported() {
+        static const bool supported = []() {
+            Ring ring;
+            return ring.init(2);
+        }();
+        return supported;
+    }
+
+   private:
+    int ring_fd_ = -1;
+    void* sq_map_ = nullptr;
+    void* cq_map_ = nullptr;
+    size_t sq_map_size_ = 0;
+    size_t cq_map_size_ = 0;
+    struct io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    std::atomic<unsigned>* sq_head_ = nullptr;
+    std::atomic<unsigned>* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned local_tail_ = 0;
+
+    std::atomic<unsigned>* cq_head_ = nullptr;
+    std::atomic<unsigned>* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    struct io_uring_cqe* cqes_ = nullptr;
+#else
+    bool init(unsigned) { return false; }
+    void close() {}
+    bool isOpen() const { return false; }
+    static bool isSupported() { return false; }
+#endif
+};
+}  // namespace net
+}  // namespace nadjieb
+
+// #include <nadjieb/utils/non_copyable.hpp>
+
+// #include <nadjieb/utils/runnable.hpp>
+
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace nadjieb {
+namespace net {
+// How workers write frames to clients
+enum class SendBackend {
+    // poll() for writability, then one sendmsg() per client and frame
+    POLL,
+    // Sends to up to URING_BATCH clients per worker share io_uring_enter() calls; falls back to POLL
+    // when the kernel (5.11+) or the build lacks io_uring
+    IO_URING
+};
+
+class Publisher : public nadjieb::utils::NonCopyable, public nadjieb::utils::Runnable {
+   public:
+    virtual ~Publisher() { stop(); }
+
+    // Takes effect on the next start()
+    void setSendBackend(SendBackend backend) { requested_backend_ = backend; }
+
+    // Name, affinity and priority of the worker threads and how they are started. Takes effect on the next start()
+    void setThreads(const nadjieb::utils::ThreadPlacement& placement, const nadjieb::utils::ThreadFactory& factory) {
+        placement_ = placement;
+        thread_factory_ = factory;
+    }
+
+    // The backend workers actually use, after any fallback
+    SendBackend getSendBackend() const { return backend_; }
+
+    // Frames of at least bytes go out with MSG_ZEROCOPY (Linux 4.14+, POLL backend): the kernel sends
+    // straight from the shared frame, which stays referenced until the completion arrives. 0 disables.
+    void setZeroCopyThreshold(size_t bytes) { zerocopy_threshold_ = bytes; }
+
+    struct ZeroCopyStats {
+        // Send calls that went out with MSG_ZEROCOPY
+        uint64_t sends = 0;
+        // Of those, completed by the kernel
+        uint64_t completed = 0;
+        // Of those, where the kernel copied after all (loopback, devices without scatter-gather)
+        uint64_t copied = 0;
+    };
+
+    ZeroCopyStats getZeroCopyStats() const {
+        ZeroCopyStats stats;
+        stats.sends = zerocopy_sends_;
+        stats.completed = zerocopy_completed_;
+        stats.copied = zerocopy_copied_;
+        return stats;
+    }
+
+    void setSlowClientPolicy(const SlowClientPolicy& policy) { health_.setPolicy(policy); }
+
+    // Maps a topic to a lower rendition topic for SlowClientPolicy::Action::DOWNGRADE, or to an empty
+    // string if there is none. Called from publishing and worker threads.
+    void setDowngradeResolver(const std::function<std::string(const std::string&)>& resolver) {
+        std::unique_lock<std::mutex> lock(downgrade_resolver_mtx_);
+        downgrade_resolver_ = resolver;
+    }
+
+    std::vector<ClientStats> getClientStats() { return health_.getStats(); }
+
+    // Slow client events since the last call, oldest first
+    std::vector<ClientEvent> takeClientEvents() { return health_.takeEvents(); }
+
+    // Workers are started on demand, when a payload is queued and none is idle, up to num_workers.
+    // A server nobody watches runs no worker threads at all.
+    void start(int num_workers = std::thread::hardware_concurrency()) {
+        state_ = nadjieb::utils::State::BOOTING;
+        backend_ = requested_backend_;
+        if (backend_ == SendBackend::IO_URING && !Ring::isSupported()) {
+            UE_LOG(LogTemp, Warning, TEXT("nadjieb::MJPEGStreamer: io_uring unavailable, sending with poll"));
+            backend_ = SendBackend::POLL;
+        }
+        std::unique_lock<std::mutex> payloads_lock(payloads_mtx_);
+        end_publisher_ = false;
+        max_workers_ = std::max(num_workers, 1);
+        idle_workers_ = 0;
+        active_thread_factory_ = thread_factory_ ? thread_factory_ : nadjieb::utils::StdThread::create;
+        workers_.reserve(max_workers_);
+        state_ = nadjieb::utils::State::RUNNING;
+    }
+
+    // First half of stop(): ends the workers, after which nothing sends anymore. Clients are neither
+    // added nor removed from here on, so the listener may close the sockets while this runs and after it
+    void stopWorkers() {
+        state_ = nadjieb::utils::State::TERMINATING;
+        {
+            std::unique_lock<std::mutex> payloads_lock(payloads_mtx_);
+            end_publisher_ = true;
+        }
+        condition_.notify_all();
+        {
+            // A worker stuck sending to a stalled client would hold up the join for SEND_TIMEOUT_MS.
+            // The sockets stay open; the listener closes them as it stops.
+            std::unique_lock<std::mutex> lock(path_by_client_mtx_);
+            for (const auto& client : path_by_client_) {
+                shutdownSocket(client.first);
+            }
+        }
+
+        // No worker is started once end_publisher_ is set, so workers_ does not change anymore.
+        // The /shutdown handler and stop() may get here at the same time, only one joins
+        std::unique_lock<std::mutex> join_lock(join_mtx_);
+        if (!workers_.empty()) {
+            for (auto& w : workers_) {
+                w->join();
+            }
+            workers_.clear();
+        }
+    }
+
+    // Call after the listener stopped (see MJPEGStreamer::stop), so no loop touches the state cleared here
+    void stop() {
+        stopWorkers();
+
+        {
+            std::unique_lock<std::mutex> payloads_lock(payloads_mtx_);
+            payloads_.clear();
+            busy_clients_.clear();
+        }
+        {
+            std::unique_lock topics_lock(topics_mtx_);
+            topics_.clear();
+        }
+        {
+            std::unique_lock<std::mutex> lock(path_by_client_mtx_);
+            path_by_client_.clear();
+            clients_by_path_.clear();
+            joins_by_path_.clear();
+        }
+        shedder_.clear();
+        {
+            std::unique_lock<std::mutex> lock(path_by_subscriber_mtx_);
+            path_by_subscriber_.clear();
+        }
+        {
+            std::unique_lock<std::mutex> lock(zerocopy_mtx_);
+            zerocopy_sockets_.clear();
+        }
+        health_.clear();
+
+        state_ = nadjieb::utils::State::TERMINATED;
+    }
+
+    // Frames enqueued after this call are charged to budget; oldest payloads are dropped when it is exceeded
+    void setMemoryBudget(nadjieb::utils::MemoryBudget* budget) { memory_budget_ = budget; }
+
+    void setAdmissionPolicy(const AdmissionPolicy& policy) { shedder_.setPolicy(policy); }
+
+    AdmissionPolicy getAdmissionPolicy() { return shedder_.getPolicy(); }
+
+    // Host CPU load (0..1) for AdmissionPolicy::max_cpu_load
+    void reportCpuLoad(double load) { shedder_.reportCpuLoad(load); }
+
+    AdmissionStats getAdmissionStats() { return shedder_.getStats(); }
+
+    // Reserves a place for a new client of path (a topic) before its response is sent, so concurrent
+    // listener loops cannot exceed the caps; add() takes the place, removeClient() frees it
+    Admission admit(const SocketFD& sockfd, const std::string& path) {
+        if (end_publisher_) {
+            return Admission::OVERLOADED;
+        }
+
+        auto policy = shedder_.getPolicy();
+        auto base = path.substr(0, path.find('?'));
+
+        std::unique_lock<std::mutex> lock(path_by_client_mtx_);
+        Admission admission = Admission::ADMITTED;
+        if (policy.max_clients > 0 && path_by_client_.size() >= policy.max_clients) {
+            admission = Admission::SERVER_FULL;
+        } else if (policy.max_clients_per_path > 0 && clients_by_path_[base] >= policy.max_clients_per_path) {
+            admission = Admission::PATH_FULL;
+        } else if (shedder_.isOverloaded()) {
+            admission = Admission::OVERLOADED;
+        }
+        if (admission != Admission::ADMITTED) {
+            shedder_.onRejected();
+            return admission;
+        }
+
+        reserve(sockfd, path);
+        return admission;
+    }
+
+    void add(const SocketFD& sockfd, const std::string& path, Transport transport = Transport::MULTIPART) {
+        if (end_publisher_) {
+            return;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(path_by_client_mtx_);
+            if (path_by_client_.find(sockfd) == path_by_client_.end()) {
+                reserve(sockfd, path);
+            }
+        }
+
+        getTopic(path)->addClient(sockfd, transport);
+        health_.add(sockfd, path);
+
+        // Counted once the client is in the topic, so a key frame sent for this join reaches it
+        std::unique_lock<std::mutex> lock(path_by_client_mtx_);
+        ++joins_by_path_[path.substr(0, path.find('?'))];
+    }
+
+    // Stream clients of the whole server, admitted ones included
+    size_t getClientCount() {
+        std::unique_lock<std::mutex> lock(path_by_client_mtx_);
+        return path_by_client_.size();
+    }
+
+    // Clients that started receiving path since start(); grows with every join, whoever left meanwhile.
+    // Producers of delta-coded streams send a full frame when it changes
+    uint64_t getJoinCount(const std::string& path) {
+        std::unique_lock<std::mutex> lock(path_by_client_mtx_);
+        auto it = joins_by_path_.find(path);
+        return it == joins_by_path_.end() ? 0 : it->second;
+    }
+
+    // Declares path as a framed binary stream; the path exists from now on, even before the first frame
+    void setContentType(const std::string& path, const std::string& content_type) {
+        getTopic(path)->setContentType(content_type);
+    }
+
+    // See Topic::setDeltaCoded()
+    void setDeltaCoded(const std::string& path) { getTopic(path)->setDeltaCoded(true); }
+
+    // Frames of a delta-coded path that some client lost (full queue, memory budget, unwritable client).
+    // Producers send a full frame when it changes
+    uint64_t getLostFrameCount(const std::string& path) { return getTopic(path)->getLostFrames(); }
+
+    std::string getContentType(const std::string& path) { return getTopic(path)->getContentType(); }
+
+    bool pathExists(const std::string& path) {
+        std::shared_lock topics_lock(topics_mtx_);
+        return (topics_.find(path) != topics_.end());
+    }
+
+    void removeClient(const SocketFD& sockfd) {
+        // Stopping: stop() drops every client at once
+        if (end_publisher_) {
+            return;
+        }
+
+        forgetZeroCopy(sockfd);
+        health_.remove(sockfd);
+
+        std::unique_lock<std::mutex> lock(path_by_client_mtx_);
+        auto it = path_by_client_.find(sockfd);
+        if (it == path_by_client_.end()) {
+            return;
+        }
+
+        getTopic(it->second)->removeClient(sockfd);
+
+        auto count = clients_by_path_.find(it->second.substr(0, it->second.find('?')));
+        if (count != clients_by_path_.end() && --count->second == 0) {
+            clients_by_path_.erase(count);
+        }
+        path_by_client_.erase(it);
+    }
+
+    // Reads zero-copy completions queued on sockfd and releases the frames the kernel is done with
+    void reapZeroCopy(const SocketFD& sockfd) {
+#ifdef NADJIEB_MJPEG_STREAMER_HAS_ZEROCOPY
+        std::vector<ZeroCopyPending> released;
+        while (true) {
+            char control[128];
+            struct msghdr msg = {};
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            if (::recvmsg(sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+                break;
+            }
+
+            for (auto* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                bool is_recverr = (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+                                  || (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR);
+                if (!is_recverr) {
+                    continue;
+                }
+                struct sock_extended_err err;
+                std::memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+                if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0) {
+                    continue;
+                }
+
+                // Completions cover the id range [ee_info, ee_data], in send order
+                uint32_t last_id = err.ee_data;
+                uint32_t count = err.ee_data - err.ee_info + 1;
+                zerocopy_completed_ += count;
+                if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                    zerocopy_copied_ += count;
+                }
+
+                std::unique_lock<std::mutex> lock(zerocopy_mtx_);
+                auto it = zerocopy_sockets_.find(sockfd);
+                if (it == zerocopy_sockets_.end()) {
+                    continue;
+                }
+                if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                    // Pinning pages only to be copied anyway costs more than a plain send: stop on this socket
+                    it->second.enabled = false;
+                }
+                auto& pending = it->second.pending;
+                while (!pending.empty() && (int32_t)(last_id - pending.front().last_id) >= 0) {
+                    released.push_back(std::move(pending.front()));
+                    pending.pop_front();
+                }
+            }
+        }
+        // Frames (and their budget) are freed here, outside the lock
+        released.clear();
+#else
+        (void)sockfd;
+#endif
+    }
+
+    // timestamp_us is the capture time; 0 means now
+    void enqueue(const std::string& path, std::string&& buffer, int64_t timestamp_us = 0) {
+        if (end_publisher_) {
+            return;
+        }
+
+        auto topic = getTopic(path);
+        enqueue(
+            path,
+            makeFrameBuffer(
+                std::move(buffer), topic->nextSequence(), (timestamp_us != 0) ? timestamp_us : nowMicros(),
+                memory_budget_));
+    }
+
+    // Frames published with the same sequence on several paths belong together (e.g. cameras of one capture)
+    void enqueue(const std::string& path, std::string&& buffer, int64_t timestamp_us, uint64_t sequence) {
+        if (end_publisher_) {
+            return;
+        }
+
+        auto topic = getTopic(path);
+        topic->useSequence(sequence);
+        enqueue(
+            path,
+            makeFrameBuffer(
+                std::move(buffer), sequence, (timestamp_us != 0) ? timestamp_us : nowMicros(), memory_budget_));
+    }
+
+    void enqueue(const std::string& path, const FrameBuffer& buffer) {
+        if (end_publisher_) {
+            return;
+        }
+
+        auto topic = getTopic(path);
+        topic->setBuffer(buffer);
+        topic->notifySubscribers(buffer);
+
+        // Clients of a delta-coded topic could not use the frames after a skipped one, so it is not thinned out
+        shedder_.update();
+        bool delta_coded = topic->isDeltaCoded();
+        if (!delta_coded && !shedder_.wants(buffer->sequence)) {
+            return;
+        }
+
+        for (const auto& client : topic->getClients()) {
+            if (!delta_coded && !health_.wants(client.pfd.fd, buffer->sequence)) {
+                continue;
+            }
+            if (topic->getQueueSize(client.pfd.fd) > LIMIT_QUEUE_PER_CLIENT) {
+                onSkipped(client.pfd.fd, *topic);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> payloads_lock(payloads_mtx_);
+            payloads_.push_back(Payload{topic, client, buffer});
+            topic->increaseQueue(client.pfd.fd);
+            startWorkerIfNeeded();
+            payloads_lock.unlock();
+
+            condition_.notify_one();
+        }
+
+        if (memory_budget_ != nullptr && memory_budget_->isExceeded()) {
+            dropOldestPayloads();
+        }
+    }
+
+    bool hasClient(const std::string& path) { return getTopic(path)->hasClient(); }
+
+    bool hasSubscriber(const std::string& path) { return getTopic(path)->hasSubscriber(); }
+
+    // Most recent frame of path, null before the first one
+    FrameBuffer getLatest(const std::string& path) { return getTopic(path)->getBuffer(); }
+
+    // Frees path and its latest frame if nobody receives or subscribed to it; the next use creates it anew.
+    // For topics created on demand (e.g. regions), so they don't pile up. False if it is still in use
+    bool eraseTopicIfIdle(const std::string& path) {
+        std::unique_lock topics_lock(topics_mtx_);
+        auto it = topics_.find(path);
+        if (it == topics_.end()) {
+            return true;
+        }
+        if (it->second->hasClient() || it->second->hasSubscriber()) {
+            return false;
+        }
+        topics_.erase(it);
+        return true;
+    }
+
+    // Returns an id for unsubscribe(); the callback runs on the publishing thread and must not block
+    int subscribe(const std::string& path, const FrameCallback& callback) {
+        int id = ++last_subscriber_id_;
+        getTopic(path)->addSubscriber(id, callback);
+
+        std::unique_lock<std::mutex> lock(path_by_subscriber_mtx_);
+        path_by_subscriber_[id] = path;
+        return id;
+    }
+
+    void unsubscribe(int id) {
+        std::unique_lock<std::mutex> lock(path_by_subscriber_mtx_);
+        auto it = path_by_subscriber_.find(id);
+        if (it == path_by_subscriber_.end()) {
+            return;
+        }
+
+        getTopic(it->second)->removeSubscriber(id);
+        path_by_subscriber_.erase(it);
+    }
+
+    size_t getNumQueuedPayloads() {
+        std::unique_lock<std::mutex> payloads_lock(payloads_mtx_);
+        return payloads_.size();
+    }
+
+   private:
+    struct Payload {
+        // Keeps the topic alive if it is erased meanwhile, see eraseTopicIfIdle()
+        std::shared_ptr<Topic> topic;
+        Client client;
+        FrameBuffer buffer;
+    };
+
+    std::condition_variable condition_;
+    // Guarded by payloads_mtx_
+    std::vector<std::unique_ptr<nadjieb::utils::Thread>> workers_;
+    std::mutex join_mtx_;
+    int max_workers_ = 1;
+    int idle_workers_ = 0;
+    // The factory of this run; placement_ and thread_factory_ only change while stopped
+    nadjieb::utils::ThreadFactory active_thread_factory_;
+    nadjieb::utils::ThreadPlacement placement_{"MJPEGPublisher"};
+    nadjieb::utils::ThreadFactory thread_factory_;
+    std::deque<Payload> payloads_;
+    std::unordered_map<SocketFD, std::string> path_by_client_;
+    // Clients by path without the region query, for AdmissionPolicy::max_clients_per_path
+    std::unordered_map<std::string, size_t> clients_by_path_;
+    // Never decremented, see getJoinCount()
+    std::unordered_map<std::string, uint64_t> joins_by_path_;
+    LoadShedder shedder_;
+    std::unordered_map<std::string, std::shared_ptr<Topic>> topics_;
+    std::shared_mutex topics_mtx_;
+    std::mutex path_by_client_mtx_;
+    std::unordered_map<int, std::string> path_by_subscriber_;
+    std::mutex path_by_subscriber_mtx_;
+    std::atomic<int> last_subscriber_id_{0};
+    std::mutex payloads_mtx_;
+    // Clients a worker is currently sending to; a client is never served by two workers at once
+    std::unordered_set<SocketFD> busy_clients_;
+    nadjieb::utils::MemoryBudget* memory_budget_ = nullptr;
+    std::atomic<bool> end_publisher_{true};
+    SendBackend requested_backend_ = SendBackend::POLL;
+    std::atomic<SendBackend> backend_{SendBackend::POLL};
+
+    std::atomic<size_t> zerocopy_threshold_{0};
+    std::atomic<uint64_t> zerocopy_sends_{0};
+    std::atomic<uint64_t> zerocopy_completed_{0};
+    std::atomic<uint64_t> zerocopy_copied_{0};
+
+    // Everything the kernel may still read for one or more MSG_ZEROCOPY calls on a socket
+    struct ZeroCopyPending {
+        // Completion id of the last send call using these buffers
+        uint32_t last_id;
+        FrameBuffer frame;
+        std::unique_ptr<std::string> header;
+    };
+    struct ZeroCopySocket {
+        bool enabled = false;
+        // Id the kernel assigns to the next MSG_ZEROCOPY call (a per-socket counter from 0)
+        uint32_t next_id = 0;
+        std::deque<ZeroCopyPending> pending;
+    };
+    std::unordered_map<SocketFD, ZeroCopySocket> zerocopy_sockets_;
+    std::mutex zerocopy_mtx_;
+
+    ClientHealth health_;
+    std::function<std::string(const std::string&)> downgrade_resolver_;
+    std::mutex downgrade_resolver_mtx_;
+
+    const static int LIMIT_QUEUE_PER_CLIENT = 5;
+    const static long SEND_TIMEOUT_MS = 1000;
+    // How long a client may stay unwritable before its frame is skipped
+    const static long WRITABLE_TIMEOUT_MS = 1;
+    // Payloads (distinct clients) an io_uring worker has in flight at most
+    const static size_t URING_BATCH = 32;
+    // How often an io_uring worker with sends in flight looks for new payloads
+    const static long URING_IDLE_WAIT_MS = 2;
+
+    // Creates the topic on first use. Hold on to the result rather than looking it up again,
+    // eraseTopicIfIdle() may replace it by a new one
+    std::shared_ptr<Topic> getTopic(const std::string& path) {
+        {
+            std::shared_lock topics_lock(topics_mtx_);
+            auto it = topics_.find(path);
+            if (it != topics_.end()) {
+                return it->second;
+            }
+        }
+
+        std::unique_lock topics_lock(topics_mtx_);
+        auto& topic = topics_[path];
+        if (!topic) {
+            topic = std::make_shared<Topic>();
+        }
+        return topic;
+    }
+
+    // A frame of topic for sockfd was skipped (no room in its queue, unwritable, send timed out)
+    void onSkipped(const SocketFD& sockfd, Topic& topic) {
+        topic.onFrameLost();
+        auto step = health_.onSkipped(sockfd);
+        if (step == ClientHealth::Step::DOWNGRADE) {
+            health_.onDowngraded(sockfd, downgrade(sockfd));
+        } else if (step == ClientHealth::Step::DISCONNECT) {
+            // The listener sees the hangup, closes the connection and removes the client
+            shutdownSocket(sockfd);
+        }
+    }
+
+    // Part of a frame went out and the rest never will. The next frame's multipart boundary, framed header or
+    // WebSocket header would land inside it and the client could never find the frames again, so drop it
+    void dropTruncated(const SocketFD& sockfd) {
+        shutdownSocket(sockfd);
+        removeClient(sockfd);
+    }
+
+    // Moves sockfd to the lower rendition of its topic; returns that topic, empty if there is none
+    std::string downgrade(const SocketFD& sockfd) {
+        std::string from;
+        {
+            std::unique_lock<std::mutex> lock(path_by_client_mtx_);
+            auto it = path_by_client_.find(sockfd);
+            if (it == path_by_client_.end()) {
+                return std::string();
+            }
+            from = it->second;
+        }
+
+        std::string to;
+        {
+            std::unique_lock<std::mutex> lock(downgrade_resolver_mtx_);
+            if (downgrade_resolver_) {
+                to = downgrade_resolver_(from);
+            }
+        }
+        if (to.empty() || to == from) {
+            return std::string();
+        }
+
+        std::unique_lock<std::mutex> lock(path_by_client_mtx_);
+        auto it = path_by_client_.find(sockfd);
+        Client client;
+        if (it == path_by_client_.end() || it->second != from || !getTopic(from)->findClient(sockfd, client)) {
+            return std::string();
+        }
+
+        // Payloads already queued for the old topic are still delivered
+        getTopic(from)->removeClient(sockfd);
+        getTopic(to)->addClient(sockfd, client.transport);
+        it->second = to;
+        return to;
+    }
+
+    // Releases the references held by the oldest payloads until the budget is met again.
+    // Frames still referenced by a topic (the latest one) are never freed here.
+    void dropOldestPayloads() {
+        std::unique_lock<std::mutex> payloads_lock(payloads_mtx_);
+        while (!payloads_.empty() && memory_budget_->isExceeded()) {
+            auto& payload = payloads_.front();
+            payload.topic->decreaseQueue(payload.client.pfd.fd);
+            payload.topic->onFrameLost();
+            payloads_.pop_front();
+        }
+    }
+
+    // path_by_client_mtx_ must be held
+    void reserve(const SocketFD& sockfd, const std::string& path) {
+        path_by_client_[sockfd] = path;
+        ++clients_by_path_[path.substr(0, path.find('?'))];
+    }
+
+    // Starts another worker if every started one is busy. payloads_mtx_ must be held
+    void startWorkerIfNeeded() {
+        if (!end_publisher_ && idle_workers_ == 0 && (int)workers_.size() < max_workers_) {
+            workers_.push_back(active_thread_factory_(placement_, (int)workers_.size(), [this]() { worker(); }));
+            // Counts as idle until it takes its first payload, so a burst of frames starts one thread
+            ++idle_workers_;
+        }
+    }
+
+    // Oldest payload whose client is not being served by another worker
+    std::deque<Payload>::iterator findDeliverablePayload() {
+        return std::find_if(payloads_.begin(), payloads_.end(), [&](const Payload& payload) {
+            return busy_clients_.find(payload.client.pfd.fd) == busy_clients_.end();
+        });
+    }
+
+    void worker() {
+        if (backend_ == SendBackend::IO_URING) {
+            Ring ring;
+            // Room for a poll and a send (or two cancels) per payload of a batch
+            if (ring.init(URING_BATCH * 4)) {
+                uringWorker(ring);
+                return;
+            }
+        }
+
+        while (!end_publisher_) {
+            std::unique_lock<std::mutex> payloads_lock(payloads_mtx_);
+
+            auto it = payloads_.end();
+            condition_.wait(payloads_lock, [&]() {
+                if (end_publisher_) {
+                    return true;
+                }
+                it = findDeliverablePayload();
+                return it != payloads_.end();
+            });
+            if (end_publisher_) {
+                break;
+            }
+
+            Payload payload = std::move(*it);
+            payloads_.erase(it);
+            payload.topic->decreaseQueue(payload.client.pfd.fd);
+            busy_clients_.insert(payload.client.pfd.fd);
+            --idle_workers_;
+
+            payloads_lock.unlock();
+
+            deliver(payload);
+
+            payloads_lock.lock();
+            busy_clients_.erase(payload.client.pfd.fd);
+            ++idle_workers_;
+            payloads_lock.unlock();
+
+            // Payloads for this client may have been skipped while it was busy
+            condition_.notify_all();
+        }
+    }
+
+    // Turns SO_ZEROCOPY on for sockfd once; false if the kernel refuses
+    bool enableZeroCopy(SocketFD sockfd) {
+#ifdef NADJIEB_MJPEG_STREAMER_HAS_ZEROCOPY
+        std::unique_lock<std::mutex> lock(zerocopy_mtx_);
+        auto inserted = zerocopy_sockets_.emplace(sockfd, ZeroCopySocket());
+        if (inserted.second) {
+            const int enable = 1;
+            inserted.first->second.enabled
+                = ::setsockopt(sockfd, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) == 0;
+        }
+        return inserted.first->second.enabled;
+#else
+        (void)sockfd;
+        return false;
+#endif
     }
 
-    void add(const SocketFD& sockfd, const std::string& path) {
-        if (end_publisher_) {
+    // Keeps frame and header alive until the completions of the calls just made on sockfd
+    void holdForZeroCopy(SocketFD sockfd, uint32_t calls, const FrameBuffer& frame, std::unique_ptr<std::string> header) {
+        std::unique_lock<std::mutex> lock(zerocopy_mtx_);
+        auto it = zerocopy_sockets_.find(sockfd);
+        if (it == zerocopy_sockets_.end()) {
             return;
         }
+        it->second.next_id += calls;
+        it->second.pending.push_back(ZeroCopyPending{it->second.next_id - 1, frame, std::move(header)});
+        zerocopy_sends_ += calls;
+    }
 
-        topics_[path].addClient(sockfd);
+    // The socket is about to close; the kernel keeps its own page references for what is still queued
+    void forgetZeroCopy(SocketFD sockfd) {
+        ZeroCopySocket socket;
+        {
+            std::unique_lock<std::mutex> lock(zerocopy_mtx_);
+            auto it = zerocopy_sockets_.find(sockfd);
+            if (it == zerocopy_sockets_.end()) {
+                return;
+            }
+            socket = std::move(it->second);
+            zerocopy_sockets_.erase(it);
+        }
+    }
 
-        std::unique_lock<std::mutex> lock(path_by_client_mtx_);
-        path_by_client_[sockfd] = path;
+    // Transport framing sent in front of the frame bytes
+    static void buildHeader(const Payload& payload, std::string& header) {
+        const auto& frame = *payload.buffer;
+
+        if (payload.client.transport == Transport::WEBSOCKET) {
+            // One binary message per frame: frame info followed by the JPEG
+            header = websocket::buildFrameHeader(
+                websocket::BINARY, websocket::FRAME_INFO_SIZE + frame.data.size());
+            for (int i = 0; i < 8; ++i) {
+                header += (char)((frame.sequence >> (i * 8)) & 0xFF);
+            }
+            for (int i = 0; i < 8; ++i) {
+                header += (char)(((uint64_t)frame.timestamp_us >> (i * 8)) & 0xFF);
+            }
+        } else if (payload.client.transport == Transport::FRAMED) {
+            uint64_t fields[] = {(uint64_t)frame.data.size(), frame.sequence, (uint64_t)frame.timestamp_us};
+            for (auto field : fields) {
+                for (int i = 0; i < 8; ++i) {
+                    header += (char)((field >> (i * 8)) & 0xFF);
+                }
+            }
+        } else {
+            header = "--nadjiebmjpegstreamer\r\n"
+                     "Content-Type: image/jpeg\r\n"
+                     "Content-Length: "
+                     + std::to_string(frame.data.size()) + "\r\n\r\n";
+        }
     }
 
-    bool pathExists(const std::string& path) { return (topics_.find(path) != topics_.end()); }
+    void deliver(Payload& payload) {
+        const auto& frame = *payload.buffer;
+        // On the heap: with MSG_ZEROCOPY it has to outlive this call
+        auto header = std::make_unique<std::string>();
+        buildHeader(payload, *header);
+
+        int flags = 0;
+#ifdef NADJIEB_MJPEG_STREAMER_HAS_ZEROCOPY
+        size_t threshold = zerocopy_threshold_;
+        if (threshold > 0 && frame.data.size() >= threshold && enableZeroCopy(payload.client.pfd.fd)) {
+            // Completions pending on the socket would also show up as POLLERR below
+            reapZeroCopy(payload.client.pfd.fd);
+            flags = MSG_ZEROCOPY;
+        }
+#endif
 
-    void removeClient(const SocketFD& sockfd) {
-        std::unique_lock<std::mutex> lock(path_by_client_mtx_);
-        topics_[path_by_client_[sockfd]].removeClient(sockfd);
+        // A local copy: GCC loses track of the pollfd inside the payload and warns about the write
+        NADJIEB_MJPEG_STREAMER_POLLFD pfd = payload.client.pfd;
+        auto socket_count = pollSockets(&pfd, 1, WRITABLE_TIMEOUT_MS);
 
-        path_by_client_.erase(sockfd);
-    }
+        if (socket_count == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR) {
+            UE_LOG(LogTemp, Error, TEXT("nadjieb::MJPEGStreamer: pollSockets() failed"));
+            //throw std::runtime_error("pollSockets() failed\n");
+        }
 
-    void enqueue(const std::string& path, const std::string& buffer) {
-        if (end_publisher_) {
+        if (socket_count == 0) {
+            onSkipped(payload.client.pfd.fd, *payload.topic);
             return;
         }
 
-        topics_[path].setBuffer(buffer);
-
-        for (const auto& client : topics_[path].getClients()) {
-            if (topics_[path].getQueueSize(client.fd) > LIMIT_QUEUE_PER_CLIENT) {
-                continue;
-            }
+        if ((pfd.revents & ~POLLERR) != POLLWRNORM) {
+            UE_LOG(LogTemp, Error, TEXT("nadjieb::MJPEGStreamer: revents != POLLWRNORM"));
+            //throw std::runtime_error("revents != POLLWRNORM\n");
+        }
 
-            std::unique_lock<std::mutex> payloads_lock(payloads_mtx_);
-            payloads_.emplace(path, client);
-            topics_[path].increaseQueue(client.fd);
-            payloads_lock.unlock();
+        // Header and shared frame go out in one gather write, the frame itself is never copied
+        ConstBuffer parts[] = {{header->data(), header->size()}, {frame.data.data(), frame.data.size()}};
+        uint32_t zerocopy_calls = 0;
+        size_t sent_bytes = 0;
+        bool sent = sendAllViaSocket(payload.client.pfd.fd, parts, 2, SEND_TIMEOUT_MS, flags, &zerocopy_calls, &sent_bytes);
+        size_t bytes = header->size() + frame.data.size();
+        if (zerocopy_calls > 0) {
+            holdForZeroCopy(payload.client.pfd.fd, zerocopy_calls, payload.buffer, std::move(header));
+        }
 
-            condition_.notify_one();
+        if (sent) {
+            health_.onDelivered(payload.client.pfd.fd, bytes);
+            shedder_.onSent(bytes);
+        } else if (sent_bytes > 0) {
+            dropTruncated(payload.client.pfd.fd);
+        } else {
+            onSkipped(payload.client.pfd.fd, *payload.topic);
         }
     }
 
-    bool hasClient(const std::string& path) { return topics_[path].hasClient(); }
+#ifdef NADJIEB_MJPEG_STREAMER_HAS_IO_URING
+    // One payload of an io_uring batch. The iovecs point into header and the shared frame, which the
+    // entry keeps alive until the kernel has completed every operation that references them.
+    struct UringSend {
+        Payload payload;
+        std::string header;
+        struct iovec vec[2];
+        struct msghdr msg;
+        std::chrono::steady_clock::time_point started;
+        std::chrono::steady_clock::time_point deadline;
+        bool sent_any = false;
+        bool sent_all = false;
+        bool finished = false;
+        bool canceling = false;
+        int in_flight = 0;
+    };
 
-   private:
-    typedef std::pair<std::string, NADJIEB_MJPEG_STREAMER_POLLFD> Payload;
+    // user_data: payload index << 2 | operation
+    enum UringOp : uint64_t { URING_SEND = 0, URING_POLL = 1, URING_CANCEL = 2 };
+
+    // Queues a send of what is left of entry; after EAGAIN it is preceded by a linked poll for
+    // writability, so the kernel retries on its own instead of us polling.
+    static void queueUringSend(Ring& ring, UringSend& entry, size_t index, bool wait_writable) {
+        if (wait_writable) {
+            auto* poll_sqe = ring.getSqe();
+            poll_sqe->opcode = IORING_OP_POLL_ADD;
+            poll_sqe->fd = entry.payload.client.pfd.fd;
+            poll_sqe->poll32_events = POLLOUT;
+            poll_sqe->flags = IOSQE_IO_LINK;
+            poll_sqe->user_data = (index << 2) | URING_POLL;
+            ++entry.in_flight;
+        }
 
-    std::condition_variable condition_;
-    std::vector<std::thread> workers_;
-    std::queue<Payload> payloads_;
-    std::unordered_map<SocketFD, std::string> path_by_client_;
-    std::unordered_map<std::string, Topic> topics_;
-    std::mutex cv_mtx_;
-    std::mutex path_by_client_mtx_;
-    std::mutex payloads_mtx_;
-    bool end_publisher_ = true;
+        auto* sqe = ring.getSqe();
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = entry.payload.client.pfd.fd;
+        sqe->addr = (uint64_t)(uintptr_t)&entry.msg;
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+        sqe->user_data = (index << 2) | URING_SEND;
+        ++entry.in_flight;
+    }
 
-    const static int LIMIT_QUEUE_PER_CLIENT = 5;
+    static void queueUringCancel(Ring& ring, UringSend& entry, size_t index) {
+        entry.canceling = true;
+        for (uint64_t op : {(uint64_t)URING_POLL, (uint64_t)URING_SEND}) {
+            auto* sqe = ring.getSqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = (index << 2) | op;
+            sqe->user_data = (index << 2) | URING_CANCEL;
+        }
+    }
 
-    void worker() {
-        while (!end_publisher_) {
-            std::unique_lock<std::mutex> cv_lock(cv_mtx_);
+    // Send result of entry: finished, more to send, or given up
+    void onUringSent(Ring& ring, UringSend& entry, size_t index, int res) {
+        if (entry.canceling) {
+            return;
+        }
 
-            condition_.wait(cv_lock, [&]() { return (end_publisher_ || !payloads_.empty()); });
-            if (end_publisher_) {
-                break;
+        if (res == -EAGAIN) {
+            queueUringSend(ring, entry, index, true);
+            return;
+        }
+        if (res <= 0) {
+            // Connection gone (or the linked poll failed); the listener closes and removes the client
+            entry.finished = true;
+            return;
+        }
+
+        if (!entry.sent_any) {
+            entry.sent_any = true;
+            entry.deadline = entry.started + std::chrono::milliseconds(SEND_TIMEOUT_MS);
+        }
+
+        size_t advance = (size_t)res;
+        auto* vec = entry.msg.msg_iov;
+        while (advance > 0 && entry.msg.msg_iovlen > 0) {
+            if (advance >= vec->iov_len) {
+                advance -= vec->iov_len;
+                ++vec;
+                --entry.msg.msg_iovlen;
+            } else {
+                vec->iov_base = (char*)vec->iov_base + advance;
+                vec->iov_len -= advance;
+                advance = 0;
             }
+        }
+        entry.msg.msg_iov = vec;
 
-            std::unique_lock<std::mutex> payloads_lock(payloads_mtx_);
+        if (entry.msg.msg_iovlen == 0) {
+            entry.sent_all = true;
+            entry.finished = true;
+        } else {
+            queueUringSend(ring, entry, index, true);
+        }
+    }
 
-            Payload payload = std::move(payloads_.front());
-            payloads_.pop();
-            topics_[payload.first].decreaseQueue(payload.second.fd);
+    // Same semantics as worker() and deliver(), but up to URING_BATCH payloads for distinct clients are
+    // in flight at once and their sends, retries and timeouts share io_uring_enter() calls. Slots are
+    // refilled as soon as they complete, so one stalled client never holds up the others.
+    void uringWorker(Ring& ring) {
+        std::vector<UringSend> slots(URING_BATCH);
+        std::vector<bool> in_use(URING_BATCH, false);
+        size_t active = 0;
 
-            payloads_lock.unlock();
-            cv_lock.unlock();
+        while (true) {
+            std::vector<size_t> taken;
+            {
+                std::unique_lock<std::mutex> payloads_lock(payloads_mtx_);
+                if (active == 0) {
+                    condition_.wait(payloads_lock, [&]() {
+                        return end_publisher_ || findDeliverablePayload() != payloads_.end();
+                    });
+                }
+                if (end_publisher_) {
+                    break;
+                }
+
+                for (size_t i = 0; i < slots.size(); ++i) {
+                    if (in_use[i]) {
+                        continue;
+                    }
+                    auto it = findDeliverablePayload();
+                    if (it == payloads_.end()) {
+                        break;
+                    }
+                    slots[i] = UringSend();
+                    slots[i].payload = std::move(*it);
+                    payloads_.erase(it);
+                    auto fd = slots[i].payload.client.pfd.fd;
+                    slots[i].payload.topic->decreaseQueue(fd);
+                    busy_clients_.insert(fd);
+                    in_use[i] = true;
+                    taken.push_back(i);
+                }
+                if (active == 0 && !taken.empty()) {
+                    --idle_workers_;
+                }
+            }
 
-            auto buffer = topics_[payload.first].getBuffer();
-            std::string res_str
-                = "--nadjiebmjpegstreamer\r\n"
-                  "Content-Type: image/jpeg\r\n"
-                  "Content-Length: "
-                  + std::to_string(buffer.size()) + "\r\n\r\n" + buffer;
+            auto now = std::chrono::steady_clock::now();
+            for (auto i : taken) {
+                auto& entry = slots[i];
+                const auto& frame = *entry.payload.buffer;
+                buildHeader(entry.payload, entry.header);
+                entry.vec[0].iov_base = const_cast<char*>(entry.header.data());
+                entry.vec[0].iov_len = entry.header.size();
+                entry.vec[1].iov_base = const_cast<char*>(frame.data.data());
+                entry.vec[1].iov_len = frame.data.size();
+                std::memset(&entry.msg, 0, sizeof(entry.msg));
+                entry.msg.msg_iov = entry.vec;
+                entry.msg.msg_iovlen = frame.data.empty() ? 1 : 2;
+                entry.started = now;
+                entry.deadline = now + std::chrono::milliseconds(WRITABLE_TIMEOUT_MS);
+                queueUringSend(ring, entry, i, false);
+                ++active;
+            }
 
-            auto socket_count = pollSockets(&payload.second, 1, 1);
+            waitUringSlots(ring, slots, in_use, URING_IDLE_WAIT_MS);
+
+            std::vector<SocketFD> released;
+            for (size_t i = 0; i < slots.size(); ++i) {
+                if (in_use[i] && slots[i].in_flight == 0) {
+                    auto fd = slots[i].payload.client.pfd.fd;
+                    if (slots[i].sent_all) {
+                        auto bytes = slots[i].header.size() + slots[i].payload.buffer->data.size();
+                        health_.onDelivered(fd, bytes);
+                        shedder_.onSent(bytes);
+                    } else if (slots[i].sent_any) {
+                        dropTruncated(fd);
+                    } else {
+                        onSkipped(fd, *slots[i].payload.topic);
+                    }
+                    released.push_back(fd);
+                    slots[i] = UringSend();
+                    in_use[i] = false;
+                    --active;
+                }
+            }
+            if (!released.empty()) {
+                {
+                    std::unique_lock<std::mutex> payloads_lock(payloads_mtx_);
+                    for (auto fd : released) {
+                        busy_clients_.erase(fd);
+                    }
+                    if (active == 0) {
+                        ++idle_workers_;
+                    }
+                }
+                // Payloads for these clients may have been skipped while they were busy
+                condition_.notify_all();
+            }
+        }
 
-            if (socket_count == NADJIEB_MJPEG_STREAMER_SOCKET_ERROR) {
-                UE_LOG(LogTemp, Error, TEXT("nadjieb::MJPEGStreamer: pollSockets() failed"));
-                //throw std::runtime_error("pollSockets() failed\n");
+        // The kernel may still read header and frame memory of the slots: cancel and wait it out
+        for (size_t i = 0; i < slots.size(); ++i) {
+            if (in_use[i] && slots[i].in_flight > 0 && !slots[i].canceling) {
+                queueUringCancel(ring, slots[i], i);
             }
+        }
+        while (std::any_of(slots.begin(), slots.end(), [](const UringSend& entry) { return entry.in_flight > 0; })) {
+            waitUringSlots(ring, slots, in_use, SEND_TIMEOUT_MS);
+        }
 
-            if (socket_count == 0) {
-                continue;
+        // After a restart a new client may get one of these fd numbers
+        std::unique_lock<std::mutex> payloads_lock(payloads_mtx_);
+        for (size_t i = 0; i < slots.size(); ++i) {
+            if (in_use[i]) {
+                busy_clients_.erase(slots[i].payload.client.pfd.fd);
+            }
+        }
+    }
+
+    // One round of submitting queued operations, waiting for completions (at most max_wait_ms, less if a
+    // deadline is closer) and handling them; cancels what ran out of time
+    void waitUringSlots(Ring& ring, std::vector<UringSend>& slots, const std::vector<bool>& in_use, long max_wait_ms) {
+        auto now = std::chrono::steady_clock::now();
+        long wait_ms = max_wait_ms;
+        for (size_t i = 0; i < slots.size(); ++i) {
+            if (in_use[i] && !slots[i].finished && !slots[i].canceling) {
+                auto until = std::chrono::duration_cast<std::chrono::milliseconds>(slots[i].deadline - now);
+                wait_ms = std::min(wait_ms, std::max<long>(0, (long)until.count() + 1));
             }
+        }
+
+        if (!ring.submitAndWait(1, wait_ms)) {
+            UE_LOG(LogTemp, Error, TEXT("nadjieb::MJPEGStreamer: io_uring_enter() failed"));
+        }
 
-            if (payload.second.revents != POLLWRNORM) {
-                UE_LOG(LogTemp, Error, TEXT("nadjieb::MJPEGStreamer: revents != POLLWRNORM"));
-                //throw std::runtime_error("revents != POLLWRNORM\n");
+        ring.drain([&](uint64_t user_data, int res) {
+            auto op = user_data & 3;
+            if (op == URING_CANCEL) {
+                return;
             }
+            size_t index = (size_t)(user_data >> 2);
+            auto& entry = slots[index];
+            --entry.in_flight;
+            if (op == URING_SEND) {
+                onUringSent(ring, entry, index, res);
+            }
+        });
+
+        now = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < slots.size(); ++i) {
+            auto& entry = slots[i];
+            if (in_use[i] && !entry.finished && !entry.canceling && entry.in_flight > 0 && now >= entry.deadline) {
+                // Unwritable client (frame skipped) or stalled send (given up, like sendAllViaSocket)
+                queueUringCancel(ring, entry, i);
+            }
+        }
+    }
+#else
+    void uringWorker(Ring&) {}
+#endif
+};
+}  // namespace net
+}  // namespace nadjieb
+
+// #include <nadjieb/net/region_of_interest.hpp>
+
+
+#include <cstdlib>
+#include <string>
 
-            sendViaSocket(payload.second.fd, res_str.c_str(), res_str.size(), 0);
+namespace nadjieb {
+namespace net {
+// Crop (and optional downscale) requested with ?roi=x,y,width,height[&scale=n]
+struct RegionOfInterest {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+    // Output is 1/scale of the cropped size: 1, 2, 4 or 8
+    int scale = 1;
+
+    // Aligned extent larger than any frame; a region of this size is the whole frame once clamped
+    static const int FULL_FRAME = 65520;
+
+    // Snaps the region outwards to the alignment grid (the 16x16 JPEG MCU), so nearby requests
+    // share one topic and the crop never splits a block. Clamping to the frame is up to the producer.
+    static bool parse(const HTTPRequest& req, int alignment, RegionOfInterest& roi) {
+        int values[4];
+        std::string text = req.getQueryValue("roi");
+        const char* p = text.c_str();
+        for (int i = 0; i < 4; ++i) {
+            char* end = nullptr;
+            long value = std::strtol(p, &end, 10);
+            if (end == p || value < 0 || value > 65535 || (i < 3 && *end != ',') || (i == 3 && *end != '\0')) {
+                return false;
+            }
+            values[i] = (int)value;
+            p = end + 1;
         }
+        if (values[2] == 0 || values[3] == 0) {
+            return false;
+        }
+
+        roi.x = values[0] / alignment * alignment;
+        roi.y = values[1] / alignment * alignment;
+        roi.width = (values[0] + values[2] + alignment - 1) / alignment * alignment - roi.x;
+        roi.height = (values[1] + values[3] + alignment - 1) / alignment * alignment - roi.y;
+
+        std::string scale = req.getQueryValue("scale");
+        roi.scale = scale.empty() ? 1 : std::atoi(scale.c_str());
+        return roi.scale == 1 || roi.scale == 2 || roi.scale == 4 || roi.scale == 8;
+    }
+
+    std::string toTopic(const std::string& path) const {
+        return path + "?roi=" + std::to_string(x) + "," + std::to_string(y) + "," + std::to_string(width) + ","
+               + std::to_string(height) + "&scale=" + std::to_string(scale);
     }
 };
 }  // namespace net
@@ -828,45 +3619,453 @@ class Publisher : public nadjieb::utils::NonCopyable, public nadjieb::utils::Run
 // #include <nadjieb/utils/non_copyable.hpp>
 
 
+#include <algorithm>
+#include <cctype>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 namespace nadjieb {
 class MJPEGStreamer : public nadjieb::utils::NonCopyable {
    public:
     virtual ~MJPEGStreamer() { stop(); }
 
-    void start(int port, int num_workers = std::thread::hardware_concurrency()) {
+    // Returns once the server accepts connections, or false right away if neither port nor one of the
+    // SocketOptions::port_fallback ports after it could be bound; getPort() tells which one it got.
+    // num_workers is an upper bound, see Publisher::start().
+    bool start(int port, int num_workers = std::thread::hardware_concurrency()) {
+        publisher_.setMemoryBudget(&memory_budget_);
+        publisher_.setDowngradeResolver([this](const std::string& topic) { return lowerRendition(topic); });
         publisher_.start(num_workers);
-        listener_.withOnMessageCallback(on_message_cb_).withOnBeforeCloseCallback(on_before_close_cb_).runAsync(port);
-
-        while (!isRunning()) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        bool listening = listener_.withOnMessageCallback(on_message_cb_)
+                             .withThreads(listener_placement_, thread_factory_)
+                             .withOnBeforeCloseCallback(on_before_close_cb_)
+                             .withOnErrorQueueCallback([this](const nadjieb::net::SocketFD& sockfd) {
+                                 publisher_.reapZeroCopy(sockfd);
+                             })
+                             .runAsync(port, listener_threads_, socket_options_);
+        if (!listening) {
+            publisher_.stop();
         }
+        return listening;
     }
 
+    // Port the server listens on, valid after start() returned true
+    int getPort() const { return listener_.getPort(); }
+
     void stop() {
-        publisher_.stop();
+        // Workers first, so none is still sending on a socket the listener closes; then the listener,
+        // so no loop adds or removes clients while the publisher clears them
+        publisher_.stopWorkers();
         listener_.stop();
+        publisher_.stop();
+
+        std::unique_lock lock(roi_mtx_);
+        regions_by_path_.clear();
     }
 
-    void publish(const std::string& path, const std::string& buffer) { publisher_.enqueue(path, buffer); }
+    void publish(const std::string& path, std::string&& buffer, int64_t timestamp_us = 0) {
+        publisher_.enqueue(path, std::move(buffer), timestamp_us);
+    }
+
+    // sequence must grow from frame to frame; it is sent as X-Sequence or in the FRAMED header
+    void publish(const std::string& path, std::string&& buffer, int64_t timestamp_us, uint64_t sequence) {
+        publisher_.enqueue(path, std::move(buffer), timestamp_us, sequence);
+    }
+
+    void publish(const std::string& path, const std::string& buffer) { publisher_.enqueue(path, std::string(buffer)); }
+
+    // Budget shared with the capture and encode stages of the host application
+    nadjieb::utils::MemoryBudget& getMemoryBudget() { return memory_budget_; }
 
     void setShutdownTarget(const std::string& target) { shutdown_target_ = target; }
 
+    // Event loops accepting and reading requests, see Listener. Takes effect on the next start()
+    void setListenerThreads(int num_threads) { listener_threads_ = std::max(num_threads, 1); }
+
+    // Name, CPU affinity and priority of the listener loops and of the publisher workers. factory starts the
+    // threads (null = std::thread), e.g. as engine threads that show up in its profiler. Takes effect on the next start()
+    void setThreadPlacement(
+        const nadjieb::utils::ThreadPlacement& listener,
+        const nadjieb::utils::ThreadPlacement& publisher,
+        const nadjieb::utils::ThreadFactory& factory = nullptr) {
+        listener_placement_ = listener;
+        publisher_.setThreads(publisher, factory);
+        thread_factory_ = factory;
+    }
+
+    // Bind address and TCP tuning of client connections, see SocketOptions. Takes effect on the next start()
+    void setSocketOptions(const nadjieb::net::SocketOptions& options) { socket_options_ = options; }
+
+    int getListenerThreads() { return listener_.getThreadCount(); }
+
+    // How frames are written to clients, see SendBackend. Takes effect on the next start()
+    void setSendBackend(nadjieb::net::SendBackend backend) { publisher_.setSendBackend(backend); }
+
+    nadjieb::net::SendBackend getSendBackend() { return publisher_.getSendBackend(); }
+
+    // Frames of at least bytes are sent with MSG_ZEROCOPY where supported (0 = never), see Publisher
+    void setZeroCopyThreshold(size_t bytes) { publisher_.setZeroCopyThreshold(bytes); }
+
+    nadjieb::net::Publisher::ZeroCopyStats getZeroCopyStats() { return publisher_.getZeroCopyStats(); }
+
+    // What happens to clients that cannot keep up. DOWNGRADE moves them to a half resolution region
+    // topic of their path (see getRegionsOfInterest()), so region of interest has to be enabled for it.
+    void setSlowClientPolicy(const nadjieb::net::SlowClientPolicy& policy) { publisher_.setSlowClientPolicy(policy); }
+
+    std::vector<nadjieb::net::ClientStats> getClientStats() { return publisher_.getClientStats(); }
+
+    // Client caps and load shedding, see AdmissionPolicy. Clients over a cap get 503 with Retry-After
+    void setAdmissionPolicy(const nadjieb::net::AdmissionPolicy& policy) { publisher_.setAdmissionPolicy(policy); }
+
+    // Host CPU load (0..1); only needed with AdmissionPolicy::max_cpu_load
+    void reportCpuLoad(double load) { publisher_.reportCpuLoad(load); }
+
+    nadjieb::net::AdmissionStats getAdmissionStats() { return publisher_.getAdmissionStats(); }
+
+    size_t getClientCount() { return publisher_.getClientCount(); }
+
+    uint64_t getJoinCount(const std::string& path) { return publisher_.getJoinCount(path); }
+
+    // Slow client events since the last call, oldest first
+    std::vector<nadjieb::net::ClientEvent> takeClientEvents() { return publisher_.takeClientEvents(); }
+
+    // HTTP clients of path get a plain content_type response with length-prefixed frames
+    // (see FRAMED_HEADER_SIZE) instead of multipart JPEG. WebSocket clients are unaffected.
+    void setFramedPath(const std::string& path, const std::string& content_type) {
+        publisher_.setContentType(path, content_type);
+    }
+
+    // For paths whose frames build on the ones before, see nadjieb::net::Topic::setDeltaCoded(). Call before start()
+    void setDeltaCoded(const std::string& path) { publisher_.setDeltaCoded(path); }
+
+    uint64_t getLostFrameCount(const std::string& path) { return publisher_.getLostFrameCount(path); }
+
     bool isRunning() { return (publisher_.isRunning() && listener_.isRunning()); }
 
     bool hasClient(const std::string& path) { return publisher_.hasClient(path); }
 
+    bool hasSubscriber(const std::string& path) { return publisher_.hasSubscriber(path); }
+
+    int subscribe(const std::string& path, const nadjieb::net::FrameCallback& callback) {
+        return publisher_.subscribe(path, callback);
+    }
+
+    void unsubscribe(int id) { publisher_.unsubscribe(id); }
+
+    // Lets clients of path request a cropped region (?roi=x,y,w,h[&scale=n]). Every distinct
+    // region, snapped to alignment, becomes its own topic; see getRegionsOfInterest().
+    // Without client_requests only the lower renditions of downgraded clients are regions, ?roi= is ignored.
+    void enableRegionOfInterest(const std::string& path, int alignment = 16, bool client_requests = true) {
+        std::unique_lock lock(roi_mtx_);
+        roi_alignment_by_path_[path] = (alignment > 0) ? alignment : 1;
+        if (client_requests) {
+            roi_requests_by_path_.insert(path);
+        } else {
+            roi_requests_by_path_.erase(path);
+        }
+    }
+
+    // Regions of path that currently have clients, with the topic to publish each crop on
+    std::vector<std::pair<std::string, nadjieb::net::RegionOfInterest>> getRegionsOfInterest(const std::string& path) {
+        std::vector<std::pair<std::string, nadjieb::net::RegionOfInterest>> regions;
+        std::unique_lock lock(roi_mtx_);
+        auto it = regions_by_path_.find(path);
+        if (it == regions_by_path_.end()) {
+            return regions;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        for (auto& region : it->second) {
+            if (publisher_.hasClient(region.first) || publisher_.hasSubscriber(region.first)) {
+                // The caller publishes on it next, it must not be evicted meanwhile
+                region.second.last_used = now;
+                regions.emplace_back(region.first, region.second.roi);
+            }
+        }
+        return regions;
+    }
+
+    // Requests whose path starts with prefix go to handler instead of the publisher.
+    // The handler sends its own response; on_close is called for every closing connection.
+    void addRoute(const std::string& prefix, const nadjieb::net::RouteHandler& handler) {
+        std::unique_lock lock(routes_mtx_);
+        routes_.emplace_back(prefix, handler);
+    }
+
    private:
+    // Declared first so it outlives every frame buffer held by the publisher
+    nadjieb::utils::MemoryBudget memory_budget_;
     nadjieb::net::Listener listener_;
+    int listener_threads_ = 1;
+    nadjieb::utils::ThreadPlacement listener_placement_{"MJPEGListener"};
+    nadjieb::utils::ThreadFactory thread_factory_;
+    nadjieb::net::SocketOptions socket_options_;
     nadjieb::net::Publisher publisher_;
     std::string shutdown_target_ = "/shutdown";
+    std::vector<std::pair<std::string, nadjieb::net::RouteHandler>> routes_;
+    std::shared_mutex routes_mtx_;
+
+    struct Region {
+        nadjieb::net::RegionOfInterest roi;
+        // Last time a client asked for it or a frame was published on it
+        std::chrono::steady_clock::time_point last_used;
+    };
+
+    std::unordered_map<std::string, int> roi_alignment_by_path_;
+    // Paths whose clients may ask for regions themselves
+    std::unordered_set<std::string> roi_requests_by_path_;
+    // Regions requested recently or still watched, by path and topic
+    std::unordered_map<std::string, std::unordered_map<std::string, Region>> regions_by_path_;
+    std::shared_mutex roi_mtx_;
+
+    // Every region is a topic with its own crop encoded per frame, so only this many are kept at once
+    const static size_t LIMIT_REGIONS_PER_PATH = 32;
+    // A region is resolved before its client is added; it is not evicted that soon after, so the client finds it
+    const static long REGION_EVICT_AFTER_MS = 5000;
+
+    const static long SEND_TIMEOUT_MS = 1000;
+
+    // Empty response; the connection stays open if the client wants keep-alive
+    static nadjieb::net::OnMessageCallbackResponse sendStatus(
+        const nadjieb::net::SocketFD& sockfd,
+        nadjieb::net::HTTPRequest& req,
+        int status_code,
+        const char* status_text) {
+        nadjieb::net::OnMessageCallbackResponse cb_res;
+        cb_res.close_conn = !req.isKeepAlive();
+
+        auto& res = nadjieb::net::ResponseBuilder::forThread()
+                         .start(req.getVersion(), status_code, status_text)
+                         .connection(!cb_res.close_conn)
+                         .finish();
+        nadjieb::net::sendAllViaSocket(sockfd, res, SEND_TIMEOUT_MS);
+        return cb_res;
+    }
+
+    // A stream client turned away by the AdmissionPolicy; it is told when to try again
+    nadjieb::net::OnMessageCallbackResponse sendUnavailable(
+        const nadjieb::net::SocketFD& sockfd,
+        nadjieb::net::HTTPRequest& req) {
+        nadjieb::net::OnMessageCallbackResponse cb_res;
+        cb_res.close_conn = true;
+
+        auto& res = nadjieb::net::ResponseBuilder::forThread()
+                        .start(req.getVersion(), 503, "Service Unavailable")
+                        .connection(false)
+                        .header("Retry-After", (uint64_t)std::max(publisher_.getAdmissionPolicy().retry_after_s, 0))
+                        .finish();
+        nadjieb::net::sendAllViaSocket(sockfd, res, SEND_TIMEOUT_MS);
+        return cb_res;
+    }
+
+    // ?snapshot: the latest frame of a stream as a single response, for polling clients
+    nadjieb::net::OnMessageCallbackResponse sendSnapshot(
+        const nadjieb::net::SocketFD& sockfd,
+        nadjieb::net::HTTPRequest& req,
+        const std::string& topic) {
+        auto frame = publisher_.getLatest(topic);
+        if (!frame) {
+            return sendStatus(sockfd, req, 503, "Service Unavailable");
+        }
+
+        nadjieb::net::OnMessageCallbackResponse cb_res;
+        cb_res.close_conn = !req.isKeepAlive();
+
+        auto content_type = publisher_.getContentType(req.getPath());
+        auto& header = nadjieb::net::ResponseBuilder::forThread()
+                           .start(req.getVersion(), 200, "OK")
+                           .connection(!cb_res.close_conn)
+                           .header("Cache-Control", "no-cache, no-store, must-revalidate, max-age=0")
+                           .header("Content-Type", content_type.empty() ? std::string("image/jpeg") : content_type)
+                           .header("X-Sequence", (uint64_t)frame->sequence)
+                           .header("X-Timestamp", (uint64_t)frame->timestamp_us)
+                           .finishHeaders(frame->data.size());
+
+        nadjieb::net::ConstBuffer parts[] = {{header.data(), header.size()}, {frame->data.data(), frame->data.size()}};
+        if (!nadjieb::net::sendAllViaSocket(sockfd, parts, 2, SEND_TIMEOUT_MS)) {
+            cb_res.close_conn = true;
+        }
+        return cb_res;
+    }
+
+    // Topic a stream request subscribes to: the path, or one region of it. Sends an error, fills
+    // error and returns false for malformed regions or when the path has no room for another one.
+    bool resolveTopic(
+        const nadjieb::net::SocketFD& sockfd,
+        nadjieb::net::HTTPRequest& req,
+        std::string& topic,
+        nadjieb::net::OnMessageCallbackResponse& error) {
+        topic = req.getPath();
+        if (req.getQueryValue("roi").empty()) {
+            return true;
+        }
+
+        std::unique_lock lock(roi_mtx_);
+        auto it = roi_alignment_by_path_.find(topic);
+        if (it == roi_alignment_by_path_.end() || roi_requests_by_path_.count(topic) == 0) {
+            return true;
+        }
+
+        nadjieb::net::RegionOfInterest roi;
+        if (!nadjieb::net::RegionOfInterest::parse(req, it->second, roi)) {
+            lock.unlock();
+            error = sendStatus(sockfd, req, 400, "Bad Request");
+            return false;
+        }
+
+        auto& regions = regions_by_path_[topic];
+        std::string roi_topic = roi.toTopic(topic);
+        if (!useRegion(regions, roi_topic, roi)) {
+            lock.unlock();
+            error = sendStatus(sockfd, req, 503, "Service Unavailable");
+            return false;
+        }
+
+        topic = roi_topic;
+        return true;
+    }
+
+    // Adds region roi_topic to regions, or marks it used if it is there already. If regions is full,
+    // regions that nobody watches anymore are evicted first. False if there is no room. roi_mtx_ must be held
+    bool useRegion(std::unordered_map<std::string, Region>& regions, const std::string& roi_topic,
+                   const nadjieb::net::RegionOfInterest& roi) {
+        auto now = std::chrono::steady_clock::now();
+        auto it = regions.find(roi_topic);
+        if (it != regions.end()) {
+            it->second.last_used = now;
+            return true;
+        }
+
+        if (regions.size() >= LIMIT_REGIONS_PER_PATH) {
+            for (auto idle = regions.begin(); idle != regions.end();) {
+                if (now - idle->second.last_used >= std::chrono::milliseconds(REGION_EVICT_AFTER_MS)
+                    && publisher_.eraseTopicIfIdle(idle->first)) {
+                    idle = regions.erase(idle);
+                } else {
+                    ++idle;
+                }
+            }
+            if (regions.size() >= LIMIT_REGIONS_PER_PATH) {
+                return false;
+            }
+        }
+
+        regions[roi_topic] = Region{roi, now};
+        return true;
+    }
+
+    // Half the resolution of topic, as a region topic of the same path: the whole frame at scale 2 for
+    // the path itself, twice the scale for a region. Empty if regions are not enabled for the path,
+    // the scale is at its maximum or the path has no room for another region.
+    std::string lowerRendition(const std::string& topic) {
+        std::string path = topic.substr(0, topic.find('?'));
+
+        std::unique_lock lock(roi_mtx_);
+        if (roi_alignment_by_path_.find(path) == roi_alignment_by_path_.end()) {
+            return std::string();
+        }
+
+        auto& regions = regions_by_path_[path];
+        nadjieb::net::RegionOfInterest roi;
+        if (topic == path) {
+            roi.width = nadjieb::net::RegionOfInterest::FULL_FRAME;
+            roi.height = nadjieb::net::RegionOfInterest::FULL_FRAME;
+        } else {
+            auto it = regions.find(topic);
+            if (it == regions.end()) {
+                return std::string();
+            }
+            roi = it->second.roi;
+        }
+        if (roi.scale >= 8) {
+            return std::string();
+        }
+        roi.scale *= 2;
+
+        std::string lower = roi.toTopic(path);
+        if (!useRegion(regions, lower, roi)) {
+            return std::string();
+        }
+        return lower;
+    }
+
+    // Connections upgraded to WebSocket; their incoming data is frames, not HTTP
+    std::unordered_map<nadjieb::net::SocketFD, nadjieb::net::websocket::FrameScanner> websocket_clients_;
+    std::mutex websocket_clients_mtx_;
+
+    // False if sockfd is no WebSocket client, otherwise feeds message to its scanner
+    bool scanWebSocket(const nadjieb::net::SocketFD& sockfd, const std::string& message, bool& close_conn) {
+        std::unique_lock<std::mutex> lock(websocket_clients_mtx_);
+        auto it = websocket_clients_.find(sockfd);
+        if (it == websocket_clients_.end()) {
+            return false;
+        }
+        close_conn = it->second.feed(message);
+        return true;
+    }
+
+    static bool isWebSocketUpgrade(nadjieb::net::HTTPRequest& req) {
+        std::string upgrade = req.getValue("Upgrade");
+        std::transform(
+            upgrade.begin(), upgrade.end(), upgrade.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        return upgrade == "websocket" && !req.getValue("Sec-WebSocket-Key").empty();
+    }
+
+    // Same topics as multipart clients, one binary message per frame
+    nadjieb::net::OnMessageCallbackResponse acceptWebSocket(
+        const nadjieb::net::SocketFD& sockfd,
+        nadjieb::net::HTTPRequest& req) {
+        nadjieb::net::OnMessageCallbackResponse cb_res;
+
+        if (!publisher_.pathExists(req.getPath())) {
+            return sendStatus(sockfd, req, 404, "Not Found");
+        }
+
+        std::string topic;
+        if (!resolveTopic(sockfd, req, topic, cb_res)) {
+            return cb_res;
+        }
+        if (publisher_.admit(sockfd, topic) != nadjieb::net::Admission::ADMITTED) {
+            return sendUnavailable(sockfd, req);
+        }
+
+        auto& upgrade_res = nadjieb::net::ResponseBuilder::forThread()
+                                .start(req.getVersion(), 101, "Switching Protocols")
+                                .header("Upgrade", "websocket")
+                                .header("Connection", "Upgrade")
+                                .header(
+                                    "Sec-WebSocket-Accept",
+                                    nadjieb::net::websocket::computeAcceptKey(req.getValue("Sec-WebSocket-Key")))
+                                .finishStream();
+
+        nadjieb::net::sendAllViaSocket(sockfd, upgrade_res, SEND_TIMEOUT_MS);
+
+        {
+            std::unique_lock<std::mutex> lock(websocket_clients_mtx_);
+            websocket_clients_[sockfd] = nadjieb::net::websocket::FrameScanner();
+        }
+        publisher_.add(sockfd, topic, nadjieb::net::Transport::WEBSOCKET);
+
+        // Incoming data is WebSocket frames from now on
+        cb_res.mode = nadjieb::net::ConnectionMode::PASSTHROUGH;
+        return cb_res;
+    }
 
     nadjieb::net::OnMessageCallback on_message_cb_ = [&](const nadjieb::net::SocketFD& sockfd,
                                                          const std::string& message) {
-        nadjieb::net::HTTPRequest req(message);
         nadjieb::net::OnMessageCallbackResponse cb_res;
 
+        if (scanWebSocket(sockfd, message, cb_res.close_conn)) {
+            cb_res.mode = nadjieb::net::ConnectionMode::PASSTHROUGH;
+            return cb_res;
+        }
+
+        nadjieb::net::HTTPRequest req(message);
+
         if (req.getTarget() == shutdown_target_) {
             nadjieb::net::HTTPResponse shutdown_res;
             shutdown_res.setVersion(req.getVersion());
@@ -876,57 +4075,86 @@ class MJPEGStreamer : public nadjieb::utils::NonCopyable {
 
             nadjieb::net::sendViaSocket(sockfd, shutdown_res_str.c_str(), shutdown_res_str.size(), 0);
 
-            publisher_.stop();
+            // Other loops may still hold topics and clients; stop() clears them once every loop has ended
+            publisher_.stopWorkers();
 
             cb_res.end_listener = true;
             return cb_res;
         }
 
         if (req.getMethod() != "GET") {
-            nadjieb::net::HTTPResponse method_not_allowed_res;
-            method_not_allowed_res.setVersion(req.getVersion());
-            method_not_allowed_res.setStatusCode(405);
-            method_not_allowed_res.setStatusText("Method Not Allowed");
-            auto method_not_allowed_res_str = method_not_allowed_res.serialize();
-
-            nadjieb::net::sendViaSocket(
-                sockfd, method_not_allowed_res_str.c_str(), method_not_allowed_res_str.size(), 0);
+            return sendStatus(sockfd, req, 405, "Method Not Allowed");
+        }
 
-            cb_res.close_conn = true;
-            return cb_res;
+        if (isWebSocketUpgrade(req)) {
+            return acceptWebSocket(sockfd, req);
         }
 
-        if (!publisher_.pathExists(req.getTarget())) {
-            nadjieb::net::HTTPResponse not_found_res;
-            not_found_res.setVersion(req.getVersion());
-            not_found_res.setStatusCode(404);
-            not_found_res.setStatusText("Not Found");
-            auto not_found_res_str = not_found_res.serialize();
+        {
+            std::shared_lock routes_lock(routes_mtx_);
+            for (const auto& route : routes_) {
+                if (req.getPath().compare(0, route.first.size(), route.first) == 0) {
+                    return route.second.on_request(sockfd, req);
+                }
+            }
+        }
 
-            nadjieb::net::sendViaSocket(sockfd, not_found_res_str.c_str(), not_found_res_str.size(), 0);
+        if (!publisher_.pathExists(req.getPath())) {
+            return sendStatus(sockfd, req, 404, "Not Found");
+        }
 
-            cb_res.close_conn = true;
+        std::string topic;
+        if (!resolveTopic(sockfd, req, topic, cb_res)) {
             return cb_res;
         }
 
-        nadjieb::net::HTTPResponse init_res;
-        init_res.setVersion(req.getVersion());
-        init_res.setStatusCode(200);
-        init_res.setStatusText("OK");
-        init_res.setValue("Connection", "close");
-        init_res.setValue("Cache-Control", "no-cache, no-store, must-revalidate, pre-check=0, post-check=0, max-age=0");
-        init_res.setValue("Pragma", "no-cache");
-        init_res.setValue("Content-Type", "multipart/x-mixed-replace; boundary=nadjiebmjpegstreamer");
-        auto init_res_str = init_res.serialize();
+        if (req.hasQueryKey("snapshot")) {
+            return sendSnapshot(sockfd, req, topic);
+        }
+        if (publisher_.admit(sockfd, topic) != nadjieb::net::Admission::ADMITTED) {
+            return sendUnavailable(sockfd, req);
+        }
+
+        auto content_type = publisher_.getContentType(req.getPath());
 
-        nadjieb::net::sendViaSocket(sockfd, init_res_str.c_str(), init_res_str.size(), 0);
+        auto& init_res
+            = nadjieb::net::ResponseBuilder::forThread()
+                  .start(req.getVersion(), 200, "OK")
+                  .connection(false)
+                  .header("Cache-Control", "no-cache, no-store, must-revalidate, pre-check=0, post-check=0, max-age=0")
+                  .header("Pragma", "no-cache")
+                  .header(
+                      "Content-Type",
+                      content_type.empty() ? std::string("multipart/x-mixed-replace; boundary=nadjiebmjpegstreamer")
+                                           : content_type)
+                  .finishStream();
 
-        publisher_.add(sockfd, req.getTarget());
+        nadjieb::net::sendAllViaSocket(sockfd, init_res, SEND_TIMEOUT_MS);
+
+        publisher_.add(
+            sockfd, topic,
+            content_type.empty() ? nadjieb::net::Transport::MULTIPART : nadjieb::net::Transport::FRAMED);
+
+        // The stream runs until the client hangs up, nothing it sends matters anymore
+        cb_res.mode = nadjieb::net::ConnectionMode::DISCARD;
 
         return cb_res;
     };
 
-    nadjieb::net::OnBeforeCloseCallback on_before_close_cb_
-        = [&](const nadjieb::net::SocketFD& sockfd) { publisher_.removeClient(sockfd); };
+    nadjieb::net::OnBeforeCloseCallback on_before_close_cb_ = [&](const nadjieb::net::SocketFD& sockfd) {
+        publisher_.removeClient(sockfd);
+
+        {
+            std::unique_lock<std::mutex> lock(websocket_clients_mtx_);
+            websocket_clients_.erase(sockfd);
+        }
+
+        std::shared_lock routes_lock(routes_mtx_);
+        for (const auto& route : routes_) {
+            if (route.second.on_close) {
+                route.second.on_close(sockfd);
+            }
+        }
+    };
 };
 }  // namespace nadjieb
@@ -0,0 +1,70 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "ClientHealthMJPEG.generated.h"
+
+UENUM(BlueprintType)
+enum class ESlowClientActionMJPEG : uint8
+{
+    // Only skip the frames a client has no room for
+    None,
+    // Deliver every 2nd, 4th, ... frame to the client while it stays behind
+    ReduceFrameRate,
+    // Move the client to a half resolution rendition of the stream first, then reduce its frame rate
+    Downgrade
+};
+
+// Same order as nadjieb::net::ClientEventType
+UENUM(BlueprintType)
+enum class ESlowClientEventMJPEG : uint8
+{
+    // The client started skipping frames
+    Behind,
+    ReducedFrameRate,
+    Downgraded,
+    // The client skipped nothing for a while
+    Recovered,
+    // The client stayed behind for SlowClientDisconnectSeconds and was dropped
+    Disconnected
+};
+
+USTRUCT(BlueprintType)
+struct FStreamClientStatsMJPEG
+{
+    GENERATED_BODY()
+
+    // Remote address:port
+    UPROPERTY(BlueprintReadOnly, Category = "Stream|Clients")
+    FString Address;
+
+    // Path (and region) the client currently receives
+    UPROPERTY(BlueprintReadOnly, Category = "Stream|Clients")
+    FString Stream;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Stream|Clients")
+    int64 DeliveredFrames = 0;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Stream|Clients")
+    int64 SkippedFrames = 0;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Stream|Clients")
+    int64 BytesSent = 0;
+
+    // Averaged over the last few seconds
+    UPROPERTY(BlueprintReadOnly, Category = "Stream|Clients")
+    float ThroughputKBps = 0.0f;
+
+    // How long the client has been skipping frames, 0 while it keeps up
+    UPROPERTY(BlueprintReadOnly, Category = "Stream|Clients")
+    float SecondsBehind = 0.0f;
+
+    // Every FrameInterval-th frame is delivered
+    UPROPERTY(BlueprintReadOnly, Category = "Stream|Clients")
+    int32 FrameInterval = 1;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Stream|Clients")
+    bool bDowngraded = false;
+};
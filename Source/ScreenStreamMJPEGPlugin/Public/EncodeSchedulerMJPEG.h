@@ -0,0 +1,109 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/PlatformAffinity.h"
+#include "Templates/Function.h"
+
+class FEncodeSchedulerMJPEG;
+class FEncodeWorkerMJPEG;
+
+/**
+ * Encode jobs of one stream. Jobs of a queue run one at a time and in the order they were submitted,
+ * jobs of different queues run in parallel on the threads of FEncodeSchedulerMJPEG.
+ * Create queues with FEncodeSchedulerMJPEG::CreateQueue.
+ */
+class SCREENSTREAMMJPEGPLUGIN_API FEncodeQueueMJPEG : public TSharedFromThis<FEncodeQueueMJPEG, ESPMode::ThreadSafe>
+{
+public:
+    ~FEncodeQueueMJPEG();
+
+    // Queues with higher priority are served first while every encode thread is busy
+    void SetPriority(int32 InPriority);
+    int32 GetPriority() const { return Priority; }
+
+    // Submitting more jobs than this drops the oldest waiting one
+    void SetMaxWaitingJobs(int32 Count);
+
+    // Queues a job. Drop runs instead of Encode if the job is still waiting at DeadlineSeconds
+    // (FPlatformTime::Seconds, 0 = no deadline), is pushed out by newer jobs or the queue is flushed
+    void Submit(TUniqueFunction<void()> Encode, TUniqueFunction<void()> Drop, double DeadlineSeconds);
+
+    // Drops the waiting jobs and waits for the running one. Call before anything the jobs reference goes away
+    void Flush();
+
+private:
+    friend class FEncodeSchedulerMJPEG;
+
+    struct FJob
+    {
+        TUniqueFunction<void()> Encode;
+        TUniqueFunction<void()> Drop;
+        double DeadlineSeconds = 0.0;
+    };
+
+    explicit FEncodeQueueMJPEG(FEncodeSchedulerMJPEG &InScheduler) : Scheduler(InScheduler) {}
+
+    FEncodeSchedulerMJPEG &Scheduler;
+
+    // Everything below is guarded by the scheduler lock
+    int32 Priority = 0;
+    int32 MaxWaitingJobs = 4;
+    TArray<FJob> WaitingJobs;
+    bool bRunning = false;
+    bool bReady = false;
+};
+
+/**
+ * Process-wide pool of encode threads shared by every stream actor. Threads are started on demand up to
+ * the configured maximum; each picks the waiting queue with the highest priority, oldest first among equals,
+ * so busy low priority streams cannot take the threads away from high priority ones.
+ */
+class SCREENSTREAMMJPEGPLUGIN_API FEncodeSchedulerMJPEG
+{
+public:
+    static FEncodeSchedulerMJPEG &Get();
+
+    TSharedRef<FEncodeQueueMJPEG, ESPMode::ThreadSafe> CreateQueue();
+
+    // Upper bound for encode threads. Lowering it parks the surplus threads
+    void SetMaxThreads(int32 Count);
+    int32 GetMaxThreads() const;
+
+    // Number of encode threads started so far
+    int32 GetNumThreads() const;
+
+    // Priority of the encode threads and the CPUs they may run on (0 = any). The priority also applies to running
+    // threads, the affinity only to threads started afterwards, so set it before the first frame is encoded
+    void SetThreadPlacement(EThreadPriority Priority, uint64 AffinityMask);
+
+    // Stops every thread. Called on module shutdown, after all streams were flushed
+    void Shutdown();
+
+private:
+    friend class FEncodeQueueMJPEG;
+    friend class FEncodeWorkerMJPEG;
+
+    FEncodeSchedulerMJPEG();
+    ~FEncodeSchedulerMJPEG();
+
+    // Marks Queue as having work and wakes or starts a thread for it. Lock must be held
+    void MakeReady(FEncodeQueueMJPEG &Queue);
+
+    // Runs jobs on Worker until there is nothing left for it. False once the worker should exit
+    bool RunJobs(FEncodeWorkerMJPEG &Worker);
+
+    mutable FCriticalSection Lock;
+
+    // Queues with waiting jobs that no thread runs right now, in the order they became ready
+    TArray<TSharedPtr<FEncodeQueueMJPEG, ESPMode::ThreadSafe>> ReadyQueues;
+
+    TArray<FEncodeWorkerMJPEG *> Workers;
+    TArray<FEncodeWorkerMJPEG *> IdleWorkers;
+    int32 MaxThreads = 1;
+    // Below the game and render threads by default, encoding must not delay the next frame
+    EThreadPriority ThreadPriority = TPri_BelowNormal;
+    uint64 ThreadAffinityMask = 0;
+    bool bShutdown = false;
+};
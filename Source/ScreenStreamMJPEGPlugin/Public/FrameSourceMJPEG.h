@@ -0,0 +1,200 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+class ASceneCapture2D;
+class USceneCaptureComponent2D;
+struct FRenderRequestStreamMJPEGStruct;
+struct FCaptureGpuTimerMJPEG;
+struct FViewportGrabStateMJPEG;
+
+#include "CoreMinimal.h"
+
+#include "FrameSourceMJPEG.generated.h"
+
+UENUM(BlueprintType)
+enum class EFrameSourceTypeMJPEG : uint8
+{
+    // Read back the render target of CaptureComponent
+    SceneCapture,
+    // Generate deterministic test patterns on the CPU (no GPU required)
+    Synthetic,
+    // Grab the game viewport back buffer as presented (scene and UI), without a second scene render
+    Viewport,
+    // Capture every camera of CaptureGroup in the same game frame (stereo pairs, surround views)
+    CaptureGroup
+};
+
+UENUM(BlueprintType)
+enum class ESyntheticPatternMJPEG : uint8
+{
+    // Diagonal gradient scrolling by a few pixels per frame
+    MovingGradient,
+    // Per-pixel noise, reseeded every frame (worst case for JPEG)
+    Noise,
+    // Fixed color bars, identical on every frame (best case for JPEG)
+    Static
+};
+
+UENUM(BlueprintType)
+enum class ECaptureCostProfileMJPEG : uint8
+{
+    // Leave capture source and show flags of the capture component as configured
+    Custom,
+    // Final color with temporal AA, like the player view
+    Cinematic,
+    // Final color with FXAA instead of temporal AA; no motion blur, depth of field or lens flares
+    Balanced,
+    // Balanced without anti-aliasing, bloom, ambient occlusion, volumetric fog, screen space and Lumen reflections or Lumen GI
+    Fast
+};
+
+/**
+ * Produces raw BGRA frames for AStreamManagerMJPEG.
+ * A source either fills the request on the spot or issues an asynchronous
+ * readback and sets bReadsBackOnRenderThread. The manager enqueues a render
+ * command after RequestFrame that marks the request complete, so readbacks done in
+ * render commands enqueued from RequestFrame need nothing else. Sources that fill
+ * the request later also set bSignalsCompletion and call
+ * AStreamManagerMJPEG::CompleteReadback themselves.
+ * All methods are called on the game thread.
+ */
+class SCREENSTREAMMJPEGPLUGIN_API IFrameSourceMJPEG
+{
+public:
+    virtual ~IFrameSourceMJPEG() = default;
+
+    // Short name used in logs
+    virtual const TCHAR *GetName() const = 0;
+
+    // False if the source cannot produce frames (e.g. missing capture actor)
+    virtual bool IsValidSource() const = 0;
+
+    // Called when the stream resolution changes
+    virtual void SetFrameSize(int32 Width, int32 Height) = 0;
+
+    // Starts producing the next frame into Request. Returns false to skip this capture.
+    virtual bool RequestFrame(FRenderRequestStreamMJPEGStruct &Request) = 0;
+
+    // Called once a request with bSignalsCompletion is queued. Such sources hand the request to whatever completes
+    // it only here: completed before it was queued, its completion would find nothing to process
+    virtual void OnRequestQueued(FRenderRequestStreamMJPEGStruct &Request) {}
+
+    // GPU time spent rendering one frame, averaged over recent frames. 0 if the source does not render or cannot tell
+    virtual float GetGpuTimeMs() const { return 0.0f; }
+
+    // Called before the manager frees requests. Sources with bSignalsCompletion must not touch any
+    // request they were given once this returns
+    virtual void CancelPendingFrames() {}
+
+    // Number of views per frame. Image holds them stacked top to bottom, each Width x Height
+    virtual int32 GetViewCount() const { return 1; }
+};
+
+/**
+ * Reads back the color target of an ASceneCapture2D (the original capture path).
+ * With bCaptureOnRequest the scene is rendered right before each readback instead of
+ * every game frame, and the GPU time of that render is measured with timestamp queries.
+ */
+class SCREENSTREAMMJPEGPLUGIN_API FSceneCaptureFrameSourceMJPEG : public IFrameSourceMJPEG
+{
+public:
+    explicit FSceneCaptureFrameSourceMJPEG(ASceneCapture2D *InCaptureActor, bool bInVerboseLogging = false, bool bInCaptureOnRequest = false);
+
+    virtual const TCHAR *GetName() const override { return TEXT("SceneCapture"); }
+    virtual bool IsValidSource() const override;
+    virtual void SetFrameSize(int32 Width, int32 Height) override;
+    virtual bool RequestFrame(FRenderRequestStreamMJPEGStruct &Request) override;
+    virtual float GetGpuTimeMs() const override;
+
+    // Sets capture source and show flags of Component for Profile (Custom leaves them alone)
+    static void ApplyCostProfile(USceneCaptureComponent2D *Component, ECaptureCostProfileMJPEG Profile);
+
+private:
+    TWeakObjectPtr<ASceneCapture2D> CaptureActor;
+    bool bVerboseLogging = false;
+    bool bCaptureOnRequest = false;
+
+    // Shared with the render commands that write and read the timestamps
+    TSharedPtr<FCaptureGpuTimerMJPEG, ESPMode::ThreadSafe> GpuTimer;
+};
+
+/**
+ * Captures several ASceneCapture2D rigs as one frame: all members are rendered in the same game frame
+ * and read back by a single render command, so the manager waits on one completion for all of them.
+ * Every member needs a render target of the stream size; their images are stacked in member order.
+ */
+class SCREENSTREAMMJPEGPLUGIN_API FCaptureGroupFrameSourceMJPEG : public IFrameSourceMJPEG
+{
+public:
+    FCaptureGroupFrameSourceMJPEG(const TArray<ASceneCapture2D *> &InCaptureActors, bool bInCaptureOnRequest = false);
+
+    virtual const TCHAR *GetName() const override { return TEXT("CaptureGroup"); }
+    virtual bool IsValidSource() const override;
+    virtual void SetFrameSize(int32 Width, int32 Height) override;
+    virtual bool RequestFrame(FRenderRequestStreamMJPEGStruct &Request) override;
+    virtual int32 GetViewCount() const override { return CaptureActors.Num(); }
+
+private:
+    TArray<TWeakObjectPtr<ASceneCapture2D>> CaptureActors;
+    bool bCaptureOnRequest = false;
+
+    // Readback target of a single member, only touched on the render thread
+    TSharedPtr<TArray<FColor>, ESPMode::ThreadSafe> ViewScratch;
+};
+
+/**
+ * Grabs the game viewport back buffer when Slate presents it: what the player sees, UI included,
+ * for the cost of one copy instead of a second scene render. When the stream size differs from the
+ * back buffer it is scaled on the GPU before the readback. Set the stream size to the viewport's
+ * aspect ratio, the image is stretched otherwise.
+ */
+class SCREENSTREAMMJPEGPLUGIN_API FViewportFrameSourceMJPEG : public IFrameSourceMJPEG
+{
+public:
+    FViewportFrameSourceMJPEG(int32 InWidth, int32 InHeight);
+    virtual ~FViewportFrameSourceMJPEG() override;
+
+    virtual const TCHAR *GetName() const override { return TEXT("Viewport"); }
+    virtual bool IsValidSource() const override;
+    virtual void SetFrameSize(int32 InWidth, int32 InHeight) override;
+    virtual bool RequestFrame(FRenderRequestStreamMJPEGStruct &Request) override;
+    virtual void OnRequestQueued(FRenderRequestStreamMJPEGStruct &Request) override;
+    virtual void CancelPendingFrames() override;
+
+private:
+    int32 Width;
+    int32 Height;
+
+    // Pending requests and the render thread side, kept alive by the back buffer delegate while it runs
+    TSharedPtr<FViewportGrabStateMJPEG, ESPMode::ThreadSafe> State;
+    FDelegateHandle BackBufferReadyHandle;
+};
+
+/**
+ * Generates deterministic BGRA test patterns on the CPU.
+ * Frame N of a given pattern, size and seed is always identical, so encode
+ * and publish timings are comparable between runs and machines (-nullrhi).
+ */
+class SCREENSTREAMMJPEGPLUGIN_API FSyntheticFrameSourceMJPEG : public IFrameSourceMJPEG
+{
+public:
+    FSyntheticFrameSourceMJPEG(ESyntheticPatternMJPEG InPattern, int32 InWidth, int32 InHeight, uint32 InSeed = 0);
+
+    virtual const TCHAR *GetName() const override { return TEXT("Synthetic"); }
+    virtual bool IsValidSource() const override { return Width > 0 && Height > 0; }
+    virtual void SetFrameSize(int32 InWidth, int32 InHeight) override;
+    virtual bool RequestFrame(FRenderRequestStreamMJPEGStruct &Request) override;
+
+    // Fills OutImage with frame FrameIndex of the pattern (exposed for tests and benchmarks)
+    static void GeneratePattern(ESyntheticPatternMJPEG Pattern, int32 Width, int32 Height, uint32 Seed, uint64 FrameIndex, TArray<FColor> &OutImage);
+
+    uint64 GetFrameIndex() const { return FrameIndex; }
+
+private:
+    ESyntheticPatternMJPEG Pattern;
+    int32 Width;
+    int32 Height;
+    uint32 Seed;
+    uint64 FrameIndex = 0;
+};
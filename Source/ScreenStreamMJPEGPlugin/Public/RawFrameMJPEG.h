@@ -0,0 +1,46 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "RawFrameMJPEG.generated.h"
+
+UENUM(BlueprintType)
+enum class EStreamModeMJPEG : uint8
+{
+    // Encode and publish JPEG only (/stream.mjpg)
+    Jpeg,
+    // Publish uncompressed frames only (/stream.raw), no JPEG encoding at all
+    Raw,
+    // Publish both
+    JpegAndRaw
+};
+
+UENUM(BlueprintType)
+enum class ERawFrameFormatMJPEG : uint8
+{
+    // The readback as is, 4 bytes per pixel
+    BGRA,
+    // Y plane followed by interleaved UV at half resolution (BT.601, limited range)
+    NV12,
+    // Y plane followed by U and V planes at half resolution (BT.601, limited range)
+    I420
+};
+
+/**
+ * Packs readback pixels into the self-describing payload published on the raw path:
+ * a 16-byte header (FourCC, width, height, stride of the first plane, uint32 little endian)
+ * followed by the planes, tightly packed.
+ */
+class SCREENSTREAMMJPEGPLUGIN_API FRawFrameMJPEG
+{
+public:
+    static constexpr int32 HeaderSize = 16;
+
+    // Bytes of the pixel data following the header
+    static int64 GetImageSize(ERawFrameFormatMJPEG Format, int32 Width, int32 Height);
+
+    // Writes header and pixels to Out, which must hold HeaderSize + GetImageSize() bytes
+    static void Pack(ERawFrameFormatMJPEG Format, const FColor *Pixels, int32 Width, int32 Height, uint8 *Out);
+};
@@ -5,8 +5,16 @@
 class ASceneCapture2D;
 class UMaterial;
 class FMJPEGStreamerImpl;
+class FEncodeQueueMJPEG;
+class IImageWrapper;
+struct FReadbackCompletionMJPEG;
 
 #include "CoreMinimal.h"
+#include "ClientHealthMJPEG.h"
+#include "FrameSourceMJPEG.h"
+#include "RawFrameMJPEG.h"
+#include "StreamThreadsMJPEG.h"
+#include "TileStreamMJPEG.h"
 #include "GameFramework/Actor.h"
 #include "Containers/Queue.h"
 #include "Async/AsyncWork.h"
@@ -15,19 +23,83 @@ DECLARE_LOG_CATEGORY_EXTERN(LogStreamMJPEG, Log, All);
 
 #include "StreamManagerMJPEG.generated.h"
 
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnSlowClientMJPEG, ESlowClientEventMJPEG, Event, const FStreamClientStatsMJPEG&, Client);
+
+// Layout of the BGRA pixels in a request, fixed when the capture is requested
+struct FFrameFormatMJPEG
+{
+    int32 Width = 0;
+    int32 Height = 0;
+
+    // Views stacked top to bottom, each Width x Height, see IFrameSourceMJPEG::GetViewCount
+    int32 ViewCount = 1;
+
+    int32 GetImageHeight() const { return Height * ViewCount; }
+    int64 GetNumPixels() const { return static_cast<int64>(Width) * Height * ViewCount; }
+
+    bool operator==(const FFrameFormatMJPEG &Other) const
+    {
+        return Width == Other.Width && Height == Other.Height && ViewCount == Other.ViewCount;
+    }
+    bool operator!=(const FFrameFormatMJPEG &Other) const { return !(*this == Other); }
+
+    friend uint32 GetTypeHash(const FFrameFormatMJPEG &Format)
+    {
+        return HashCombine(HashCombine(::GetTypeHash(Format.Width), ::GetTypeHash(Format.Height)), ::GetTypeHash(Format.ViewCount));
+    }
+};
+
 USTRUCT()
 struct FRenderRequestStreamMJPEGStruct
 {
     GENERATED_BODY()
 
     TArray<FColor> Image;
-    FRenderCommandFence RenderFence;
+
+    // What Image holds once the readback completed, whatever the stream size is by then
+    FFrameFormatMJPEG Format;
+
+    // False if the frame source filled Image synchronously
+    bool bReadsBackOnRenderThread = true;
+
+    // Set by sources that fill Image later than the render commands they enqueue from RequestFrame
+    // (e.g. when the back buffer is presented). They call AStreamManagerMJPEG::CompleteReadback themselves
+    bool bSignalsCompletion = false;
+
+    // Set (on the render thread for asynchronous sources) once Image holds the frame
+    std::atomic<bool> bReadbackComplete{false};
+
+    // Set together with bReadbackComplete by sources that gave up on the frame. Image is empty, the request is
+    // released without encoding so the requests queued after it can complete
+    bool bReadbackFailed = false;
+
+    // Where completion is reported, see AStreamManagerMJPEG::CompleteReadback
+    TSharedPtr<FReadbackCompletionMJPEG, ESPMode::ThreadSafe> Completion;
+
+    // Bytes of Image currently charged to the memory budget
+    int64 AccountedBytes = 0;
+
+    // Capture time in microseconds since the Unix epoch, carried into the published frame
+    int64 CaptureTimestampUs = 0;
+
+    // Sequence number of the capture, shared by every path the frame and its views are published on
+    int64 FrameNumber = 0;
 
     FRenderRequestStreamMJPEGStruct()
     {
     }
 };
 
+// Requests are only ever handled through pointers; the atomic flag makes them non-copyable
+template <>
+struct TStructOpsTypeTraits<FRenderRequestStreamMJPEGStruct> : public TStructOpsTypeTraitsBase2<FRenderRequestStreamMJPEGStruct>
+{
+    enum
+    {
+        WithCopy = false
+    };
+};
+
 UCLASS(Blueprintable)
 class SCREENSTREAMMJPEGPLUGIN_API AStreamManagerMJPEG : public AActor
 {
@@ -39,6 +111,118 @@ public:
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream")
     int ServerPort = 8000;
 
+    // If ServerPort is taken, the next this many ports are tried in order, see GetServerPort.
+    // 0 = fail and log an error instead
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Network", meta = (ClampMin = "0", ClampMax = "1000"))
+    int32 ServerPortFallbackCount = 0;
+
+    // Threads accepting connections and reading requests. On Linux each binds ServerPort with SO_REUSEPORT,
+    // so reconnect storms are spread across them; elsewhere they share one listening socket
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Network", meta = (ClampMin = "1", ClampMax = "64"))
+    int32 ListenerThreadCount = 1;
+
+    // Start the listener and publisher threads as engine threads (FRunnableThread), named MJPEGListener<n> and
+    // MJPEGPublisher<n> in Unreal Insights. Off, they are std::threads with the same OS thread names
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Threads")
+    bool bUseUnrealThreads = false;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Threads")
+    FStreamThreadPlacementMJPEG ListenerThreadPlacement;
+
+    // Upper bound for the threads sending frames to clients, started as clients need them. 0 = one per core
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Threads", meta = (ClampMin = "0", ClampMax = "64"))
+    int32 PublisherThreadCount = 0;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Threads")
+    FStreamThreadPlacementMJPEG PublisherThreadPlacement;
+
+    // Shared by all stream actors in the process like MaxEncodeThreads; the last actor to begin play sets it
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Threads")
+    FStreamThreadPlacementMJPEG EncodeThreadPlacement{EStreamThreadPriorityMJPEG::BelowNormal};
+
+    // Send frames through io_uring (Linux 5.11+), batching the sends to many clients into few syscalls.
+    // Only the publisher's sends use the ring; accepting connections and reading requests stay on the poll
+    // based listener loops. Falls back to poll/send where io_uring is unavailable
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Network")
+    bool bUseIoUring = false;
+
+    // Send large frames with MSG_ZEROCOPY (Linux), so the kernel reads them from the shared frame instead of
+    // copying them once per client. Only pays off on real NICs; loopback clients fall back to plain sends
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Network")
+    bool bEnableZeroCopy = false;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Network", meta = (ClampMin = "16", EditCondition = "bEnableZeroCopy"))
+    int32 ZeroCopyMinFrameKB = 256;
+
+    // IPv4 address the server listens on. 127.0.0.1 keeps the stream on this machine
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Network")
+    FString BindAddress = TEXT("0.0.0.0");
+
+    // Disable Nagle's algorithm, so small responses and frame tails are not held back
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Network")
+    bool bTcpNoDelay = true;
+
+    // Kernel send buffer per client (SO_SNDBUF). 0 = OS default, which Linux autotunes up to several MB
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Network", meta = (ClampMin = "0"))
+    int32 SendBufferSizeKB = 0;
+
+    // Unsent bytes per client above which its socket stops counting as writable (TCP_NOTSENT_LOWAT, Linux/macOS).
+    // A client that cannot keep up then gets frames skipped instead of seconds of them queued in the kernel. 0 = off
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Network", meta = (ClampMin = "0"))
+    int32 NotSentLowWatermarkKB = 128;
+
+    // TCP keepalive probes, so viewers that vanished without closing the connection are dropped
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Network")
+    bool bTcpKeepAlive = true;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Network", meta = (ClampMin = "1", EditCondition = "bTcpKeepAlive"))
+    int32 KeepAliveIdleSeconds = 30;
+
+    // What happens to a client that skips frames because its connection cannot keep up. Downgrade needs
+    // region of interest support and enables it for the JPEG stream
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Clients")
+    ESlowClientActionMJPEG SlowClientAction = ESlowClientActionMJPEG::ReduceFrameRate;
+
+    // How long a client is behind before SlowClientAction is taken, and between further steps
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Clients", meta = (ClampMin = "0.1"))
+    float SlowClientGraceSeconds = 2.0f;
+
+    // A slow client still gets at least every n-th frame
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Clients", meta = (ClampMin = "1", ClampMax = "64"))
+    int32 SlowClientMaxFrameInterval = 8;
+
+    // Disconnect clients that are still behind after this long. 0 = never
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Clients", meta = (ClampMin = "0.0"))
+    float SlowClientDisconnectSeconds = 0.0f;
+
+    // Broadcast on the game thread when a client falls behind, is throttled, downgraded, recovers or is dropped
+    UPROPERTY(BlueprintAssignable, Category = "Stream|Clients")
+    FOnSlowClientMJPEG OnSlowClient;
+
+    // Stream clients (HTTP and WebSocket) of all paths; more get 503 Service Unavailable. 0 = unlimited
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Admission", meta = (ClampMin = "0"))
+    int32 MaxClients = 0;
+
+    // Stream clients of one path (e.g. /stream.mjpg with all its regions). 0 = unlimited
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Admission", meta = (ClampMin = "0"))
+    int32 MaxClientsPerStream = 0;
+
+    // Retry-After sent with the 503, so well-behaved viewers back off instead of reconnecting at once
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Admission", meta = (ClampMin = "0"))
+    int32 RetryAfterSeconds = 5;
+
+    // Total send rate to all clients. Above it every client gets every 2nd, 4th, ... frame. 0 = unlimited
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Admission", meta = (ClampMin = "0.0"))
+    float MaxBandwidthMBps = 0.0f;
+
+    // CPU load of the process across all cores. Above it every client gets every 2nd, 4th, ... frame. 0 = unlimited
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Admission", meta = (ClampMin = "0.0", ClampMax = "100.0"))
+    float MaxCpuLoadPercent = 0.0f;
+
+    // Shedding stops halving the frame rate here; if the load is still too high, new clients are turned away
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Admission", meta = (ClampMin = "1", ClampMax = "64"))
+    int32 MaxShedFrameInterval = 8;
+
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream")
     int FrameWidth = 640;
 
@@ -48,29 +232,363 @@ public:
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream")
     ASceneCapture2D *CaptureComponent;
 
+    // Where frames come from. Synthetic needs no CaptureComponent and no GPU (works with -nullrhi)
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Source")
+    EFrameSourceTypeMJPEG FrameSourceType = EFrameSourceTypeMJPEG::SceneCapture;
+
+    // Render the scene capture only for frames that are streamed, instead of every game frame
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Source", meta = (EditCondition = "FrameSourceType == EFrameSourceTypeMJPEG::SceneCapture"))
+    bool bCaptureOnlyStreamedFrames = true;
+
+    // Show flags and capture source of the scene capture. Cinematic keeps the image of earlier versions; temporal AA
+    // needs a capture every frame to look right, so opt into Balanced or Fast when bCaptureOnlyStreamedFrames is set
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Source", meta = (EditCondition = "FrameSourceType == EFrameSourceTypeMJPEG::SceneCapture"))
+    ECaptureCostProfileMJPEG CaptureCostProfile = ECaptureCostProfileMJPEG::Cinematic;
+
+    // Cameras captured together in one game frame. Each is streamed on /cam<index>.mjpg, all of them stacked
+    // top to bottom on /stream.mjpg, and frames of one capture carry the same X-Sequence
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Source", meta = (EditCondition = "FrameSourceType == EFrameSourceTypeMJPEG::CaptureGroup"))
+    TArray<ASceneCapture2D *> CaptureGroup;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Source", meta = (EditCondition = "FrameSourceType == EFrameSourceTypeMJPEG::Synthetic"))
+    ESyntheticPatternMJPEG SyntheticPattern = ESyntheticPatternMJPEG::MovingGradient;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Source", meta = (EditCondition = "FrameSourceType == EFrameSourceTypeMJPEG::Synthetic"))
+    int32 SyntheticSeed = 0;
+
+    // Frames per second captured automatically from Tick. 0 = manual capture via CaptureNonBlocking
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream", meta = (ClampMin = "0.0"))
+    float CaptureFrameRate = 0.0f;
+
+    // Hand every frame to the encode threads as soon as the render thread has read it back, instead of on the
+    // next Tick. Saves up to a game frame of latency and lets the stream run faster than the game tick
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream")
+    bool bLowLatencyReadback = false;
+
+    // Streams with higher priority are encoded first while the shared encode threads are saturated
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Encode")
+    int32 EncodePriority = 0;
+
+    // Frames still waiting for an encode thread this long after capture are dropped. 0 = never
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Encode", meta = (ClampMin = "0.0"))
+    float EncodeDeadlineSeconds = 0.25f;
+
+    // Encode threads shared by all stream actors in the process. 0 keeps the current limit (half the cores, at most 4)
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Encode", meta = (ClampMin = "0", ClampMax = "64"))
+    int32 MaxEncodeThreads = 0;
+
+    // JPEG on /stream.mjpg, uncompressed frames on /stream.raw, or both. Raw alone skips JPEG encoding entirely
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Raw")
+    EStreamModeMJPEG StreamMode = EStreamModeMJPEG::Jpeg;
+
+    // Pixel layout of the frames on /stream.raw
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Raw", meta = (EditCondition = "StreamMode != EStreamModeMJPEG::Jpeg"))
+    ERawFrameFormatMJPEG RawFrameFormat = ERawFrameFormatMJPEG::NV12;
+
+    // Also publish only the tiles that changed since the previous frame, as small JPEGs, on /stream.tiles.
+    // A viewer that composites them on a canvas is served at /tiles.html. Pays off for mostly static content
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Tiles")
+    bool bEnableTileStream = false;
+
+    // Edge length of a tile in pixels, rounded down to a multiple of 16. Smaller tiles send less of a change
+    // but compress worse and cost more per frame
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Tiles", meta = (ClampMin = "16", ClampMax = "256", EditCondition = "bEnableTileStream"))
+    int32 TileSize = 64;
+
+    // Send every tile every this many frames, so viewers that skipped frames catch up. 0 = only when a viewer joins
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Tiles", meta = (ClampMin = "0", EditCondition = "bEnableTileStream"))
+    int32 TileKeyFrameInterval = 120;
+
+    // Let clients request a crop of the JPEG stream with /stream.mjpg?roi=x,y,w,h[&scale=2|4|8].
+    // Each distinct region is encoded once per frame, however many clients watch it
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream")
+    bool bEnableRegionOfInterest = false;
+
+    // Upper bound in bytes for raw frames, encoded frames and queued payloads together. 0 = unlimited
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Memory", meta = (ClampMin = "0"))
+    int64 MemoryBudgetBytes = 256 * 1024 * 1024;
+
+    // Start recording the stream to disk as soon as it starts
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Recording")
+    bool bRecordOnBeginPlay = false;
+
+    // Directory for .mjpr recordings. Empty = <Project>/Saved/StreamRecordings
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Recording")
+    FString RecordingDirectory;
+
+    // Start a new file once the current one reaches this size. 0 = no limit
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Recording", meta = (ClampMin = "0"))
+    int32 RecordingMaxFileSizeMB = 1024;
+
+    // Start a new file once the current one spans this many seconds. 0 = no limit
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Recording", meta = (ClampMin = "0.0"))
+    float RecordingMaxFileDurationSeconds = 600.0f;
+
+    // Serve the recordings in RecordingDirectory as http://host:port/replay/<name>.mjpg (?t=seconds&speed=x)
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Recording")
+    bool bEnableReplay = false;
+
+    // Also send the stream as RTP/JPEG (RFC 2435) over UDP as soon as it starts
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|RTP")
+    bool bEnableRtp = false;
+
+    // Unicast or multicast (224.0.0.0/4) IPv4 destination
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|RTP")
+    FString RtpAddress = TEXT("239.255.0.1");
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|RTP", meta = (ClampMin = "1", ClampMax = "65535"))
+    int32 RtpPort = 5004;
+
+    // Multicast hop limit. 1 keeps the stream on the local network
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|RTP", meta = (ClampMin = "0", ClampMax = "255"))
+    int32 RtpMulticastTtl = 1;
+
+    // Local address of the interface multicast is sent from. Empty = default route
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|RTP")
+    FString RtpMulticastInterface;
+
+    // Largest UDP payload in bytes, keep below the network MTU
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|RTP", meta = (ClampMin = "256", ClampMax = "65000"))
+    int32 RtpMaxPacketSize = 1400;
+
+    // Also write every frame into a shared-memory ring for processes on this host (see mjpeg_shm.hpp)
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|SharedMemory")
+    bool bEnableSharedMemory = false;
+
+    // Name of the shared-memory object (/dev/shm/<name> on Linux, Local\<name> on Windows)
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|SharedMemory")
+    FString SharedMemoryName = TEXT("ScreenStreamMJPEG");
+
+    // Frames kept in the ring; readers that fall further behind skip ahead to the newest frame
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|SharedMemory", meta = (ClampMin = "2", ClampMax = "64"))
+    int32 SharedMemorySlotCount = 4;
+
+    // Largest frame in MB; larger frames are skipped. Raw 1080p BGRA needs 8
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|SharedMemory", meta = (ClampMin = "1", ClampMax = "256"))
+    int32 SharedMemorySlotSizeMB = 8;
+
+    // Write the raw frames of /stream.raw instead of JPEG (needs StreamMode Raw or JpegAndRaw)
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|SharedMemory")
+    bool bSharedMemoryRawFrames = false;
+
     UPROPERTY(EditAnywhere, Category = "Logging")
     bool VerboseLogging = false;
 
+    // Picks up FrameWidth and FrameHeight at the next capture. Frames in flight are published at the size they
+    // were captured at, nothing is flushed
     UFUNCTION(BlueprintCallable, Category = "Stream")
     void UpdateRenderTargetAfterFrameSizeChanged();
 
+    // Changes the stream resolution from the next capture on, e.g. to shed load
+    UFUNCTION(BlueprintCallable, Category = "Stream")
+    void SetFrameSize(int32 Width, int32 Height);
+
+    // Replaces the frame source (C++ only, e.g. for automation tests). Call before BeginPlay to skip the default source
+    void SetFrameSource(TUniquePtr<IFrameSourceMJPEG> NewFrameSource);
+
+    IFrameSourceMJPEG *GetFrameSource() const { return FrameSource.Get(); }
+
+    // Marks Request as filled and wakes its consumer. Called on the render thread; the request may be
+    // recycled as soon as this returns
+    static void CompleteReadback(FRenderRequestStreamMJPEGStruct &Request);
+
+    // Switches the scene capture to another cost profile at runtime
+    UFUNCTION(BlueprintCallable, Category = "Stream|Source")
+    void SetCaptureCostProfile(ECaptureCostProfileMJPEG Profile);
+
+    // GPU time of one scene capture render, averaged over recent captures (needs bCaptureOnlyStreamedFrames).
+    // Each game frame not streamed saves this much compared to capturing every frame
+    UFUNCTION(BlueprintCallable, Category = "Stream|Source")
+    float GetCaptureGpuTimeMs() const;
+
+    // Port the server listens on, which differs from ServerPort after a fallback. 0 if it is not running
+    UFUNCTION(BlueprintCallable, Category = "Stream")
+    int32 GetServerPort() const;
+
+    // Number of frames encoded and published so far
+    UFUNCTION(BlueprintCallable, Category = "Stream")
+    int32 GetPublishedFrameCount() const { return ImgCounter.load(); }
+
+    // Applies a new memory budget at runtime
+    UFUNCTION(BlueprintCallable, Category = "Stream|Memory")
+    void SetMemoryBudget(int64 Bytes);
+
+    // Bytes currently held by the whole pipeline (pooled/queued raw frames and encoded frames)
+    UFUNCTION(BlueprintCallable, Category = "Stream|Memory")
+    int64 GetMemoryUsageBytes() const;
+
+    // Appends the already encoded frames to rotating files on a dedicated I/O thread
+    UFUNCTION(BlueprintCallable, Category = "Stream|Recording")
+    bool StartRecording();
+
+    UFUNCTION(BlueprintCallable, Category = "Stream|Recording")
+    void StopRecording();
+
+    UFUNCTION(BlueprintCallable, Category = "Stream|Recording")
+    bool IsRecording() const;
+
+    UFUNCTION(BlueprintCallable, Category = "Stream|Recording")
+    FString GetCurrentRecordingFile() const;
+
+    // Starts sending every published frame to RtpAddress:RtpPort; the SDP is served as /stream.sdp
+    UFUNCTION(BlueprintCallable, Category = "Stream|RTP")
+    bool StartRtp();
+
+    UFUNCTION(BlueprintCallable, Category = "Stream|RTP")
+    void StopRtp();
+
+    UFUNCTION(BlueprintCallable, Category = "Stream|RTP")
+    bool IsRtpRunning() const;
+
+    UFUNCTION(BlueprintCallable, Category = "Stream|SharedMemory")
+    bool StartSharedMemory();
+
+    UFUNCTION(BlueprintCallable, Category = "Stream|SharedMemory")
+    void StopSharedMemory();
+
+    UFUNCTION(BlueprintCallable, Category = "Stream|SharedMemory")
+    bool IsSharedMemoryActive() const;
+
+    // Delivery statistics of every connected stream client
+    UFUNCTION(BlueprintCallable, Category = "Stream|Clients")
+    TArray<FStreamClientStatsMJPEG> GetClientStats() const;
+
+    // Stream clients connected right now
+    UFUNCTION(BlueprintCallable, Category = "Stream|Admission")
+    int32 GetClientCount() const;
+
+    // Every client currently gets every n-th frame because of load shedding, 1 = all frames
+    UFUNCTION(BlueprintCallable, Category = "Stream|Admission")
+    int32 GetShedFrameInterval() const;
+
+    // Clients turned away with 503 so far
+    UFUNCTION(BlueprintCallable, Category = "Stream|Admission")
+    int64 GetRejectedClientCount() const;
+
+    // Applies a new encode priority at runtime
+    UFUNCTION(BlueprintCallable, Category = "Stream|Encode")
+    void SetEncodePriority(int32 Priority);
+
+    // Frames dropped because they waited longer than EncodeDeadlineSeconds for an encode thread
+    UFUNCTION(BlueprintCallable, Category = "Stream|Encode")
+    int32 GetStaleDroppedFrameCount() const { return StaleDroppedFrames.load(); }
+
+    // Captures skipped and raw frames dropped because the memory budget was exceeded
+    UFUNCTION(BlueprintCallable, Category = "Stream|Memory")
+    int32 GetBudgetDroppedFrameCount() const { return BudgetDroppedFrames.load(); }
+
 protected:
     // Pimpl to hide MJPEG streamer implementation details
     TUniquePtr<FMJPEGStreamerImpl> StreamerImpl;
 
+    // Produces the raw frames that get encoded and published
+    TUniquePtr<IFrameSourceMJPEG> FrameSource;
+
+    // Time accumulated towards the next automatic capture
+    float CaptureTimeAccumulator = 0.0f;
+
     // RenderRequest Queue
     TQueue<FRenderRequestStreamMJPEGStruct*> RenderRequestQueue;
     
     // Queue size tracker (TQueue doesn't expose size)
     std::atomic<int32> QueueSize{0};
 
-    int ImgCounter = 0;
+    std::atomic<int32> ImgCounter{0};
+
+    // Numbers the captures, see FRenderRequestStreamMJPEGStruct::FrameNumber
+    int64 CaptureFrameNumber = 0;
+
+    // Completed requests kept around per format, so their image allocation is reused by the next capture of that size
+    TMap<FFrameFormatMJPEG, TArray<FRenderRequestStreamMJPEGStruct*>> RenderRequestPools;
+
+    // Format of new captures. Changes only between two captures, see ApplyFrameFormat
+    FFrameFormatMJPEG CaptureFormat;
+
+    // Guards RenderRequestPools and CaptureFormat, encode threads return requests to the pools
+    FCriticalSection RenderRequestPoolLock;
+
+    static constexpr int32 MaxPooledRenderRequests = 3;
+
+    std::atomic<int32> BudgetDroppedFrames{0};
+
+    // Serializes the consumers of RenderRequestQueue and hands frames over on readback completion
+    TSharedPtr<FReadbackCompletionMJPEG, ESPMode::ThreadSafe> ReadbackCompletion;
+    friend struct FReadbackCompletionMJPEG;
+
+    // This stream's jobs on the process-wide encode threads
+    TSharedPtr<FEncodeQueueMJPEG, ESPMode::ThreadSafe> EncodeQueue;
+
+    std::atomic<int32> StaleDroppedFrames{0};
+
+    // Whether the last Start succeeded, GetServerPort reports 0 otherwise
+    bool bServerRunning = false;
+
+    // Shedding state last logged by Tick
+    int32 LastShedFrameInterval = 1;
+    bool bLastOverloaded = false;
+
+    // Used by one encode job at a time, like everything below
+    TSharedPtr<IImageWrapper> JpegImageWrapper;
+
+    // Reused for every region of interest crop
+    TArray<FColor> RegionOfInterestScratch;
+
+    // Previous frame of the tile stream, and the viewers it was sent to
+    FTileStreamMJPEG TileStream;
+    uint64 TileStreamJoinCount = 0;
+    uint64 TileStreamLostFrameCount = 0;
+    TArray<uint8> TilePayloadScratch;
 
 protected:
     virtual void BeginPlay() override;
     virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
-    void SetupCaptureComponent();
+    // Gives Capture a render target of the stream size and configures it for streaming
+    void SetupCaptureComponent(ASceneCapture2D *Capture);
+
+    void CreateDefaultFrameSource();
+
+    // RecordingDirectory, or the default under Saved, as an absolute path
+    FString GetResolvedRecordingDirectory() const;
+
+    // Switches new captures to the current FrameWidth, FrameHeight and view count, if they changed.
+    // Requests of the old format finish as they are and are freed instead of pooled
+    void ApplyFrameFormat();
+
+    // Takes a request of CaptureFormat from the pool, or allocates one if the memory budget allows it
+    FRenderRequestStreamMJPEGStruct *AcquireRenderRequest();
+    void ReleaseRenderRequest(FRenderRequestStreamMJPEGStruct *Request);
+
+    // Charges the actual image allocation of Request to the memory budget
+    void UpdateAccountedBytes(FRenderRequestStreamMJPEGStruct *Request);
+
+    // Queues Request on EncodeQueue with a deadline derived from its capture time
+    void SubmitEncode(FRenderRequestStreamMJPEGStruct *Request);
+
+    // Publishes Request in every format StreamMode asks for and returns it to the pool. Runs on an encode thread
+    void EncodeRequest(FRenderRequestStreamMJPEGStruct *Request);
+
+    // Encodes Request to JPEG and publishes it on the JPEG path and on every region of interest that has clients
+    void PublishJpegFrame(FRenderRequestStreamMJPEGStruct *Request);
+
+    // Whether the JPEG path has region topics: requested ones, or the lower renditions of downgraded clients
+    bool HasRegionTopics() const { return bEnableRegionOfInterest || SlowClientAction == ESlowClientActionMJPEG::Downgrade; }
+
+    // Converts Request to RawFrameFormat and publishes it on the raw path, if anyone is watching
+    void PublishRawFrame(FRenderRequestStreamMJPEGStruct *Request);
+
+    // Encodes the tiles of Request that changed since the last frame and publishes them on the tile path, if anyone is watching
+    void PublishTileFrame(FRenderRequestStreamMJPEGStruct *Request);
+
+    // Waits for in-flight readbacks and frees every queued and pooled request
+    void FlushRenderRequests();
+
+    // Hands the completed requests at the head of RenderRequestQueue to the encode threads.
+    // The caller holds the ReadbackCompletion lock
+    void ProcessCompletedRequests();
+
+    // Broadcasts the slow client events collected by the streamer threads since the last tick
+    void DispatchClientEvents();
 
 public:
     virtual void Tick(float DeltaTime) override;
@@ -0,0 +1,58 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/PlatformAffinity.h"
+
+#include "StreamThreadsMJPEG.generated.h"
+
+// Same order as nadjieb::utils::ThreadPriority
+UENUM(BlueprintType)
+enum class EStreamThreadPriorityMJPEG : uint8
+{
+    Lowest,
+    BelowNormal,
+    Normal,
+    AboveNormal,
+    Highest
+};
+
+// Where the threads of one role (listener, publisher, encoder) run
+USTRUCT(BlueprintType)
+struct FStreamThreadPlacementMJPEG
+{
+    GENERATED_BODY()
+
+    FStreamThreadPlacementMJPEG() = default;
+
+    explicit FStreamThreadPlacementMJPEG(EStreamThreadPriorityMJPEG InPriority)
+        : Priority(InPriority)
+    {
+    }
+
+    // Bit n allows CPU n, 0 = any. Keep the cores of the game and render threads out of it on busy hosts
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Threads")
+    int64 AffinityMask = 0;
+
+    // Below the game and render threads, streaming never delays a frame; at Normal it competes with them
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Stream|Threads")
+    EStreamThreadPriorityMJPEG Priority = EStreamThreadPriorityMJPEG::Normal;
+
+    EThreadPriority GetThreadPriority() const
+    {
+        switch (Priority)
+        {
+        case EStreamThreadPriorityMJPEG::Lowest:
+            return TPri_Lowest;
+        case EStreamThreadPriorityMJPEG::BelowNormal:
+            return TPri_BelowNormal;
+        case EStreamThreadPriorityMJPEG::AboveNormal:
+            return TPri_AboveNormal;
+        case EStreamThreadPriorityMJPEG::Highest:
+            return TPri_Highest;
+        default:
+            return TPri_Normal;
+        }
+    }
+};
@@ -0,0 +1,57 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class IImageWrapper;
+
+/**
+ * Dirty-region stream: splits each frame into TileSize x TileSize tiles, compares them against the previous
+ * frame and encodes only the tiles that changed, each as a small JPEG. One payload per frame (little endian):
+ * a 16-byte header (FourCC "TILE", uint16 width, height, tile size and flags, see KeyFrameFlag, uint32 tile count)
+ * followed by the tiles, each an 8-byte header (uint16 x, y in pixels, uint32 JPEG size) and the JPEG.
+ * Tiles on the right and bottom edge are cut to the frame. Not thread-safe, one encode job at a time.
+ */
+class SCREENSTREAMMJPEGPLUGIN_API FTileStreamMJPEG
+{
+public:
+    static constexpr int32 HeaderSize = 16;
+    static constexpr int32 TileHeaderSize = 8;
+    // Set if the payload holds every tile of the frame, not only the changed ones
+    static constexpr uint16 KeyFrameFlag = 1;
+
+    // Clamped to 16..256, a multiple of 16 so JPEG blocks never straddle two tiles
+    void SetTileSize(int32 InTileSize);
+    int32 GetTileSize() const { return TileSize; }
+
+    // Every Interval-th frame is a key frame, so clients that joined or skipped frames catch up (0 = only on request)
+    void SetKeyFrameInterval(int32 Interval);
+
+    // The next frame sends every tile. Call when a client joins
+    void RequestKeyFrame() { bKeyFrameRequested = true; }
+
+    // Forgets the previous frame, e.g. while nobody watches
+    void Reset();
+
+    // Encodes the tiles of Pixels that differ from the previous frame into Out.
+    // False if nothing changed, there is nothing to send then
+    bool Encode(IImageWrapper &ImageWrapper, const FColor *Pixels, int32 Width, int32 Height, TArray<uint8> &Out);
+
+    // Self-contained page that shows the stream at StreamPath on a canvas, over a WebSocket
+    static FString GetViewerHtml(const FString &StreamPath);
+
+private:
+    int32 TileSize = 64;
+    int32 KeyFrameInterval = 0;
+    int32 FramesSinceKeyFrame = 0;
+    bool bKeyFrameRequested = true;
+
+    // Last frame as sent; only the changed tiles are copied into it
+    TArray<FColor> PreviousFrame;
+    int32 PreviousWidth = 0;
+    int32 PreviousHeight = 0;
+
+    // One tile, contiguous, as the image wrapper wants it
+    TArray<FColor> TileScratch;
+};